@@ -0,0 +1,261 @@
+#include "stdafx.h"
+#include "AsyncLogWriter.h"
+#include "CsvLogger.h"
+#include "Config.h"
+#include <chrono>
+
+AsyncLogArena::AsyncLogArena(LogFile & logger, size_t nFields) :
+	m_Logger(logger),
+	m_pActive(NULL),
+	m_nFields(max(size_t(1), nFields)),
+	m_Overflow(ALO_Drop),
+	m_nRows(0),
+	m_nDropped(0)
+{
+	int nBufferKb = 1024;
+	int nBuffers = 2;
+	std::string strOverflow = "drop";
+	Config::Instance()->assign("CsvLogger/async/bufferSize_kb", nBufferKb);
+	Config::Instance()->assign("CsvLogger/async/buffers", nBuffers);
+	Config::Instance()->assign("CsvLogger/async/overflow", strOverflow);
+	if (strOverflow.compare("block") == 0)
+		m_Overflow = ALO_Block;
+
+	m_nBlockRows = max(size_t(1), size_t(max(1, nBufferKb)) * 1024 / (m_nFields * sizeof(uint64_t)));
+	for (int i = 0; i < max(2, nBuffers); i++)
+	{
+		m_Blocks.emplace_back(new AsyncLogBlock());
+		m_Blocks.back()->slots.resize(m_nBlockRows * m_nFields);
+		m_Blocks.back()->nRows = 0;
+		m_vecFree.push_back(m_Blocks.back().get());
+	}
+}
+
+AsyncLogArena::~AsyncLogArena()
+{
+	AsyncLogWriter::Instance()->removeArena(this);
+	drain();
+}
+
+uint64_t * AsyncLogArena::reserveRow(std::unique_lock<std::mutex> & lk)
+{
+	if (!m_pActive)
+	{
+		if (m_Overflow == ALO_Block)
+			m_CondReturned.wait(lk, [this] { return !m_vecFree.empty(); });
+		else if (m_vecFree.empty())
+		{
+			m_nDropped++;
+			return NULL;
+		}
+		m_pActive = m_vecFree.back();
+		m_vecFree.pop_back();
+	}
+	return m_pActive->slots.data() + m_pActive->nRows * m_nFields;
+}
+
+void AsyncLogArena::commitRow()
+{
+	m_nRows++;
+	if (++m_pActive->nRows == m_nBlockRows)
+		handOff();
+}
+
+void AsyncLogArena::drain()
+{
+	std::unique_lock<std::mutex> lk(m_Mutex);
+	handOff();
+	m_CondReturned.wait(lk, [this] { return m_vecFree.size() == m_Blocks.size(); });
+}
+
+void AsyncLogArena::handOff()
+{
+	if (!m_pActive || m_pActive->nRows == 0)
+		return;
+	AsyncLogWriter::Instance()->submit(this, m_pActive);
+	m_pActive = NULL;
+}
+
+void AsyncLogArena::release(AsyncLogBlock * pBlock)
+{
+	// Notified under the lock, since drain() may destroy the arena as soon as it wakes up
+	std::lock_guard<std::mutex> lk(m_Mutex);
+	pBlock->nRows = 0;
+	m_vecFree.push_back(pBlock);
+	m_CondReturned.notify_all();
+}
+
+AsyncLogWriter::AsyncLogWriter() :
+	m_bTerminating(false),
+	m_nFlushIntervalMs(500),
+	m_nCommitIntervalMs(0),
+	m_nCommitBytes(0),
+	m_nCommitErrors(0),
+	m_nRowsRemoved(0),
+	m_nDroppedRemoved(0)
+{
+	Config::Instance()->assign("CsvLogger/async/flushInterval_ms", m_nFlushIntervalMs);
+	m_nFlushIntervalMs = max(1, m_nFlushIntervalMs);
+	int nCommitKb = 0;
+	Config::Instance()->assign("CsvLogger/durability/commitInterval_ms", m_nCommitIntervalMs);
+	Config::Instance()->assign("CsvLogger/durability/commitSize_kb", nCommitKb);
+	m_nCommitIntervalMs = max(0, m_nCommitIntervalMs);
+	m_nCommitBytes = uint64_t(max(0, nCommitKb)) * 1024;
+	m_Thread = std::thread(&AsyncLogWriter::threadProc, this);
+}
+
+AsyncLogWriter::~AsyncLogWriter()
+{
+	{
+		std::lock_guard<std::mutex> lk(m_MutexQueue);
+		m_bTerminating = true;
+	}
+	m_CondQueue.notify_all();
+	if (m_Thread.joinable())
+		m_Thread.join();
+}
+
+AsyncLogWriter * AsyncLogWriter::Instance()
+{
+	// Constructed by the first asynchronous logger, so it outlives all of them
+	static AsyncLogWriter instance;
+	return &instance;
+}
+
+void AsyncLogWriter::addArena(AsyncLogArena * pArena)
+{
+	std::lock_guard<std::mutex> lk(m_MutexArenas);
+	m_vecArenas.push_back(pArena);
+}
+
+void AsyncLogWriter::removeArena(AsyncLogArena * pArena)
+{
+	std::lock_guard<std::mutex> lk(m_MutexArenas);
+	auto it = std::find(m_vecArenas.begin(), m_vecArenas.end(), pArena);
+	if (it == m_vecArenas.end())
+		return;
+	m_vecArenas.erase(it);
+	m_nRowsRemoved += pArena->getRowCount();
+	m_nDroppedRemoved += pArena->getDroppedCount();
+}
+
+void AsyncLogWriter::submit(AsyncLogArena * pArena, AsyncLogBlock * pBlock)
+{
+	{
+		std::lock_guard<std::mutex> lk(m_MutexQueue);
+		m_Queue.push_back({ pArena, pBlock });
+	}
+	m_CondQueue.notify_one();
+}
+
+void AsyncLogWriter::report(std::function<void(static_control_type, const wchar_t *)> funPrintMessage)
+{
+	uint64_t nRows, nDropped;
+	size_t nLoggers, nQueued;
+	{
+		std::lock_guard<std::mutex> lk(m_MutexArenas);
+		nRows = m_nRowsRemoved;
+		nDropped = m_nDroppedRemoved;
+		for (auto pArena : m_vecArenas)
+		{
+			nRows += pArena->getRowCount();
+			nDropped += pArena->getDroppedCount();
+		}
+		nLoggers = m_vecArenas.size();
+	}
+	{
+		std::lock_guard<std::mutex> lk(m_MutexQueue);
+		nQueued = m_Queue.size();
+	}
+
+	if (funPrintMessage && nLoggers > 0)
+	{
+		const size_t BUFFER_LEN = 128;
+		wchar_t pszText[BUFFER_LEN];
+		const uint64_t nCommitErrors = m_nCommitErrors;
+		if (nCommitErrors > 0)
+			StringCchPrintf(pszText, BUFFER_LEN, L"Logger: %llu rows to %llu files, %llu buffers waiting, dropped %llu, failed commits %llu",
+				nRows, static_cast<uint64_t>(nLoggers), static_cast<uint64_t>(nQueued), nDropped, nCommitErrors);
+		else
+			StringCchPrintf(pszText, BUFFER_LEN, L"Logger: %llu rows to %llu files, %llu buffers waiting for the disk, dropped %llu",
+				nRows, static_cast<uint64_t>(nLoggers), static_cast<uint64_t>(nQueued), nDropped);
+		funPrintMessage(SCT_Logger, pszText);
+	}
+}
+
+void AsyncLogWriter::threadProc()
+{
+	auto tNextFlush = std::chrono::steady_clock::now() + std::chrono::milliseconds(m_nFlushIntervalMs);
+	// Rows written since the last commit are due at tNextCommit, or once they take m_nCommitBytes
+	auto tNextCommit = tNextFlush;
+	bool bUncommitted = false;
+	uint64_t nUncommittedBytes = 0;
+	std::unique_lock<std::mutex> lk(m_MutexQueue);
+	while (true)
+	{
+		auto tWake = tNextFlush;
+		if (bUncommitted && m_nCommitIntervalMs > 0 && tNextCommit < tWake)
+			tWake = tNextCommit;
+		m_CondQueue.wait_until(lk, tWake, [this] { return !m_Queue.empty() || m_bTerminating; });
+		if (std::chrono::steady_clock::now() >= tNextFlush)
+		{
+			// Hand off the rows of loggers that have not filled a buffer in a while
+			lk.unlock();
+			{
+				std::lock_guard<std::mutex> lkArenas(m_MutexArenas);
+				for (auto pArena : m_vecArenas)
+				{
+					std::lock_guard<std::mutex> lkArena(pArena->m_Mutex);
+					pArena->handOff();
+				}
+			}
+			tNextFlush = std::chrono::steady_clock::now() + std::chrono::milliseconds(m_nFlushIntervalMs);
+			lk.lock();
+		}
+
+		while (!m_Queue.empty())
+		{
+			Pending pending = m_Queue.front();
+			m_Queue.pop_front();
+			lk.unlock();
+			// One large sequential write per buffer
+			LogFile & logger = pending.pArena->m_Logger;
+			const uint64_t nFileSize = logger.getFileSize();
+			logger.writeRows(pending.pBlock->slots.data(), pending.pBlock->nRows);
+			logger.flushFile();
+			if (isCommitEnabled())
+			{
+				if (!bUncommitted)
+					tNextCommit = std::chrono::steady_clock::now() + std::chrono::milliseconds(m_nCommitIntervalMs);
+				bUncommitted = true;
+				nUncommittedBytes += logger.getFileSize() - nFileSize;
+			}
+			pending.pArena->release(pending.pBlock);
+			lk.lock();
+		}
+
+		if (bUncommitted &&
+			((m_nCommitIntervalMs > 0 && std::chrono::steady_clock::now() >= tNextCommit) ||
+			(m_nCommitBytes > 0 && nUncommittedBytes >= m_nCommitBytes)))
+		{
+			lk.unlock();
+			commitAll();
+			bUncommitted = false;
+			nUncommittedBytes = 0;
+			lk.lock();
+		}
+		if (m_bTerminating)
+			break;
+	}
+}
+
+void AsyncLogWriter::commitAll()
+{
+	// The loggers stay alive while they are listed, and their files are only written by this thread
+	std::lock_guard<std::mutex> lkArenas(m_MutexArenas);
+	for (auto pArena : m_vecArenas)
+	{
+		if (!pArena->m_Logger.commitFile())
+			m_nCommitErrors++;
+	}
+}
@@ -0,0 +1,133 @@
+#pragma once
+#include "stdafx.h"
+#include <atomic>
+#include <condition_variable>
+#include <deque>
+#include <memory>
+#include <mutex>
+#include <string>
+#include <thread>
+#include <vector>
+
+class LogFile;
+
+enum async_log_overflow
+{
+	ALO_Drop = 0,   // rows are dropped and counted while all buffers are waiting for the writer
+	ALO_Block       // the producer waits for the writer to return a buffer
+};
+
+// Rows of one logger on their way to the writer thread, one 64-bit slot per field
+struct AsyncLogBlock
+{
+	std::vector<uint64_t>   slots;
+	size_t                  nRows;
+};
+
+// The buffers of one logger. The producer copies its values into the active buffer, which is
+// handed to the writer thread once it is full or once the flush interval has passed. Each
+// logger is fed by a single thread, so the lock is only contended by the writer thread.
+class AsyncLogArena
+{
+	friend class AsyncLogWriter;
+private:
+	LogFile &               m_Logger;
+	std::mutex              m_Mutex;
+	std::condition_variable m_CondReturned;
+	std::vector<std::unique_ptr<AsyncLogBlock>> m_Blocks;
+	std::vector<AsyncLogBlock *> m_vecFree;
+	AsyncLogBlock *         m_pActive;
+	size_t                  m_nFields;
+	size_t                  m_nBlockRows;
+	async_log_overflow      m_Overflow;
+
+	std::atomic<uint64_t>   m_nRows;
+	std::atomic<uint64_t>   m_nDropped;
+
+public:
+	// Reads the "CsvLogger/async/..." parameters
+	AsyncLogArena(LogFile & logger, size_t nFields);
+	~AsyncLogArena();
+
+	// Lets funEncode(uint64_t * pSlots) store a row into the active buffer. Returns false if
+	// the row was dropped.
+	template <typename Encode>
+	bool append(Encode funEncode)
+	{
+		std::unique_lock<std::mutex> lk(m_Mutex);
+		uint64_t * pSlots = reserveRow(lk);
+		if (!pSlots)
+			return false;
+		funEncode(pSlots);
+		commitRow();
+		return true;
+	}
+
+	// Hands the rows logged so far to the writer thread and waits until they are written
+	void drain();
+
+	size_t getBlockBytes() const { return m_nBlockRows * m_nFields * sizeof(uint64_t); }
+	uint64_t getRowCount() const { return m_nRows; }
+	uint64_t getDroppedCount() const { return m_nDropped; }
+
+private:
+	// Expect m_Mutex to be held
+	uint64_t * reserveRow(std::unique_lock<std::mutex> & lk);
+	void commitRow();
+	void handOff();
+	void release(AsyncLogBlock * pBlock);
+};
+
+// The writer thread shared by all asynchronous loggers. It formats the rows of full buffers
+// into the files of their loggers and writes every buffer out in one piece.
+class AsyncLogWriter
+{
+private:
+	struct Pending
+	{
+		AsyncLogArena *     pArena;
+		AsyncLogBlock *     pBlock;
+	};
+
+	// Lock order: m_MutexArenas, then an arena, then m_MutexQueue
+	std::mutex              m_MutexArenas;
+	std::vector<AsyncLogArena *> m_vecArenas;
+	std::mutex              m_MutexQueue;
+	std::condition_variable m_CondQueue;
+	std::deque<Pending>     m_Queue;
+	bool                    m_bTerminating;
+	int                     m_nFlushIntervalMs;
+	// Group commits, see commitAll(). Off if both are 0.
+	int                     m_nCommitIntervalMs;
+	uint64_t                m_nCommitBytes;
+	std::atomic<uint64_t>   m_nCommitErrors;
+	std::thread             m_Thread;
+
+	// Totals of the arenas that have been removed
+	uint64_t                m_nRowsRemoved;
+	uint64_t                m_nDroppedRemoved;
+
+	AsyncLogWriter();
+	AsyncLogWriter(AsyncLogWriter const &) = delete;
+	AsyncLogWriter & operator=(AsyncLogWriter const &) = delete;
+
+public:
+	~AsyncLogWriter();
+	static AsyncLogWriter * Instance();
+
+	void addArena(AsyncLogArena * pArena);
+	void removeArena(AsyncLogArena * pArena);
+	void submit(AsyncLogArena * pArena, AsyncLogBlock * pBlock);
+
+	// Whether the files are committed to the disk periodically, see "CsvLogger/durability/..."
+	bool isCommitEnabled() const { return m_nCommitIntervalMs > 0 || m_nCommitBytes > 0; }
+
+	// Rows written and dropped by all loggers and the buffers waiting for the writer, for
+	// the status list
+	void report(std::function<void(static_control_type, const wchar_t *)> funPrintMessage);
+
+private:
+	void threadProc();
+	// Forces the rows written so far by all loggers to the disk, with one sync per file
+	void commitAll();
+};
@@ -0,0 +1,522 @@
+#include "stdafx.h"
+#include "BinaryLog.h"
+#include "CsvLogger.h"
+#include "Crc32.h"
+#include "LogIndex.h"
+#include "NumberFormat.h"
+#include <cmath>
+#include <cstring>
+#include <stdexcept>
+
+static const size_t PADDING = 8;
+
+static size_t padTo(size_t n, size_t nAlignment)
+{
+	return (n + nAlignment - 1) / nAlignment * nAlignment;
+}
+
+static void writePadding(std::ofstream & file, size_t n)
+{
+	static const char zeros[PADDING] = {};
+	file.write(zeros, n);
+}
+
+size_t getBinaryLogTypeWidth(binary_log_type type)
+{
+	switch (type)
+	{
+	case BLT_Uint64: return sizeof(uint64_t);
+	case BLT_Float: return sizeof(float);
+	case BLT_String: return sizeof(uint32_t);
+	default: throw std::runtime_error("BinaryLog: Unknown value type.");
+	}
+}
+
+static void writeVarint(std::vector<uint8_t> & out, uint64_t n)
+{
+	while (n >= 0x80)
+	{
+		out.push_back(static_cast<uint8_t>(n | 0x80));
+		n >>= 7;
+	}
+	out.push_back(static_cast<uint8_t>(n));
+}
+
+static bool readVarint(const uint8_t *& p, const uint8_t * pEnd, uint64_t & n)
+{
+	n = 0;
+	for (int nShift = 0; p < pEnd && nShift < 64; nShift += 7)
+	{
+		const uint8_t b = *p++;
+		n |= uint64_t(b & 0x7f) << nShift;
+		if (!(b & 0x80))
+			return true;
+	}
+	return false;
+}
+
+static uint64_t zigzag(uint64_t n)
+{
+	return (n << 1) ^ static_cast<uint64_t>(static_cast<int64_t>(n) >> 63);
+}
+
+static uint64_t unzigzag(uint64_t n)
+{
+	return (n >> 1) ^ (0 - (n & 1));
+}
+
+BinaryLogWriter::BinaryLogWriter(std::ofstream & file, const std::vector<BinaryLogField> & fields, size_t nChunkRows, bool bCompressed) :
+	m_File(file),
+	m_nChunkRows(max(size_t(1), nChunkRows)),
+	m_nRows(0),
+	m_bCompressed(bCompressed),
+	m_pIndex(nullptr),
+	m_iIndexField(0),
+	m_nChunkCrc(0)
+{
+	BinaryLogFileHeader header = {};
+	memcpy(header.magic, BINARY_LOG_MAGIC, sizeof(header.magic));
+	header.nFields = static_cast<uint32_t>(fields.size());
+	header.nFlags = BLF_Checksums | (bCompressed ? BLF_Compressed : 0);
+	m_File.write(reinterpret_cast<const char *>(&header), sizeof(header));
+
+	size_t nBytes = 0;
+	for (auto & field : fields)
+	{
+		Column column;
+		column.type = field.type;
+		column.fResolution = field.fResolution;
+		column.data.resize(m_nChunkRows * getBinaryLogTypeWidth(column.type));
+		m_Columns.push_back(std::move(column));
+
+		const uint8_t type = static_cast<uint8_t>(field.type);
+		const uint8_t nNameLength = static_cast<uint8_t>(min(field.strName.size(), size_t(255)));
+		m_File.write(reinterpret_cast<const char *>(&type), 1);
+		m_File.write(reinterpret_cast<const char *>(&nNameLength), 1);
+		m_File.write(field.strName.data(), nNameLength);
+		nBytes += 2 + nNameLength;
+	}
+	writePadding(m_File, padTo(nBytes, PADDING) - nBytes);
+}
+
+BinaryLogWriter::~BinaryLogWriter()
+{
+	flush();
+}
+
+void BinaryLogWriter::append(const uint64_t * pSlots)
+{
+	for (size_t i = 0; i < m_Columns.size(); i++)
+	{
+		Column & column = m_Columns[i];
+		switch (column.type)
+		{
+		case BLT_Uint64:
+			reinterpret_cast<uint64_t *>(column.data.data())[m_nRows] = pSlots[i];
+			break;
+		case BLT_Float:
+			reinterpret_cast<float *>(column.data.data())[m_nRows] = ValueType::loadFloat(pSlots[i]);
+			break;
+		case BLT_String:
+			reinterpret_cast<uint32_t *>(column.data.data())[m_nRows] = getStringId(ValueType::loadString(pSlots[i]));
+			break;
+		default:
+			break;
+		}
+	}
+	if (++m_nRows == m_nChunkRows)
+		flush();
+}
+
+void BinaryLogWriter::flush()
+{
+	if (m_nRows == 0)
+		return;
+
+	size_t nStrings = 0;
+	size_t nStringBytes = 0;
+	for (size_t i = 0; i < m_vecStrings.size(); i++)
+	{
+		if (!m_vecStringUsed[i])
+			continue;
+		nStrings++;
+		nStringBytes += 2 * sizeof(uint32_t) + padTo(m_vecStrings[i].size(), 4);
+	}
+
+	// Compressed columns are encoded one after the other into m_Encoded, so that the payload
+	// size is known before the chunk header is written
+	std::vector<BinaryLogColumnHeader> vecColumnHeaders;
+	size_t nPayloadBytes = padTo(nStringBytes, PADDING);
+	m_Encoded.clear();
+	for (auto & column : m_Columns)
+	{
+		if (m_bCompressed)
+		{
+			const size_t nStart = m_Encoded.size();
+			BinaryLogColumnHeader columnHeader = {};
+			columnHeader.nEncoding = static_cast<uint8_t>(encodeColumn(column));
+			columnHeader.nBytes = static_cast<uint32_t>(m_Encoded.size() - nStart);
+			columnHeader.fResolution = columnHeader.nEncoding == BLE_Quantized ? column.fResolution : 0;
+			m_Encoded.resize(nStart + padTo(columnHeader.nBytes, PADDING));
+			vecColumnHeaders.push_back(columnHeader);
+			nPayloadBytes += sizeof(columnHeader);
+		}
+		else
+			nPayloadBytes += padTo(m_nRows * getBinaryLogTypeWidth(column.type), PADDING);
+	}
+	nPayloadBytes += m_Encoded.size();
+
+	const uint64_t nChunkOffset = static_cast<uint64_t>(m_File.tellp());
+	BinaryLogChunkHeader header;
+	header.nMagic = BINARY_LOG_CHUNK_MAGIC;
+	header.nRows = static_cast<uint32_t>(m_nRows);
+	header.nStrings = static_cast<uint32_t>(nStrings);
+	header.nPayloadBytes = static_cast<uint32_t>(nPayloadBytes);
+	m_nChunkCrc = 0;
+	writeChunk(&header, sizeof(header));
+
+	for (size_t i = 0; i < m_vecStrings.size(); i++)
+	{
+		if (!m_vecStringUsed[i])
+			continue;
+		const std::string & str = m_vecStrings[i];
+		const uint32_t entry[2] = { static_cast<uint32_t>(i), static_cast<uint32_t>(str.size()) };
+		writeChunk(entry, sizeof(entry));
+		writeChunk(str.data(), str.size());
+		writeChunkPadding(padTo(str.size(), 4) - str.size());
+		m_vecStringUsed[i] = false;
+	}
+	writeChunkPadding(padTo(nStringBytes, PADDING) - nStringBytes);
+
+	size_t nOffset = 0;
+	for (size_t i = 0; i < m_Columns.size(); i++)
+	{
+		if (m_bCompressed)
+		{
+			const size_t nBytes = padTo(vecColumnHeaders[i].nBytes, PADDING);
+			writeChunk(&vecColumnHeaders[i], sizeof(BinaryLogColumnHeader));
+			writeChunk(m_Encoded.data() + nOffset, nBytes);
+			nOffset += nBytes;
+			continue;
+		}
+		const size_t nBytes = m_nRows * getBinaryLogTypeWidth(m_Columns[i].type);
+		writeChunk(m_Columns[i].data.data(), nBytes);
+		writeChunkPadding(padTo(nBytes, PADDING) - nBytes);
+	}
+
+	const BinaryLogChunkTrailer trailer = { m_nChunkCrc, 0 };
+	m_File.write(reinterpret_cast<const char *>(&trailer), sizeof(trailer));
+
+	if (m_pIndex)
+	{
+		const uint64_t * pKeys = reinterpret_cast<const uint64_t *>(m_Columns[m_iIndexField].data.data());
+		const auto range = std::minmax_element(pKeys, pKeys + m_nRows);
+		m_pIndex->addBlock(nChunkOffset, m_nRows, sizeof(header) + nPayloadBytes + sizeof(trailer), m_nChunkCrc,
+			*range.first, *range.second);
+	}
+	m_nRows = 0;
+}
+
+void BinaryLogWriter::writeChunk(const void * pData, size_t nBytes)
+{
+	m_File.write(static_cast<const char *>(pData), nBytes);
+	m_nChunkCrc = updateCrc32(m_nChunkCrc, pData, nBytes);
+}
+
+void BinaryLogWriter::writeChunkPadding(size_t nBytes)
+{
+	static const char zeros[PADDING] = {};
+	writeChunk(zeros, nBytes);
+}
+
+binary_log_encoding BinaryLogWriter::encodeColumn(const Column & column)
+{
+	const size_t nStart = m_Encoded.size();
+	switch (column.type)
+	{
+	case BLT_Uint64:
+	{
+		// Timestamps advance in near-constant steps, which leaves zeros and small numbers
+		const uint64_t * pValues = reinterpret_cast<const uint64_t *>(column.data.data());
+		uint64_t nPrevious = 0, nPreviousDelta = 0;
+		for (size_t i = 0; i < m_nRows; i++)
+		{
+			const uint64_t nDelta = pValues[i] - nPrevious;
+			writeVarint(m_Encoded, i == 0 ? pValues[0] : zigzag(nDelta - nPreviousDelta));
+			nPreviousDelta = i == 0 ? 0 : nDelta;
+			nPrevious = pValues[i];
+		}
+		return BLE_DeltaDelta;
+	}
+	case BLT_Float:
+	{
+		if (column.fResolution <= 0)
+			break;
+		const float * pValues = reinterpret_cast<const float *>(column.data.data());
+		const double fScale = 1.0 / column.fResolution;
+		int64_t nPrevious = 0;
+		size_t i = 0;
+		for (; i < m_nRows; i++)
+		{
+			const double fSteps = pValues[i] * fScale;
+			// Not a finite number of steps, so the column is written exactly
+			if (!(fabs(fSteps) < 4.0e15))
+				break;
+			const int64_t nSteps = llround(fSteps);
+			writeVarint(m_Encoded, zigzag(static_cast<uint64_t>(nSteps - nPrevious)));
+			nPrevious = nSteps;
+		}
+		if (i == m_nRows)
+			return BLE_Quantized;
+		m_Encoded.resize(nStart);
+		break;
+	}
+	case BLT_String:
+	{
+		const uint32_t * pIds = reinterpret_cast<const uint32_t *>(column.data.data());
+		for (size_t i = 0; i < m_nRows; i++)
+			writeVarint(m_Encoded, pIds[i]);
+		return BLE_Varint;
+	}
+	default:
+		break;
+	}
+
+	const uint8_t * pData = column.data.data();
+	m_Encoded.insert(m_Encoded.end(), pData, pData + m_nRows * getBinaryLogTypeWidth(column.type));
+	return BLE_Raw;
+}
+
+uint32_t BinaryLogWriter::getStringId(const char * psz)
+{
+	auto it = m_mapStringIds.find(psz);
+	if (it != m_mapStringIds.end() && m_vecStrings[it->second].compare(psz) == 0)
+	{
+		m_vecStringUsed[it->second] = true;
+		return it->second;
+	}
+
+	// Reuse the id of an equal string logged from another address
+	uint32_t id = static_cast<uint32_t>(std::find(m_vecStrings.begin(), m_vecStrings.end(), psz) - m_vecStrings.begin());
+	if (id == m_vecStrings.size())
+	{
+		m_vecStrings.push_back(psz);
+		m_vecStringUsed.push_back(false);
+	}
+	m_mapStringIds[psz] = id;
+	m_vecStringUsed[id] = true;
+	return id;
+}
+
+BinaryLogReader::BinaryLogReader(const std::string & strFileName) :
+	m_File(strFileName, std::ios::binary),
+	m_bCompressed(false),
+	m_bChecksums(false),
+	m_nRows(0)
+{
+	BinaryLogFileHeader header;
+	if (!m_File.read(reinterpret_cast<char *>(&header), sizeof(header)) ||
+		memcmp(header.magic, BINARY_LOG_MAGIC, sizeof(header.magic)) != 0)
+		throw std::runtime_error("Not a binary log file:\n" + strFileName);
+	m_bCompressed = (header.nFlags & BLF_Compressed) != 0;
+	m_bChecksums = (header.nFlags & BLF_Checksums) != 0;
+
+	size_t nBytes = 0;
+	for (uint32_t i = 0; i < header.nFields; i++)
+	{
+		uint8_t typeAndLength[2];
+		if (!m_File.read(reinterpret_cast<char *>(typeAndLength), 2) || typeAndLength[0] >= BLT_Count)
+			throw std::runtime_error("Corrupt binary log header:\n" + strFileName);
+		Field field;
+		field.type = static_cast<binary_log_type>(typeAndLength[0]);
+		field.strName.resize(typeAndLength[1]);
+		field.fResolution = 0;
+		m_File.read(&field.strName[0], typeAndLength[1]);
+		m_vecFields.push_back(field);
+		nBytes += 2 + typeAndLength[1];
+	}
+	m_File.ignore(padTo(nBytes, PADDING) - nBytes);
+	m_vecColumns.resize(m_vecFields.size());
+	m_vecDecoded.resize(m_vecFields.size());
+}
+
+bool BinaryLogReader::nextChunk()
+{
+	BinaryLogChunkHeader header;
+	if (!m_File.read(reinterpret_cast<char *>(&header), sizeof(header)) || header.nMagic != BINARY_LOG_CHUNK_MAGIC)
+		return false;
+	m_Payload.resize(header.nPayloadBytes);
+	if (!m_File.read(reinterpret_cast<char *>(m_Payload.data()), header.nPayloadBytes))
+		return false;
+	if (m_bChecksums)
+	{
+		// A chunk that was torn or damaged ends the log
+		BinaryLogChunkTrailer trailer;
+		if (!m_File.read(reinterpret_cast<char *>(&trailer), sizeof(trailer)) ||
+			trailer.nCrc != updateCrc32(updateCrc32(0, &header, sizeof(header)), m_Payload.data(), m_Payload.size()))
+			return false;
+	}
+
+	const uint8_t * p = m_Payload.data();
+	const uint8_t * pEnd = p + m_Payload.size();
+	for (uint32_t i = 0; i < header.nStrings; i++)
+	{
+		uint32_t entry[2];
+		if (p + sizeof(entry) > pEnd)
+			return false;
+		memcpy(entry, p, sizeof(entry));
+		p += sizeof(entry);
+		if (p + entry[1] > pEnd)
+			return false;
+		if (m_vecStrings.size() <= entry[0])
+			m_vecStrings.resize(entry[0] + 1);
+		m_vecStrings[entry[0]].assign(reinterpret_cast<const char *>(p), entry[1]);
+		p += padTo(entry[1], 4);
+	}
+	p = m_Payload.data() + padTo(p - m_Payload.data(), PADDING);
+
+	for (size_t i = 0; i < m_vecFields.size(); i++)
+	{
+		if (m_bCompressed)
+		{
+			BinaryLogColumnHeader columnHeader;
+			if (p + sizeof(columnHeader) > pEnd)
+				return false;
+			memcpy(&columnHeader, p, sizeof(columnHeader));
+			p += sizeof(columnHeader);
+			if (p + columnHeader.nBytes > pEnd || !decodeColumn(i, columnHeader, p, header.nRows))
+				return false;
+			p += padTo(columnHeader.nBytes, PADDING);
+			continue;
+		}
+		const size_t nBytes = header.nRows * getBinaryLogTypeWidth(m_vecFields[i].type);
+		if (p + nBytes > pEnd)
+			return false;
+		m_vecColumns[i] = p;
+		p += padTo(nBytes, PADDING);
+	}
+	m_nRows = header.nRows;
+	return true;
+}
+
+void BinaryLogReader::seek(uint64_t nOffset)
+{
+	m_File.clear();
+	m_File.seekg(static_cast<std::streamoff>(nOffset));
+	m_nRows = 0;
+}
+
+bool BinaryLogReader::decodeColumn(size_t iField, const BinaryLogColumnHeader & header, const uint8_t * p, size_t nRows)
+{
+	const uint8_t * pEnd = p + header.nBytes;
+	const binary_log_type type = m_vecFields[iField].type;
+	std::vector<uint64_t> & decoded = m_vecDecoded[iField];
+	decoded.resize(max(size_t(1), nRows));
+	m_vecColumns[iField] = reinterpret_cast<const uint8_t *>(decoded.data());
+
+	uint64_t n;
+	switch (header.nEncoding)
+	{
+	case BLE_Raw:
+		if (header.nBytes != nRows * getBinaryLogTypeWidth(type))
+			return false;
+		memcpy(decoded.data(), p, header.nBytes);
+		return true;
+	case BLE_DeltaDelta:
+	{
+		if (type != BLT_Uint64)
+			return false;
+		uint64_t nPrevious = 0, nDelta = 0;
+		for (size_t i = 0; i < nRows; i++)
+		{
+			if (!readVarint(p, pEnd, n))
+				return false;
+			if (i == 0)
+				decoded[0] = n;
+			else
+			{
+				nDelta += unzigzag(n);
+				decoded[i] = nPrevious + nDelta;
+			}
+			nPrevious = decoded[i];
+		}
+		return true;
+	}
+	case BLE_Quantized:
+	{
+		if (type != BLT_Float)
+			return false;
+		float * pValues = reinterpret_cast<float *>(decoded.data());
+		int64_t nSteps = 0;
+		for (size_t i = 0; i < nRows; i++)
+		{
+			if (!readVarint(p, pEnd, n))
+				return false;
+			nSteps += static_cast<int64_t>(unzigzag(n));
+			pValues[i] = static_cast<float>(nSteps * header.fResolution);
+		}
+		return true;
+	}
+	case BLE_Varint:
+	{
+		if (type != BLT_String)
+			return false;
+		uint32_t * pIds = reinterpret_cast<uint32_t *>(decoded.data());
+		for (size_t i = 0; i < nRows; i++)
+		{
+			if (!readVarint(p, pEnd, n))
+				return false;
+			pIds[i] = static_cast<uint32_t>(n);
+		}
+		return true;
+	}
+	default:
+		return false;
+	}
+}
+
+const char * BinaryLogReader::getString(size_t iField, size_t iRow) const
+{
+	uint32_t id = reinterpret_cast<const uint32_t *>(m_vecColumns[iField])[iRow];
+	return id < m_vecStrings.size() ? m_vecStrings[id].c_str() : "";
+}
+
+uint64_t BinaryLogReader::convertToCsv(const std::string & strBinaryFile, const std::string & strCsvFile)
+{
+	BinaryLogReader reader(strBinaryFile);
+	std::ofstream file(strCsvFile, std::ofstream::out | std::ofstream::binary);
+	if (!file.is_open())
+		throw std::runtime_error("Cannot open file\n" + strCsvFile);
+
+	// Same layout and line breaks as CsvLogger::log() with the default precision
+	const auto & fields = reader.getFields();
+	for (auto & field : fields)
+		file << field.strName << ',';
+	file << "\r\n";
+
+	uint64_t nRows = 0;
+	std::string strLine;
+	char buffer[NUMBER_FORMAT_MAX_LENGTH];
+	while (reader.nextChunk())
+	{
+		for (size_t iRow = 0; iRow < reader.getRowCount(); iRow++)
+		{
+			strLine.clear();
+			for (size_t i = 0; i < fields.size(); i++)
+			{
+				switch (fields[i].type)
+				{
+				case BLT_Uint64: strLine.append(buffer, formatUint64(buffer, reader.getUint64Column(i)[iRow])); break;
+				case BLT_Float: strLine.append(buffer, formatFloat(buffer, reader.getFloatColumn(i)[iRow])); break;
+				case BLT_String: strLine.append(reader.getString(i, iRow)); break;
+				default: break;
+				}
+				strLine += ',';
+			}
+			strLine += "\r\n";
+			file.write(strLine.data(), strLine.size());
+		}
+		nRows += reader.getRowCount();
+	}
+	return nRows;
+}
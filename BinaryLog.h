@@ -0,0 +1,179 @@
+#pragma once
+#include <cstdint>
+#include <fstream>
+#include <string>
+#include <unordered_map>
+#include <vector>
+
+class LogIndexWriter;
+
+// Binary session log, written by CsvLogger when "CsvLogger/format" is "binary".
+//
+// The file starts with a BinaryLogFileHeader followed by one BinaryLogField record per column
+// (type, name length, name), padded to 8 bytes. The rows follow in chunks: a
+// BinaryLogChunkHeader, the strings used in the chunk (id, length, characters, padded to 4
+// bytes), each column padded to 8 bytes, and with BLF_Checksums a BinaryLogChunkTrailer.
+// String columns hold ids of those strings, so every chunk can be decoded by itself.
+//
+// In an uncompressed file a column is a fixed-width array of nRows values, which can be used
+// in place once the file is memory-mapped. With BLF_Compressed every column starts with a
+// BinaryLogColumnHeader and is encoded as given there, see binary_log_encoding.
+
+const char BINARY_LOG_MAGIC[8] = { 'B', 'T', 'L', 'O', 'G', 0, 0, 1 };
+const uint32_t BINARY_LOG_CHUNK_MAGIC = 0x4b4e4843; // "CHNK"
+
+enum binary_log_type
+{
+	BLT_Uint64 = 0,
+	BLT_Float,
+	BLT_String,     // stored as uint32 string id
+	BLT_Count
+};
+
+// Flags of BinaryLogFileHeader
+enum binary_log_flag
+{
+	BLF_Compressed = 1,
+	BLF_Checksums = 2       // every chunk is followed by a BinaryLogChunkTrailer
+};
+
+// Encodings of the columns of compressed files. Signed numbers are zigzag-encoded varints.
+enum binary_log_encoding
+{
+	BLE_Raw = 0,        // fixed-width array as in uncompressed files
+	BLE_DeltaDelta,     // uint64: the first value, then the change of the difference to the previous value
+	BLE_Quantized,      // float: the value in steps of fResolution, then the difference to the previous one
+	BLE_Varint,         // string id: varints
+	BLE_Count
+};
+
+struct BinaryLogFileHeader
+{
+	char                    magic[8];
+	uint32_t                nFields;
+	uint32_t                nFlags;         // binary_log_flag
+};
+
+struct BinaryLogChunkHeader
+{
+	uint32_t                nMagic;
+	uint32_t                nRows;
+	uint32_t                nStrings;       // strings used in this chunk
+	uint32_t                nPayloadBytes;  // bytes following this header
+};
+
+struct BinaryLogChunkTrailer
+{
+	uint32_t                nCrc;           // CRC-32 of the chunk header and payload
+	uint32_t                nReserved;
+};
+
+struct BinaryLogColumnHeader
+{
+	uint8_t                 nEncoding;      // binary_log_encoding
+	uint8_t                 nReserved[3];
+	uint32_t                nBytes;         // encoded bytes following this header, before padding
+	double                  fResolution;    // BLE_Quantized
+};
+
+struct BinaryLogField
+{
+	binary_log_type         type;
+	std::string             strName;
+	// Step that float columns of compressed files are rounded to; 0 keeps them exact
+	double                  fResolution;
+};
+
+size_t getBinaryLogTypeWidth(binary_log_type type);
+
+// Collects rows column by column and writes them out a chunk at a time
+class BinaryLogWriter
+{
+private:
+	struct Column
+	{
+		binary_log_type     type;
+		double              fResolution;
+		std::vector<uint8_t> data;
+	};
+
+	std::ofstream &         m_File;
+	std::vector<Column>     m_Columns;
+	size_t                  m_nChunkRows;
+	size_t                  m_nRows;
+	bool                    m_bCompressed;
+	std::vector<uint8_t>    m_Encoded;
+
+	// String ids by the address they were logged from; the content is checked on every hit
+	std::unordered_map<const char *, uint32_t> m_mapStringIds;
+	std::vector<std::string> m_vecStrings;
+	std::vector<bool>       m_vecStringUsed;    // in the current chunk
+
+	LogIndexWriter *        m_pIndex;
+	size_t                  m_iIndexField;
+	uint32_t                m_nChunkCrc;
+
+public:
+	// Writes the file header with the names and types of the fields
+	BinaryLogWriter(std::ofstream & file, const std::vector<BinaryLogField> & fields, size_t nChunkRows, bool bCompressed = false);
+	~BinaryLogWriter();
+
+	// Copies a row of values in the format of ValueType::load() into the chunk, which is written
+	// out when it is full
+	void append(const uint64_t * pSlots);
+	void flush();
+
+	// Adds every chunk to pIndex, keyed by the uint64 field iField
+	void setIndex(LogIndexWriter * pIndex, size_t iField) { m_pIndex = pIndex; m_iIndexField = iField; }
+
+private:
+	uint32_t getStringId(const char * psz);
+	// Write a part of a chunk and add it to m_nChunkCrc
+	void writeChunk(const void * pData, size_t nBytes);
+	void writeChunkPadding(size_t nBytes);
+	// Encodes the column of the current chunk into m_Encoded and returns the encoding
+	binary_log_encoding encodeColumn(const Column & column);
+};
+
+// Sequential reader of a binary log, for the csv converter and offline tools
+class BinaryLogReader
+{
+public:
+	typedef BinaryLogField Field;
+
+private:
+	std::ifstream           m_File;
+	std::vector<Field>      m_vecFields;
+	bool                    m_bCompressed;
+	bool                    m_bChecksums;
+	std::vector<std::string> m_vecStrings;
+	std::vector<uint8_t>    m_Payload;
+	std::vector<const uint8_t *> m_vecColumns;
+	std::vector<std::vector<uint64_t>> m_vecDecoded;    // columns of compressed chunks
+	size_t                  m_nRows;
+
+public:
+	// Throws std::runtime_error if the file cannot be opened or is not a binary log
+	explicit BinaryLogReader(const std::string & strFileName);
+
+	const std::vector<Field> & getFields() const { return m_vecFields; }
+	bool isCompressed() const { return m_bCompressed; }
+
+	// Reads the next chunk. Returns false at the end of the file or at a truncated or damaged chunk.
+	bool nextChunk();
+	// Continues at the chunk at byte nOffset of the file, e.g. from LogIndex
+	void seek(uint64_t nOffset);
+	// Byte offset of the next chunk
+	uint64_t tell() { return static_cast<uint64_t>(m_File.tellg()); }
+	size_t getRowCount() const { return m_nRows; }
+	const uint64_t * getUint64Column(size_t iField) const { return reinterpret_cast<const uint64_t *>(m_vecColumns[iField]); }
+	const float * getFloatColumn(size_t iField) const { return reinterpret_cast<const float *>(m_vecColumns[iField]); }
+	const char * getString(size_t iField, size_t iRow) const;
+
+	// Writes the log as a csv file in the format of CsvLogger. Returns the number of rows.
+	static uint64_t convertToCsv(const std::string & strBinaryFile, const std::string & strCsvFile);
+
+private:
+	// Decodes a column of a compressed chunk into m_vecDecoded[iField]
+	bool decodeColumn(size_t iField, const BinaryLogColumnHeader & header, const uint8_t * p, size_t nRows);
+};
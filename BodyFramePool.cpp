@@ -0,0 +1,62 @@
+#include "BodyFramePool.h"
+
+void BodyFrameRef::reset()
+{
+	if (m_p && --m_p->m_nRefCount == 0)
+		m_p->m_pPool->release(m_p);
+	m_p = nullptr;
+}
+
+BodyFramePool::BodyFramePool(size_t nSize) :
+	m_pFrames(new BodyFrame[max(nSize, size_t(1))]),
+	m_nSize(max(nSize, size_t(1))),
+	m_pFreeList(nullptr),
+	m_nFree(0),
+	m_nExhausted(0)
+{
+	for (size_t i = m_nSize; i-- > 0; )
+	{
+		m_pFrames[i].m_pPool = this;
+		m_pFrames[i].m_pNextFree = m_pFreeList;
+		m_pFreeList = &m_pFrames[i];
+	}
+	m_nFree = m_nSize;
+}
+
+BodyFrameRef BodyFramePool::acquire()
+{
+	BodyFrame * pFrame;
+	{
+		std::lock_guard<std::mutex> lk(m_Mutex);
+		pFrame = m_pFreeList;
+		if (pFrame)
+		{
+			m_pFreeList = pFrame->m_pNextFree;
+			m_nFree--;
+		}
+	}
+	if (!pFrame)
+	{
+		m_nExhausted++;
+		return BodyFrameRef();
+	}
+	pFrame->m_pNextFree = nullptr;
+	pFrame->m_nRefCount = 1;
+	pFrame->num_bodies = 0;
+	pFrame->stamps = LatencyStamps();
+	return BodyFrameRef(pFrame);
+}
+
+size_t BodyFramePool::available()
+{
+	std::lock_guard<std::mutex> lk(m_Mutex);
+	return m_nFree;
+}
+
+void BodyFramePool::release(BodyFrame * pFrame)
+{
+	std::lock_guard<std::mutex> lk(m_Mutex);
+	pFrame->m_pNextFree = m_pFreeList;
+	m_pFreeList = pFrame;
+	m_nFree++;
+}
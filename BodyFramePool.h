@@ -0,0 +1,179 @@
+#pragma once
+#include "stdafx.h"
+#include "LatencyStats.h"
+#include <atomic>
+#include <memory>
+#include <mutex>
+
+const size_t MAX_NUM_BODIES = 6;
+
+// Joints stored per body: K4ABT_JOINT_COUNT padded to a multiple of the SIMD width
+const size_t JOINT_STRIDE = 28;
+const size_t MAX_NUM_JOINTS = MAX_NUM_BODIES * JOINT_STRIDE;
+
+// Joints of all bodies in structure-of-arrays layout, so that one operation can be applied
+// to every joint of every body at once (see SkeletonKernels.h). Joint j of body i is at
+// index i * JOINT_STRIDE + j. The padding entries are kept at zero.
+struct JointArrays
+{
+	alignas(16) float       px[MAX_NUM_JOINTS];
+	alignas(16) float       py[MAX_NUM_JOINTS];
+	alignas(16) float       pz[MAX_NUM_JOINTS];
+	alignas(16) float       qw[MAX_NUM_JOINTS];
+	alignas(16) float       qx[MAX_NUM_JOINTS];
+	alignas(16) float       qy[MAX_NUM_JOINTS];
+	alignas(16) float       qz[MAX_NUM_JOINTS];
+};
+
+class BodyFramePool;
+
+// Skeletons of all bodies detected in one capture, positions in meters.
+// Body frames live in a BodyFramePool and are passed around by BodyFrameRef, so that
+// every consumer sees the same object and the skeletons are never copied.
+struct BodyFrame
+{
+	uint64_t                timestamp_usec;
+	size_t                  num_bodies;
+	uint32_t                body_ids[MAX_NUM_BODIES];
+	JointArrays             joints;
+	// Bit j is set if joint j has an orientation of about unit length, see checkOrientationNorms()
+	uint32_t                valid_joints[MAX_NUM_BODIES];
+	// Pipeline timestamps, cleared by BodyFramePool::acquire()
+	LatencyStamps           stamps;
+
+	static size_t index(size_t iBody, int iJoint) { return iBody * JOINT_STRIDE + iJoint; }
+
+	k4a_float3_t position(size_t iBody, int iJoint) const
+	{
+		size_t i = index(iBody, iJoint);
+		k4a_float3_t position;
+		position.xyz.x = joints.px[i];
+		position.xyz.y = joints.py[i];
+		position.xyz.z = joints.pz[i];
+		return position;
+	}
+
+	k4a_quaternion_t orientation(size_t iBody, int iJoint) const
+	{
+		size_t i = index(iBody, iJoint);
+		k4a_quaternion_t orientation;
+		orientation.wxyz.w = joints.qw[i];
+		orientation.wxyz.x = joints.qx[i];
+		orientation.wxyz.y = joints.qy[i];
+		orientation.wxyz.z = joints.qz[i];
+		return orientation;
+	}
+
+	void setJoint(size_t iBody, int iJoint, const k4abt_joint_t & joint)
+	{
+		size_t i = index(iBody, iJoint);
+		joints.px[i] = joint.position.xyz.x;
+		joints.py[i] = joint.position.xyz.y;
+		joints.pz[i] = joint.position.xyz.z;
+		joints.qw[i] = joint.orientation.wxyz.w;
+		joints.qx[i] = joint.orientation.wxyz.x;
+		joints.qy[i] = joint.orientation.wxyz.y;
+		joints.qz[i] = joint.orientation.wxyz.z;
+	}
+
+	// Transposes a skeleton as returned by the SDK into the arrays
+	void setSkeleton(size_t iBody, const k4abt_skeleton_t & skeleton)
+	{
+		clearBody(iBody);
+		for (int j = 0; j < K4ABT_JOINT_COUNT; j++)
+			setJoint(iBody, j, skeleton.joints[j]);
+	}
+
+	void clearBody(size_t iBody)
+	{
+		float * arrays[] = { joints.px, joints.py, joints.pz, joints.qw, joints.qx, joints.qy, joints.qz };
+		for (float * p : arrays)
+			std::fill(p + index(iBody, 0), p + index(iBody + 1, 0), 0.0f);
+		valid_joints[iBody] = 0;
+	}
+
+private:
+	friend class BodyFramePool;
+	friend class BodyFrameRef;
+	std::atomic<int>        m_nRefCount;
+	BodyFramePool *         m_pPool;
+	BodyFrame *             m_pNextFree;
+
+	BodyFrame() : timestamp_usec(0), num_bodies(0), stamps(), m_nRefCount(0), m_pPool(nullptr), m_pNextFree(nullptr) {}
+	BodyFrame(const BodyFrame &) = delete;
+	BodyFrame & operator=(const BodyFrame &) = delete;
+};
+
+// Shared handle to a pooled body frame. The frame goes back to its pool when the last
+// handle to it is released. Copying a handle only touches the reference count.
+class BodyFrameRef
+{
+private:
+	BodyFrame *             m_p;
+
+public:
+	BodyFrameRef() : m_p(nullptr) {}
+	BodyFrameRef(const BodyFrameRef & other) : m_p(other.m_p) { if (m_p) m_p->m_nRefCount++; }
+	BodyFrameRef(BodyFrameRef && other) : m_p(other.m_p) { other.m_p = nullptr; }
+	~BodyFrameRef() { reset(); }
+
+	BodyFrameRef & operator=(const BodyFrameRef & other)
+	{
+		if (other.m_p)
+			other.m_p->m_nRefCount++;
+		reset();
+		m_p = other.m_p;
+		return *this;
+	}
+	BodyFrameRef & operator=(BodyFrameRef && other)
+	{
+		if (this != &other)
+		{
+			reset();
+			m_p = other.m_p;
+			other.m_p = nullptr;
+		}
+		return *this;
+	}
+
+	void reset();
+
+	BodyFrame * get() const { return m_p; }
+	BodyFrame * operator->() const { return m_p; }
+	BodyFrame & operator*() const { return *m_p; }
+	explicit operator bool() const { return m_p != nullptr; }
+
+private:
+	friend class BodyFramePool;
+	explicit BodyFrameRef(BodyFrame * p) : m_p(p) {}
+};
+
+// A fixed number of body frames allocated once at startup. acquire() and the release of
+// the last BodyFrameRef only move a frame between the free list and its users.
+class BodyFramePool
+{
+private:
+	std::unique_ptr<BodyFrame[]> m_pFrames;
+	size_t                  m_nSize;
+	std::mutex              m_Mutex;
+	BodyFrame *             m_pFreeList;
+	size_t                  m_nFree;
+	std::atomic<uint64_t>   m_nExhausted;
+
+public:
+	// All handles must have been released before the pool is destroyed
+	explicit BodyFramePool(size_t nSize);
+
+	// Takes a frame off the free list. Returns an empty handle if every frame is in use,
+	// in which case the caller is expected to drop the data.
+	BodyFrameRef acquire();
+
+	size_t size() const { return m_nSize; }
+	size_t available();
+	// Number of failed acquire() calls so far
+	uint64_t getExhaustedCount() const { return m_nExhausted; }
+
+private:
+	friend class BodyFrameRef;
+	void release(BodyFrame * pFrame);
+};
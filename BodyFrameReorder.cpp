@@ -0,0 +1,158 @@
+#include "stdafx.h"
+#include "BodyFrameReorder.h"
+
+BodyFrameReorder::BodyFrameReorder(size_t nTrackers, Emit funEmit) :
+	m_nTrackers(min(nTrackers, MAX_TRACKERS)),
+	m_nReady(0),
+	m_bEmitting(false),
+	m_funEmit(funEmit)
+{
+}
+
+void BodyFrameReorder::expect(size_t iTracker, uint64_t nTimestampUsec)
+{
+	std::lock_guard<std::mutex> lk(m_Mutex);
+	// Full only with captures left over from more trackers or a longer queue; the oldest of
+	// them is not coming back
+	Ring<uint64_t, MAX_IN_FLIGHT> & pending = m_Pending[iTracker];
+	if (pending.full())
+		pending.pop_front();
+	pending.push_back(nTimestampUsec);
+}
+
+void BodyFrameReorder::cancel(size_t iTracker, uint64_t nTimestampUsec)
+{
+	std::lock_guard<std::mutex> lk(m_Mutex);
+	Ring<uint64_t, MAX_IN_FLIGHT> & pending = m_Pending[iTracker];
+	for (size_t i = pending.nSize; i-- > 0;)
+	{
+		if (pending[i] == nTimestampUsec)
+		{
+			pending.erase(i);
+			break;
+		}
+	}
+}
+
+size_t BodyFrameReorder::popped(size_t iTracker, uint64_t nTimestampUsec, const BodyFrameRef & frame, uint64_t nNowNs, uint64_t nTimeoutNs)
+{
+	std::unique_lock<std::mutex> lk(m_Mutex);
+
+	// Captures of this tracker before the popped one were dropped by the tracker
+	size_t nLost = 0;
+	Ring<uint64_t, MAX_IN_FLIGHT> & pending = m_Pending[iTracker];
+	for (size_t i = 0; i < pending.nSize; i++)
+	{
+		if (pending[i] == nTimestampUsec)
+		{
+			nLost = i;
+			for (size_t j = 0; j <= i; j++)
+				pending.pop_front();
+			break;
+		}
+	}
+
+	if (frame)
+	{
+		// collectDue() leaves a free slot
+		Ready * pReady = nullptr;
+		for (Ready & ready : m_Ready)
+		{
+			if (!ready.frame || ready.nTimestampUsec == nTimestampUsec)
+			{
+				pReady = &ready;
+				if (ready.frame)
+					break;
+			}
+		}
+		if (!pReady->frame)
+			m_nReady++;
+		pReady->nTimestampUsec = nTimestampUsec;
+		pReady->iTracker = iTracker;
+		pReady->frame = frame;
+		pReady->nPoppedNs = nNowNs;
+	}
+	nLost += collectDue(nNowNs, nTimeoutNs);
+	emitDue(lk);
+	return nLost;
+}
+
+size_t BodyFrameReorder::discard(size_t iTracker, uint64_t nNowNs, uint64_t nTimeoutNs)
+{
+	std::unique_lock<std::mutex> lk(m_Mutex);
+	Ring<uint64_t, MAX_IN_FLIGHT> & pending = m_Pending[iTracker];
+	size_t nLost = pending.nSize;
+	pending.nSize = 0;
+	nLost += collectDue(nNowNs, nTimeoutNs);
+	emitDue(lk);
+	return nLost;
+}
+
+size_t BodyFrameReorder::poll(uint64_t nNowNs, uint64_t nTimeoutNs)
+{
+	std::unique_lock<std::mutex> lk(m_Mutex);
+	const size_t nLost = collectDue(nNowNs, nTimeoutNs);
+	emitDue(lk);
+	return nLost;
+}
+
+size_t BodyFrameReorder::collectDue(uint64_t nNowNs, uint64_t nTimeoutNs)
+{
+	size_t nLost = 0;
+	while (m_nReady > 0)
+	{
+		Ready * pFirst = nullptr;
+		for (Ready & ready : m_Ready)
+		{
+			if (ready.frame && (!pFirst || ready.nTimestampUsec < pFirst->nTimestampUsec))
+				pFirst = &ready;
+		}
+		const uint64_t nTimestampUsec = pFirst->nTimestampUsec;
+		bool bBlocked = false;
+		for (size_t i = 0; i < m_nTrackers; i++)
+			bBlocked = bBlocked || (!m_Pending[i].empty() && m_Pending[i].front() < nTimestampUsec);
+
+		if (bBlocked)
+		{
+			// Held back too long, or the slots run out
+			if (nNowNs < pFirst->nPoppedNs + nTimeoutNs && m_nReady < m_Ready.size())
+				break;
+			for (size_t i = 0; i < m_nTrackers; i++)
+			{
+				while (!m_Pending[i].empty() && m_Pending[i].front() < nTimestampUsec)
+				{
+					m_Pending[i].pop_front();
+					nLost++;
+				}
+			}
+		}
+
+		// Frames the emitting thread has not caught up with are dropped, like those the
+		// frame pool has no room for
+		if (m_Due.full())
+			nLost++;
+		else
+			m_Due.push_back(Due{ pFirst->iTracker, std::move(pFirst->frame) });
+		pFirst->frame.reset();
+		m_nReady--;
+	}
+	return nLost;
+}
+
+void BodyFrameReorder::emitDue(std::unique_lock<std::mutex> & lk)
+{
+	// A slow subscriber only holds up the thread that emits, not the trackers
+	if (m_bEmitting)
+		return;
+	m_bEmitting = true;
+	while (!m_Due.empty())
+	{
+		Due due = std::move(m_Due.front());
+		m_Due.pop_front();
+		lk.unlock();
+		m_funEmit(due.iTracker, due.frame);
+		due.frame.reset();
+		lk.lock();
+	}
+	m_bEmitting = false;
+}
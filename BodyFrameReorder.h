@@ -0,0 +1,103 @@
+#pragma once
+#include "stdafx.h"
+#include "BodyFramePool.h"
+#include "TrackerManager.h"
+#include <array>
+#include <functional>
+#include <mutex>
+
+// Captures each tracker can have queued, see "k4a/pipeline/maxInFlight"
+const size_t MAX_IN_FLIGHT = 8;
+
+// Puts the body frames of several trackers, which finish in any order, back into the order
+// of their captures. Each tracker returns its captures in the order they were enqueued, so
+// a frame is due as soon as no tracker has an earlier capture outstanding. Captures are
+// identified by the device timestamp of their depth image.
+// All storage is allocated with the object, so that passing a frame through does not touch
+// the heap. A single tracker returns its frames in order already and does not need this.
+class BodyFrameReorder
+{
+public:
+	// Called with the due frames in timestamp order, one at a time, without a lock held
+	typedef std::function<void(size_t iTracker, const BodyFrameRef & frame)> Emit;
+
+	// Popped frames that can be held back or waiting to be emitted
+	static const size_t MAX_HELD = MAX_TRACKERS * MAX_IN_FLIGHT;
+
+private:
+	// Fixed-capacity FIFO, oldest first
+	template <typename T, size_t N>
+	struct Ring
+	{
+		std::array<T, N>    items;
+		size_t              nHead = 0;
+		size_t              nSize = 0;
+
+		bool empty() const { return nSize == 0; }
+		bool full() const { return nSize == N; }
+		T & operator[](size_t i) { return items[(nHead + i) % N]; }
+		T & front() { return items[nHead]; }
+		void push_back(T value) { items[(nHead + nSize++) % N] = std::move(value); }
+		void pop_front() { nHead = (nHead + 1) % N; nSize--; }
+		// Removes the element at i, keeping the order of the others
+		void erase(size_t i)
+		{
+			for (; i + 1 < nSize; i++)
+				(*this)[i] = std::move((*this)[i + 1]);
+			nSize--;
+		}
+	};
+
+	struct Ready
+	{
+		uint64_t            nTimestampUsec;
+		size_t              iTracker;
+		BodyFrameRef        frame;  // empty if the slot is free
+		uint64_t            nPoppedNs;
+	};
+
+	struct Due
+	{
+		size_t              iTracker;
+		BodyFrameRef        frame;
+	};
+
+	std::mutex              m_Mutex;
+	size_t                  m_nTrackers;
+	// Timestamps of the captures each tracker has not returned yet
+	std::array<Ring<uint64_t, MAX_IN_FLIGHT>, MAX_TRACKERS> m_Pending;
+	// Popped frames waiting for an earlier capture, in no particular order. One slot is
+	// always kept free: when the last one fills up, the earliest frame is no longer held back.
+	std::array<Ready, MAX_HELD> m_Ready;
+	size_t                  m_nReady;
+	// Due frames not emitted yet. One thread at a time emits them, so that they keep their
+	// order, and the other threads only add to them and move on.
+	Ring<Due, MAX_HELD>     m_Due;
+	bool                    m_bEmitting;
+	Emit                    m_funEmit;
+
+public:
+	BodyFrameReorder(size_t nTrackers, Emit funEmit);
+
+	// Called before a capture is enqueued in iTracker, and cancel() if that failed
+	void expect(size_t iTracker, uint64_t nTimestampUsec);
+	void cancel(size_t iTracker, uint64_t nTimestampUsec);
+
+	// A body frame was popped from iTracker. frame is empty if the skeletons could not be
+	// read, so that the frames after it are not held back. Emits the frames that are due and
+	// returns the number of captures given up, see poll().
+	size_t popped(size_t iTracker, uint64_t nTimestampUsec, const BodyFrameRef & frame, uint64_t nNowNs, uint64_t nTimeoutNs);
+
+	// The captures outstanding in iTracker will not come back, e.g. the tracker was shut down
+	size_t discard(size_t iTracker, uint64_t nNowNs, uint64_t nTimeoutNs);
+
+	// Gives up the captures that have held back a popped frame for longer than nTimeoutNs
+	// and emits it. Returns the number of captures given up.
+	size_t poll(uint64_t nNowNs, uint64_t nTimeoutNs);
+
+private:
+	// Moves the due frames to m_Due and returns the number of captures given up
+	size_t collectDue(uint64_t nNowNs, uint64_t nTimeoutNs);
+	// Emits m_Due unless another thread does; lk holds m_Mutex and is held again on return
+	void emitDue(std::unique_lock<std::mutex> & lk);
+};
@@ -0,0 +1,131 @@
+#include "stdafx.h"
+#include "BodyIdMap.h"
+#include <algorithm>
+#include <array>
+#include <tuple>
+
+BodyIdMap::BodyIdMap() :
+	m_nNextId(1)
+{
+	m_vecTracks.reserve(MAX_TRACKS);
+}
+
+void BodyIdMap::clear()
+{
+	m_vecTracks.clear();
+	m_mapIds.clear();
+}
+
+static float getDistance2(const k4a_float3_t & a, const k4a_float3_t & b)
+{
+	const float dx = a.xyz.x - b.xyz.x, dy = a.xyz.y - b.xyz.y, dz = a.xyz.z - b.xyz.z;
+	return dx * dx + dy * dy + dz * dz;
+}
+
+void BodyIdMap::remap(size_t iTracker, BodyFrame & frame, float fMaxDistance, uint64_t nExpireUsec)
+{
+	// Forget the bodies that have left. The device timestamps start over when the cameras are
+	// restarted, which leaves every track in the future.
+	const uint64_t nNowUsec = frame.timestamp_usec;
+	std::vector<Track>::iterator itExpired = std::remove_if(m_vecTracks.begin(), m_vecTracks.end(),
+		[&](const Track & track) { return nNowUsec > track.nTimestampUsec + nExpireUsec || track.nTimestampUsec > nNowUsec; });
+	if (itExpired != m_vecTracks.end())
+	{
+		m_vecTracks.erase(itExpired, m_vecTracks.end());
+		for (auto it = m_mapIds.begin(); it != m_mapIds.end();)
+		{
+			const uint32_t nId = it->second;
+			if (std::none_of(m_vecTracks.begin(), m_vecTracks.end(), [nId](const Track & track) { return track.nId == nId; }))
+				it = m_mapIds.erase(it);
+			else
+				++it;
+		}
+	}
+
+	std::array<size_t, MAX_NUM_BODIES> tracks;   // index in m_vecTracks, or SIZE_MAX
+	std::array<bool, MAX_TRACKS> taken;
+	tracks.fill(SIZE_MAX);
+	taken.fill(false);
+	auto findTrack = [this](uint32_t nId) {
+		for (size_t i = 0; i < m_vecTracks.size(); i++)
+		{
+			if (m_vecTracks[i].nId == nId)
+				return i;
+		}
+		return size_t(SIZE_MAX);
+	};
+
+	// Bodies this tracker has seen before
+	for (size_t iBody = 0; iBody < frame.num_bodies; iBody++)
+	{
+		auto it = m_mapIds.find(std::make_pair(iTracker, frame.body_ids[iBody]));
+		const size_t iTrack = it == m_mapIds.end() ? SIZE_MAX : findTrack(it->second);
+		if (iTrack != SIZE_MAX && !taken[iTrack])
+		{
+			tracks[iBody] = iTrack;
+			taken[iTrack] = true;
+		}
+	}
+
+	// The others go to the nearest free track, closest pairs first
+	std::array<std::tuple<float, size_t, size_t>, MAX_NUM_BODIES * MAX_TRACKS> pairs;
+	size_t nPairs = 0;
+	for (size_t iBody = 0; iBody < frame.num_bodies; iBody++)
+	{
+		if (tracks[iBody] != SIZE_MAX)
+			continue;
+		const k4a_float3_t pelvis = frame.position(iBody, K4ABT_JOINT_PELVIS);
+		for (size_t iTrack = 0; iTrack < m_vecTracks.size(); iTrack++)
+		{
+			const float fDistance2 = getDistance2(pelvis, m_vecTracks[iTrack].pelvis);
+			if (!taken[iTrack] && fDistance2 <= fMaxDistance * fMaxDistance)
+				pairs[nPairs++] = std::make_tuple(fDistance2, iBody, iTrack);
+		}
+	}
+	std::sort(pairs.begin(), pairs.begin() + nPairs);
+	for (size_t i = 0; i < nPairs; i++)
+	{
+		const std::tuple<float, size_t, size_t> & pair = pairs[i];
+		const size_t iBody = std::get<1>(pair), iTrack = std::get<2>(pair);
+		if (tracks[iBody] == SIZE_MAX && !taken[iTrack])
+		{
+			tracks[iBody] = iTrack;
+			taken[iTrack] = true;
+		}
+	}
+
+	for (size_t iBody = 0; iBody < frame.num_bodies; iBody++)
+	{
+		if (tracks[iBody] == SIZE_MAX)
+		{
+			size_t iTrack = m_vecTracks.size();
+			if (iTrack < MAX_TRACKS)
+				m_vecTracks.push_back(Track());
+			else
+			{
+				// All tracks are in use: the one seen least recently makes room
+				for (size_t i = 0; i < m_vecTracks.size(); i++)
+				{
+					if (!taken[i] && (iTrack == MAX_TRACKS || m_vecTracks[i].nTimestampUsec < m_vecTracks[iTrack].nTimestampUsec))
+						iTrack = i;
+				}
+				const uint32_t nId = m_vecTracks[iTrack].nId;
+				for (auto it = m_mapIds.begin(); it != m_mapIds.end();)
+				{
+					if (it->second == nId)
+						it = m_mapIds.erase(it);
+					else
+						++it;
+				}
+			}
+			m_vecTracks[iTrack].nId = m_nNextId++;
+			tracks[iBody] = iTrack;
+			taken[iTrack] = true;
+		}
+		Track & track = m_vecTracks[tracks[iBody]];
+		track.pelvis = frame.position(iBody, K4ABT_JOINT_PELVIS);
+		track.nTimestampUsec = nNowUsec;
+		m_mapIds[std::make_pair(iTracker, frame.body_ids[iBody])] = track.nId;
+		frame.body_ids[iBody] = track.nId;
+	}
+}
@@ -0,0 +1,41 @@
+#pragma once
+#include "stdafx.h"
+#include "BodyFramePool.h"
+#include "TrackerManager.h"
+#include <map>
+#include <utility>
+#include <vector>
+
+// Gives the bodies seen by several trackers consistent IDs. Each tracker numbers the bodies
+// on its own, so the same person has a different ID in each. A body keeps the ID it had in
+// the previous frame of its tracker. A body that is new to its tracker takes the ID of the
+// nearest body by pelvis position in the recent frames of all trackers, or a new ID if
+// there is none within the match distance. Frames are passed in timestamp order.
+// Up to MAX_TRACKS bodies are remembered, so that a frame is remapped without allocating.
+class BodyIdMap
+{
+public:
+	// A body for each tracker, when none of them are matched
+	static const size_t MAX_TRACKS = MAX_TRACKERS * MAX_NUM_BODIES;
+
+private:
+	struct Track
+	{
+		uint32_t            nId;
+		k4a_float3_t        pelvis;
+		uint64_t            nTimestampUsec;
+	};
+
+	std::vector<Track>      m_vecTracks;
+	// (tracker, body ID of the tracker) -> consistent ID
+	std::map<std::pair<size_t, uint32_t>, uint32_t> m_mapIds;
+	uint32_t                m_nNextId;
+
+public:
+	BodyIdMap();
+
+	// Replaces the body IDs of iTracker in frame. A body not seen for nExpireUsec is
+	// forgotten; fMaxDistance is in meters.
+	void remap(size_t iTracker, BodyFrame & frame, float fMaxDistance, uint64_t nExpireUsec);
+	void clear();
+};
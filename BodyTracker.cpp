@@ -17,6 +17,13 @@
 #include "BodyTracker.h"
 #include "Config.h"
 #include "CsvLogger.h"
+#include "TypedLogger.h"
+#include "LogRecords.h"
+#include "LoggerBenchmark.h"
+#include "LogRecovery.h"
+#include "BinaryLog.h"
+#include "SkeletonKernels.h"
+#include "LatencyStats.h"
 
 static const float c_JointThickness = 3.0f;
 static const float c_TrackedBoneThickness = 6.0f;
@@ -39,6 +46,57 @@ int APIENTRY wWinMain(
     UNREFERENCED_PARAMETER(hPrevInstance);
     UNREFERENCED_PARAMETER(lpCmdLine);
 
+	// BodyTracker.exe --to-csv <log.bin> [<log.csv>] converts a binary log and exits
+	int argc = 0;
+	LPWSTR * argv = CommandLineToArgvW(GetCommandLineW(), &argc);
+	if (argv && argc >= 3 && wcscmp(argv[1], L"--to-csv") == 0)
+	{
+		std::wstring_convert<std::codecvt_utf8<wchar_t>> converter;
+		std::string strBinaryFile = converter.to_bytes(argv[2]);
+		std::string strCsvFile = argc >= 4 ? converter.to_bytes(argv[3]) :
+			strBinaryFile.substr(0, strBinaryFile.rfind('.')) + ".csv";
+		LocalFree(argv);
+		try {
+			BinaryLogReader::convertToCsv(strBinaryFile, strCsvFile);
+			return 0;
+		}
+		catch (std::runtime_error & error) {
+			MessageBoxA(NULL, error.what(), "BodyTracker --to-csv", MB_OK | MB_ICONERROR);
+			return 1;
+		}
+	}
+	// BodyTracker.exe --recover <log> cuts a log that was not closed cleanly after its last intact row and exits
+	if (argv && argc >= 3 && wcscmp(argv[1], L"--recover") == 0)
+	{
+		std::string strDataFile = std::wstring_convert<std::codecvt_utf8<wchar_t>>().to_bytes(argv[2]);
+		LocalFree(argv);
+		try {
+			const uint64_t nRemoved = RecoverLog(strDataFile);
+			const std::string strResult = strDataFile + "\n\nRemoved " + std::to_string(nRemoved) + " bytes";
+			MessageBoxA(NULL, strResult.c_str(), "BodyTracker --recover", MB_OK);
+			return 0;
+		}
+		catch (std::runtime_error & error) {
+			MessageBoxA(NULL, error.what(), "BodyTracker --recover", MB_OK | MB_ICONERROR);
+			return 1;
+		}
+	}
+	// BodyTracker.exe --bench-logger times the loggers and exits
+	if (argv && argc >= 2 && wcscmp(argv[1], L"--bench-logger") == 0)
+	{
+		LocalFree(argv);
+		try {
+			std::wstring strResults = BenchmarkLoggers(1000000);
+			MessageBox(NULL, strResults.c_str(), L"BodyTracker --bench-logger", MB_OK);
+			return 0;
+		}
+		catch (std::runtime_error & error) {
+			MessageBoxA(NULL, error.what(), "BodyTracker --bench-logger", MB_OK | MB_ICONERROR);
+			return 1;
+		}
+	}
+	LocalFree(argv);
+
 	try {
 		BodyTracker application;
 		application.Run(hInstance, nShowCmd);
@@ -56,14 +114,16 @@ int APIENTRY wWinMain(
 BodyTracker::BodyTracker() :
 	m_hWnd(NULL),
 	m_nStartTime(GetTickCount64()),
+	m_LastUpdateTimes(),
 	m_nLastCounter(0),
 	m_nFramesSinceUpdate(0),
 	m_fFreq(0),
 	m_nNextStatusTime(0LL),
+	m_Startup(std::bind(&BodyTracker::PrintMessage, this, std::placeholders::_1, std::placeholders::_2)),
 	m_KinectAzure(
 		std::bind(&BodyTracker::PrintMessage, this, std::placeholders::_1, std::placeholders::_2),
-		std::bind(&BodyTracker::ProcessBody, this, std::placeholders::_1, std::placeholders::_2, std::placeholders::_3, std::placeholders::_4),
-		std::bind(&BodyTracker::ProcessIMU, this, std::placeholders::_1),
+		m_FrameBus,
+		m_Startup,
 		std::bind(&BodyTracker::BroadcastStaticTf, this)
 	),
 	m_pD2DFactory(NULL),
@@ -71,7 +131,8 @@ BodyTracker::BodyTracker() :
 	m_pBrushJointTracked(NULL),
 	m_pBrushBoneTracked(NULL),
 	m_pSyncSocket(nullptr),
-	m_pRosSocket(nullptr)
+	m_pRosSocket(nullptr),
+	m_iConfigListener(-1)
 {
     LARGE_INTEGER qpf = {0};
     if (QueryPerformanceFrequency(&qpf))
@@ -86,7 +147,53 @@ BodyTracker::BodyTracker() :
 	for (int i = 0; i < SCT_Count; i++)
 		m_hWndStaticControls[i] = NULL;
 
-	
+	// Sinks of the frame bus. The csv loggers see every message, while the display and
+	// the ROS publisher only care about the latest body frame. Each sink records the time
+	// from dispatch to completion in the latency statistics.
+	LatencyStats * pLatencyStats = LatencyStats::Instance();
+	m_FrameBus.bodyFrames.subscribe("logger", 64, DP_Block, [this, pLatencyStats](const BodyFrameRef & frame) {
+		LogBody(frame);
+		pLatencyStats->recordSink(LS_BodyCsv, frame->stamps);
+	});
+	m_FrameBus.bodyFrames.subscribe("ros", 1, DP_LatestOnly, [this, pLatencyStats](const BodyFrameRef & frame) {
+		m_Startup.signal(SS_FirstBodyFrame);
+		PublishBody(frame);
+		pLatencyStats->recordSink(LS_BodyRos, frame->stamps);
+	});
+	m_FrameBus.bodyFrames.subscribe("display", 1, DP_LatestOnly, [this, pLatencyStats](const BodyFrameRef & frame) {
+		RenderBody(frame);
+		pLatencyStats->recordSink(LS_BodyRender, frame->stamps);
+	});
+	m_FrameBus.imuBatches.subscribe("logger", 256, DP_Block, [this, pLatencyStats](const ImuBatch & batch) {
+		LogImu(batch);
+		pLatencyStats->recordSink(LS_ImuCsv, batch.stamps);
+	});
+	m_FrameBus.imuBatches.subscribe("ros", 64, DP_DropOldest, [this, pLatencyStats](const ImuBatch & batch) {
+		PublishImu(batch);
+		pLatencyStats->recordSink(LS_ImuRos, batch.stamps);
+	});
+	m_FrameBus.syncEvents.subscribe("logger", 64, DP_Block, std::bind(&BodyTracker::LogSync, this, std::placeholders::_1));
+
+	// Streams of the device that the sinks consume. No sink reads the color image, so the
+	// color camera stays off.
+	m_FrameBus.captureProfile.require("bodyFrames/logger", CSF_BodyTracking);
+	m_FrameBus.captureProfile.require("bodyFrames/ros", CSF_BodyTracking);
+	m_FrameBus.captureProfile.require("bodyFrames/display", CSF_BodyTracking);
+	m_FrameBus.captureProfile.require("imuBatches/logger", CSF_Imu);
+	m_FrameBus.captureProfile.require("imuBatches/ros", CSF_Imu);
+
+	// The device and the tracker are already on their way in KinectAzure. Connect to ROS
+	// right away too, and bind the sync socket as soon as there is a window for its prompts.
+	EnsureRosSocket();
+	m_Startup.run(SS_SyncSocket, { SS_Window }, [this] { return m_pSyncSocket->init(m_hWnd); });
+
+	// Parameters are loaded again by the "Load" button and whenever the file is saved
+	m_iConfigListener = Config::Instance()->subscribe([this](int nChanged) {
+		TCHAR pszText[32];
+		StringCchPrintf(pszText, 32, L"%d parameter%s updated.", nChanged, nChanged > 1 ? L"s" : L"");
+		PrintMessage(SCT_Params, pszText);
+	});
+	Config::Instance()->startWatching();
 }
   
 
@@ -95,6 +202,12 @@ BodyTracker::BodyTracker() :
 /// </summary>
 BodyTracker::~BodyTracker()
 {
+	// Stop the subscribers and startup tasks before the resources they use go away
+	Config::Instance()->stopWatching();
+	Config::Instance()->unsubscribe(m_iConfigListener);
+	m_Startup.shutdown();
+	m_FrameBus.shutdown();
+
 	delete m_pSyncSocket;
 	delete m_pRosSocket;
 	m_pRosSocket = nullptr;
@@ -239,21 +352,15 @@ int BodyTracker::Run(HINSTANCE hInstance, int nCmdShow)
 	// Init Direct2D
 	D2D1CreateFactory(D2D1_FACTORY_TYPE_MULTI_THREADED, &m_pD2DFactory);
 
-	// Get and initialize the default Kinect sensor
-	//EnsureDefaultSensor();
-
-	//
-	m_pSyncSocket->init(hWndApp);
-
-	// Initialize RosSocket
-	EnsureRosSocket();
+	// Unblocks the startup tasks waiting for the window
+	m_Startup.signal(SS_Window, hWndApp != NULL);
 	
     // Main message loop
     while (WM_QUIT != msg.message)
     {
 		// Odroid Timestamp
-		if (m_pSyncSocket)
-			m_pSyncSocket->receive();
+		if (m_pSyncSocket && m_Startup.isReady(SS_SyncSocket) && m_pSyncSocket->receive() != (OdroidTimestamp)(-1))
+			m_FrameBus.publishSyncEvent(m_pSyncSocket->m_tsWindows, m_pSyncSocket->m_tsOdroid, m_pSyncSocket->m_tsSquareWave);
 
 		Update();
 
@@ -310,9 +417,21 @@ void BodyTracker::Update()
 	if (GetTickCount64() - timePrev > 500)
 	{
 		EnsureRosSocket();
+		if (m_pRosSocket && m_pRosSocket->getStatus() == RSS_Connected)
+			m_Startup.signal(SS_RosSocket);
+		// Updates that arrive in quick succession are throttled by PrintMessage()
+		PrintMessage(SCT_Startup, m_Startup.getTimeline().c_str());
 		timePrev = GetTickCount64();
 	}
 
+	static INT64 timeLatencyReport = GetTickCount64();
+	if (GetTickCount64() - timeLatencyReport > 2000)
+	{
+		LatencyStats::Instance()->report(std::bind(&BodyTracker::PrintMessage, this, std::placeholders::_1, std::placeholders::_2));
+		AsyncLogWriter::Instance()->report(std::bind(&BodyTracker::PrintMessage, this, std::placeholders::_1, std::placeholders::_2));
+		timeLatencyReport = GetTickCount64();
+	}
+
 }
 
 /// <summary>
@@ -369,10 +488,17 @@ LRESULT CALLBACK BodyTracker::DlgProc(HWND hWnd, UINT message, WPARAM wParam, LP
         }
         break;
 
+        case WM_CLOSE:
+			// Also posted by other threads, which cannot destroy the window themselves
+			DestroyWindow(hWnd);
+			break;
+
         case WM_DESTROY:
 			//m_bTerminating = true;
 			m_hWnd = NULL;
+			m_Startup.shutdown();
 			m_KinectAzure.Terminate();
+			m_FrameBus.shutdown();
             // Quit the main message pump
             PostQuitMessage(0);
             break;
@@ -420,14 +546,16 @@ LRESULT CALLBACK BodyTracker::DlgProc(HWND hWnd, UINT message, WPARAM wParam, LP
 				}
 				else if (m_hWndButtonLoad == hButton)
 				{
-					// Load button
-					Config::Instance()->load();
-					Config::resetCounter();
-					setParams();
-					int cnt = Config::getUpdateCount();
-					TCHAR pszText[32];
-					StringCchPrintf(pszText, 32, L"%d parameter%s updated.", cnt, cnt > 1 ? L"s" : L"");
-					PrintMessage(SCT_Params, pszText);
+					// Load button. The listeners apply the parameters and report them, also those
+					// parsed before a value that could not be.
+					try
+					{
+						Config::Instance()->load();
+					}
+					catch (const std::exception &)
+					{
+						PrintError(SCT_Params, L"Failed to parse a parameter, see config.txt.");
+					}
 				}
 				else if (m_hWndButtonExit == hButton)
 				{
@@ -459,6 +587,7 @@ void BodyTracker::EnsureRosSocket()
 		Config::Instance()->assign("RosSocket/enabled", bRosSocketEnabled);
 		if (bRosSocketEnabled)
 		{
+			m_Startup.begin(SS_RosSocket);
 			m_pRosSocket = new RosSocket();
 			m_pRosSocket->setStatusUpdatingFun(std::bind(&BodyTracker::PrintMessage, this, std::placeholders::_1, std::placeholders::_2));
 		}
@@ -472,67 +601,106 @@ void BodyTracker::EnsureRosSocket()
 
 
 /// <summary>
-/// Handle new body data
-/// <param name="k4a_timestamp_usec">timestamp of frame in usec</param>
-/// <param name="nBodyCount">body data count</param>
-/// <param name="ppBodies">body data in frame</param>
+/// Finds the body closest to the camera in the x-z-plane
+/// <param name="frame">body frame with at least one body</param>
 /// </summary>
-void BodyTracker::ProcessBody(uint64_t k4a_timestamp_usec, int nBodyCount, const k4abt_skeleton_t *pSkeleton, const uint32_t * pID)
+int BodyTracker::FindClosestBody(const BodyFrameRef & frame)
 {
-	int iClosest = -1; // the index of the body closest to the camera
-	float dSqrMin = 25.0; // squared x-z-distance of the closest body
-	INT64 t0Windows = GetTickCount64();
+	float distances[MAX_NUM_BODIES];
+	computeHorizontalDistances(frame->joints, frame->num_bodies, K4ABT_JOINT_PELVIS, distances);
 
-	// Find the body with the min dist
 	float min_dist = std::numeric_limits<float>::infinity();
 	int min_dist_i = 0;
-	for (int i = 0; i < nBodyCount; i++) {
-		const k4a_float3_t & position_pelvis = pSkeleton[i].joints[K4ABT_JOINT_PELVIS].position;
-		const float & px = position_pelvis.xyz.x;
-		const float & pz = position_pelvis.xyz.z;
-		float dist = sqrt(px * px + pz * pz);
+	for (size_t i = 0; i < frame->num_bodies; i++) {
+		float dist = distances[i];
 		if (min_dist > dist)
 		{
 			min_dist = dist;
-			min_dist_i = i;
+			min_dist_i = static_cast<int>(i);
 		}
 	}
+	return min_dist_i;
+}
+
+/// <summary>
+/// Log the joints of the closest body to the partial_skeleton csv file, and all bodies to
+/// the skeleton csv file if enabled
+/// <param name="frame">body frame</param>
+/// </summary>
+void BodyTracker::LogBody(const BodyFrameRef & frame)
+{
+	// Every joint of every body, one row per frame
+	static bool bLogSkeleton = [] {
+		bool bEnabled = false;
+		Config::Instance()->assign("CsvLogger/skeleton", bEnabled);
+		return bEnabled;
+	}();
+	if (bLogSkeleton)
+	{
+		static TypedLogger<SkeletonRecord> skeletonLogger("skeleton");
+		skeletonLogger.log(SkeletonRecord(*frame));
+	}
+
+	if (frame->num_bodies == 0)
+		return;
+	int min_dist_i = FindClosestBody(frame);
 
 	// Log skeleton data data
-	const std::vector<k4abt_joint_id_t> logged_joint_id_list = { 
+	static const k4abt_joint_id_t logged_joint_id_list[] = { 
 		K4ABT_JOINT_PELVIS, K4ABT_JOINT_ANKLE_LEFT, K4ABT_JOINT_ANKLE_RIGHT };
+	static TypedLogger<PartialSkeletonRecord> logger("partial_skeleton");
 	for (const auto & joint_id : logged_joint_id_list)
 	{
-		static const char * joint_type;
-		static float px, py, pz, qw, qx, qy, qz;
-		const k4abt_joint_t & logged_joint = pSkeleton[min_dist_i].joints[joint_id];
-		px = logged_joint.position.xyz.x;
-		py = logged_joint.position.xyz.y;
-		pz = logged_joint.position.xyz.z;
-
-		qw = logged_joint.orientation.wxyz.w;
-		qx = logged_joint.orientation.wxyz.x;
-		qy = logged_joint.orientation.wxyz.y;
-		qz = logged_joint.orientation.wxyz.z;
-
-		joint_type = getJointTypeString(joint_id);
+		if (!(frame->valid_joints[min_dist_i] & (1u << joint_id)))
+			continue;
+		const JointArrays & joints = frame->joints;
+		const size_t i = BodyFrame::index(min_dist_i, joint_id);
+		PartialSkeletonRecord record;
+		record.k4a_ts_usec = frame->timestamp_usec;
+		record.joint_type = getJointTypeString(joint_id);
+		record.px = joints.px[i];
+		record.py = joints.py[i];
+		record.pz = joints.pz[i];
+
+		record.qw = joints.qw[i];
+		record.qx = joints.qx[i];
+		record.qy = joints.qy[i];
+		record.qz = joints.qz[i];
 
 		// Log data to file
-		static CsvLogger logger("partial_skeleton", vector_header_value_t{
-			{"k4a_ts_usec", &k4a_timestamp_usec},
-			{"joint_type", &joint_type},
-			{"px", &px}, {"py", &py}, {"pz", &pz}, // position
-			{"qw", &qw}, {"qx", &qx}, {"qy", &qy}, {"qz", &qz} // orientation
-		});
-		if ((qw * qw + qx * qx + qy * qy + qz * qz) > 0.8)
-			logger.log();
+		logger.log(record);
 	}
+}
+
+/// <summary>
+/// Publish the closest body to ROS
+/// <param name="frame">body frame</param>
+/// </summary>
+void BodyTracker::PublishBody(const BodyFrameRef & frame)
+{
+	if (frame->num_bodies == 0)
+		return;
+	int min_dist_i = FindClosestBody(frame);
 
 	// Publish only the body with min dist
 	if (m_pRosSocket && m_pRosSocket->getStatus() == RSS_Connected)
 	{
-		m_pRosSocket->publishMsgSkeleton(pSkeleton[min_dist_i], pID[min_dist_i], k4a_timestamp_usec);
+		m_pRosSocket->publishMsgSkeleton(*frame, min_dist_i);
+		m_Startup.signal(SS_FirstSkeleton);
 	}
+}
+
+/// <summary>
+/// Draw the bodies and update the frame rate in the status bar
+/// <param name="frame">body frame</param>
+/// </summary>
+void BodyTracker::RenderBody(const BodyFrameRef & frame)
+{
+	int iClosest = -1; // the index of the body closest to the camera
+	float dSqrMin = 25.0; // squared x-z-distance of the closest body
+	const int nBodyCount = static_cast<int>(frame->num_bodies);
+	float distances[MAX_NUM_BODIES];
+	computeHorizontalDistances(frame->joints, frame->num_bodies, K4ABT_JOINT_PELVIS, distances);
 
     if (m_hWnd)
     {
@@ -551,20 +719,17 @@ void BodyTracker::ProcessBody(uint64_t k4a_timestamp_usec, int nBodyCount, const
 			std::wstring wstrBodyInfo;
             for (int i = 0; i < nBodyCount; ++i)
             {
-                k4abt_skeleton_t const &skeleton = pSkeleton[i];
                 D2D1_POINT_2F jointPoints[K4ABT_JOINT_COUNT];
 
                 for (int j = 0; j < K4ABT_JOINT_COUNT; ++j)
                 {
-                    jointPoints[j] = BodyToScreen(skeleton.joints[j].position, width, height);
+                    jointPoints[j] = BodyToScreen(frame->position(i, j), width, height);
                 }
 
                 DrawBody(jointPoints);
 
 				// Find the closest body, if any.
-				float px = skeleton.joints[K4ABT_JOINT_PELVIS].position.xyz.x;
-				float pz = skeleton.joints[K4ABT_JOINT_PELVIS].position.xyz.z;
-				float d = sqrt(px * px + pz * pz);
+				float d = distances[i];
 				wstrBodyInfo += (i == 0 ? L"" : L", ") + std::to_wstring(d);
 				if (dSqrMin > d)
 				{
@@ -620,23 +785,18 @@ void BodyTracker::ProcessBody(uint64_t k4a_timestamp_usec, int nBodyCount, const
 	
 }
 
-void BodyTracker::ProcessIMU(const k4a_imu_sample_t & imu_sample)
+/// <summary>
+/// Log a batch of IMU samples to the imu csv file and update the sampling rate
+/// <param name="batch">IMU samples</param>
+/// </summary>
+void BodyTracker::LogImu(const ImuBatch & batch)
 {
 	// Log data to file
-	static CsvLogger logger("imu", vector_header_value_t{
-		{"k4a_ts_usec", &imu_sample.acc_timestamp_usec},
-		{"wx", &imu_sample.gyro_sample.xyz.x},
-		{"wy", &imu_sample.gyro_sample.xyz.y},
-		{"wz", &imu_sample.gyro_sample.xyz.z},
-		{"ax", &imu_sample.acc_sample.xyz.x},
-		{"ay", &imu_sample.acc_sample.xyz.y},
-		{"az", &imu_sample.acc_sample.xyz.z}
-		});
-	logger.log();
-
-	if (m_pRosSocket && m_pRosSocket->getStatus() == RSS_Connected)
+	static TypedLogger<ImuRecord> logger("imu");
+	for (size_t i = 0; i < batch.nCount; i++)
 	{
-		m_pRosSocket->publishMsgImu(imu_sample);
+		ImuRecord record = { batch.samples[i] };
+		logger.log(record);
 	}
 
 	double fps = 0.0;
@@ -650,7 +810,7 @@ void BodyTracker::ProcessIMU(const k4a_imu_sample_t & imu_sample)
 		{
 			if (nLastCounter)
 			{
-				nSamplesSinceUpdate++;
+				nSamplesSinceUpdate += static_cast<DWORD>(batch.nCount);
 				fps = m_fFreq * nSamplesSinceUpdate / double(qpcNow.QuadPart - nLastCounter);
 			}
 		}
@@ -665,6 +825,38 @@ void BodyTracker::ProcessIMU(const k4a_imu_sample_t & imu_sample)
 	}
 }
 
+/// <summary>
+/// Publish a batch of IMU samples to ROS
+/// <param name="batch">IMU samples</param>
+/// </summary>
+void BodyTracker::PublishImu(const ImuBatch & batch)
+{
+	if (m_pRosSocket && m_pRosSocket->getStatus() == RSS_Connected)
+	{
+		m_pRosSocket->publishMsgImu(batch.samples, batch.nCount);
+	}
+}
+
+/// <summary>
+/// Log a sync packet together with the latest Kinect timestamp
+/// <param name="event">sync event</param>
+/// </summary>
+void BodyTracker::LogSync(const SyncEvent & event)
+{
+	static uint64_t windows_ts_msec, odroid_ts, trigger, k4a_ts_usec;
+	static CsvLogger logger("sync", vector_header_value_t{
+		{"windows_ts_msec", &windows_ts_msec},
+		{"odroid_ts", &odroid_ts},
+		{"trigger", &trigger},
+		{"k4a_ts_usec", &k4a_ts_usec}
+		});
+	windows_ts_msec = static_cast<uint64_t>(event.tsWindows);
+	odroid_ts = static_cast<uint64_t>(event.tsOdroid);
+	trigger = static_cast<uint64_t>(event.nTrigger);
+	k4a_ts_usec = event.k4a_ts_usec;
+	logger.log();
+}
+
 void BodyTracker::BroadcastStaticTf()
 {
 	const k4a_calibration_t * pCalibration = m_KinectAzure.GetKinectCalibrationPointer();
@@ -698,9 +890,8 @@ bool BodyTracker::SetStatusMessage(_In_z_ WCHAR* szMessage, DWORD nShowTimeMsec,
 void BodyTracker::PrintMessage(static_control_type SCT, const wchar_t * szMessage)
 {
 	const INT64 minUpdateWaitTime = 100; // Wait 100 ms before printing the next update
-	static std::array<INT64, SCT_Count> lastUpdateTimes = {};
 	INT64 stampNow = GetTickCount64();
-	if (m_hWnd && lastUpdateTimes[SCT] + minUpdateWaitTime < stampNow)
+	if (m_hWnd && m_LastUpdateTimes[SCT] + minUpdateWaitTime < stampNow)
 	{
 		const size_t BUFFER_LEN = 128;
 		wchar_t pszText[BUFFER_LEN];
@@ -708,10 +899,16 @@ void BodyTracker::PrintMessage(static_control_type SCT, const wchar_t * szMessag
 			(GetTickCount64() - m_nStartTime) / 1.0e3,
 			szMessage);
 		SetWindowText(m_hWndStaticControls[SCT], pszText);
-		lastUpdateTimes[SCT] = stampNow;
+		m_LastUpdateTimes[SCT] = stampNow;
 	}
 }
 
+void BodyTracker::PrintError(static_control_type SCT, const wchar_t * szMessage)
+{
+	m_LastUpdateTimes[SCT] = 0;
+	PrintMessage(SCT, szMessage);
+}
+
 /// <summary>
 /// Ensure necessary Direct2d resources are created
 /// </summary>
@@ -775,10 +972,23 @@ D2D1_POINT_2F BodyTracker::BodyToScreen(const k4a_float3_t& point3d, int width_r
 {
 	k4a_float2_t point2d;
 	int valid;
+	float width_actual, height_actual;
 	const k4a_calibration_t * pKinectCalibration = m_KinectAzure.GetKinectCalibrationPointer();
-	k4a_calibration_3d_to_2d(pKinectCalibration, &point3d, K4A_CALIBRATION_TYPE_DEPTH, K4A_CALIBRATION_TYPE_DEPTH, &point2d, &valid);
-	float width_actual = pKinectCalibration->depth_camera_calibration.resolution_width;
-	float height_actual = pKinectCalibration->depth_camera_calibration.resolution_height;
+	if (pKinectCalibration)
+	{
+		k4a_calibration_3d_to_2d(pKinectCalibration, &point3d, K4A_CALIBRATION_TYPE_DEPTH, K4A_CALIBRATION_TYPE_DEPTH, &point2d, &valid);
+		width_actual = pKinectCalibration->depth_camera_calibration.resolution_width;
+		height_actual = pKinectCalibration->depth_camera_calibration.resolution_height;
+	}
+	else
+	{
+		// No calibration, e.g. for a synthetic source: use a nominal NFOV unbinned pinhole camera
+		width_actual = 640.0f;
+		height_actual = 576.0f;
+		float z = max(point3d.xyz.z, 0.1f);
+		point2d.xy.x = 504.0f * point3d.xyz.x / z + width_actual / 2;
+		point2d.xy.y = 504.0f * point3d.xyz.y / z + height_actual / 2;
+	}
 	float ratio_width = static_cast<float>(width_rendering) / width_actual;
 	float ratio_height = static_cast<float>(height_rendering) / height_actual;
 	float ratio_min = min(ratio_width, ratio_height);
@@ -65,11 +65,18 @@ public:
 private:
     HWND                    m_hWnd;
     INT64                   m_nStartTime;
+    std::array<INT64, SCT_Count> m_LastUpdateTimes; // of each message textbox, see PrintMessage()
     INT64                   m_nLastCounter;
     double                  m_fFreq;
     INT64                   m_nNextStatusTime;
     DWORD                   m_nFramesSinceUpdate;
 
+    // Brings the device, tracker, ROS link and sync socket up concurrently
+	StartupOrchestrator     m_Startup;
+
+    // Connects KinectAzure (or another sensor source) to the sinks below; must outlive it
+	FrameBus                m_FrameBus;
+
     // KinectAzure
 	KinectAzure             m_KinectAzure;
 
@@ -98,6 +105,8 @@ private:
 
 	// ROS Socket
 	RosSocket*				m_pRosSocket;
+	// Reports the parameters updated when the parameter file is loaded again
+	int                     m_iConfigListener;
 
 	void                    setParams();
 
@@ -114,13 +123,18 @@ private:
 
     
     /// <summary>
-    /// Handle new body data
-	/// <param name="nTime">timestamp of frame in msec</param>
-    /// <param name="nBodyCount">body data count</param>
-    /// <param name="ppBodies">body data in frame</param>
+    /// Frame bus subscribers, each called on its own thread
+	/// <param name="frame">body frame</param>
+    /// <param name="batch">IMU samples</param>
+    /// <param name="event">sync event</param>
     /// </summary>
-    void ProcessBody(uint64_t nTime, int nBodyCount, const k4abt_skeleton_t *pSkeleton, const uint32_t * pID);
-    void ProcessIMU(const k4a_imu_sample_t & ImuSample);
+    void LogBody(const BodyFrameRef & frame);
+    void PublishBody(const BodyFrameRef & frame);
+    void RenderBody(const BodyFrameRef & frame);
+    void LogImu(const ImuBatch & batch);
+    void PublishImu(const ImuBatch & batch);
+    void LogSync(const SyncEvent & event);
+    static int FindClosestBody(const BodyFrameRef & frame);
 	void BroadcastStaticTf();
 
     /// <summary>
@@ -133,6 +147,8 @@ private:
 
 	// Print to the message textbox
 	void PrintMessage(static_control_type SCT, const wchar_t * szMessage);
+	// Print to the message textbox even if it was updated just now
+	void PrintError(static_control_type SCT, const wchar_t * szMessage);
 
     /// <summary>
     /// Ensure necessary Direct2d resources are created
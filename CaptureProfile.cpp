@@ -0,0 +1,119 @@
+#include "stdafx.h"
+#include "CaptureProfile.h"
+
+void CaptureProfile::require(const std::string & strSink, uint32_t nStreams)
+{
+	std::lock_guard<std::mutex> lk(m_Mutex);
+	m_vecSinks.emplace_back(strSink, nStreams);
+	m_nVersion++;
+}
+
+uint32_t CaptureProfile::getStreams() const
+{
+	std::lock_guard<std::mutex> lk(m_Mutex);
+	uint32_t nStreams = 0;
+	for (auto & sink : m_vecSinks)
+		nStreams |= sink.second;
+	return nStreams;
+}
+
+void CaptureProfile::apply(k4a_device_configuration_t & config) const
+{
+	if (getVersion() == 0)
+		return;
+	const uint32_t nStreams = getStreams();
+	if (!(nStreams & CSF_Color))
+	{
+		config.color_resolution = K4A_COLOR_RESOLUTION_OFF;
+		config.synchronized_images_only = false;
+	}
+	if (!(nStreams & (CSF_Depth | CSF_BodyIndex | CSF_Imu)))
+		config.depth_mode = (nStreams & CSF_IR) ? K4A_DEPTH_MODE_PASSIVE_IR : K4A_DEPTH_MODE_OFF;
+}
+
+static int getFramesPerSecond(k4a_fps_t camera_fps)
+{
+	return camera_fps == K4A_FRAMES_PER_SECOND_5 ? 5 : camera_fps == K4A_FRAMES_PER_SECOND_15 ? 15 : 30;
+}
+
+// Bytes of the depth and IR images of one capture, 16 bits per pixel each
+static double getDepthFrameBytes(k4a_depth_mode_t depth_mode)
+{
+	switch (depth_mode)
+	{
+	case K4A_DEPTH_MODE_NFOV_2X2BINNED: return 2.0 * 320 * 288 * 2;
+	case K4A_DEPTH_MODE_NFOV_UNBINNED: return 2.0 * 640 * 576 * 2;
+	case K4A_DEPTH_MODE_WFOV_2X2BINNED: return 2.0 * 512 * 512 * 2;
+	case K4A_DEPTH_MODE_WFOV_UNBINNED: return 2.0 * 1024 * 1024 * 2;
+	case K4A_DEPTH_MODE_PASSIVE_IR: return 1024.0 * 1024 * 2;
+	default: return 0;
+	}
+}
+
+static double getColorPixels(k4a_color_resolution_t color_resolution)
+{
+	switch (color_resolution)
+	{
+	case K4A_COLOR_RESOLUTION_720P: return 1280.0 * 720;
+	case K4A_COLOR_RESOLUTION_1080P: return 1920.0 * 1080;
+	case K4A_COLOR_RESOLUTION_1440P: return 2560.0 * 1440;
+	case K4A_COLOR_RESOLUTION_1536P: return 2048.0 * 1536;
+	case K4A_COLOR_RESOLUTION_2160P: return 3840.0 * 2160;
+	case K4A_COLOR_RESOLUTION_3072P: return 4096.0 * 3072;
+	default: return 0;
+	}
+}
+
+// Bytes of the color image of one capture. MJPG is taken as a tenth of the 16-bit image,
+// which is a rough figure; the actual size depends on the scene.
+static double getColorFrameBytes(k4a_color_resolution_t color_resolution, k4a_image_format_t color_format)
+{
+	const double fPixels = getColorPixels(color_resolution);
+	return color_format == K4A_IMAGE_FORMAT_COLOR_MJPG ? fPixels * 2 / 10 : fPixels * 2;
+}
+
+// Rough throughput of one core of a typical laptop, for the CPU estimate
+const double COPY_BYTES_PER_SEC = 5e9;          // copying image buffers
+const double DECODE_PIXELS_PER_SEC = 150e6;     // decoding MJPG, which the SDK does for BGRA32
+
+// USB bandwidth in bytes per second and host CPU in cores that the cameras of config take.
+// Every image is copied into a capture on the host, and BGRA32 color images are also
+// decoded from the MJPG the camera sends.
+static void estimateCost(const k4a_device_configuration_t & config, double & fBytes, double & fCores)
+{
+	const int nFps = getFramesPerSecond(config.camera_fps);
+	fBytes = (getDepthFrameBytes(config.depth_mode) + getColorFrameBytes(config.color_resolution, config.color_format)) * nFps;
+	fCores = fBytes / COPY_BYTES_PER_SEC;
+	if (config.color_format == K4A_IMAGE_FORMAT_COLOR_BGRA32)
+		fCores += getColorPixels(config.color_resolution) * nFps / DECODE_PIXELS_PER_SEC;
+}
+
+std::wstring CaptureProfile::describe(const k4a_device_configuration_t & requested, const k4a_device_configuration_t & resolved) const
+{
+	const uint32_t nStreams = getStreams();
+	std::wstring strStreams;
+	const struct { uint32_t nFlag; const wchar_t * pszName; } names[] = {
+		{ CSF_Depth, L"depth" }, { CSF_IR, L"IR" }, { CSF_Color, L"color" }, { CSF_Imu, L"IMU" }, { CSF_BodyIndex, L"body index" }
+	};
+	for (auto & name : names)
+	{
+		if (nStreams & name.nFlag)
+			strStreams += (strStreams.empty() ? L"" : L"+") + std::wstring(name.pszName);
+	}
+
+	const int nFps = getFramesPerSecond(resolved.camera_fps);
+	double fResolvedBytes, fResolvedCores, fRequestedBytes, fRequestedCores;
+	estimateCost(resolved, fResolvedBytes, fResolvedCores);
+	estimateCost(requested, fRequestedBytes, fRequestedCores);
+
+	const size_t BUFFER_LEN = 128;
+	wchar_t pszText[BUFFER_LEN];
+	if (fRequestedBytes > fResolvedBytes)
+		StringCchPrintf(pszText, BUFFER_LEN, L"%s @%d fps: ~%.0f MB/s, ~%.1f%% CPU (unused streams: -%.0f MB/s, -%.1f%% CPU)",
+			strStreams.empty() ? L"no streams" : strStreams.c_str(), nFps, fResolvedBytes / 1e6, fResolvedCores * 100,
+			(fRequestedBytes - fResolvedBytes) / 1e6, (fRequestedCores - fResolvedCores) * 100);
+	else
+		StringCchPrintf(pszText, BUFFER_LEN, L"%s @%d fps: ~%.0f MB/s, ~%.1f%% CPU",
+			strStreams.empty() ? L"no streams" : strStreams.c_str(), nFps, fResolvedBytes / 1e6, fResolvedCores * 100);
+	return pszText;
+}
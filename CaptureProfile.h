@@ -0,0 +1,50 @@
+#pragma once
+#include "stdafx.h"
+#include <atomic>
+#include <mutex>
+#include <string>
+#include <utility>
+#include <vector>
+
+// Streams of the device that a sink can consume
+enum capture_stream_flags
+{
+	CSF_Depth = 1,
+	CSF_IR = 2,
+	CSF_Color = 4,
+	CSF_Imu = 8,
+	CSF_BodyIndex = 16,
+	// Body frames come from the tracker, which reads the depth and IR images
+	CSF_BodyTracking = CSF_Depth | CSF_IR
+};
+
+// The streams the sinks of the frame bus consume. Each sink declares its streams when it is
+// added, and the device is started with only their union, e.g. without the color camera if
+// no sink reads color images. The version changes whenever a sink is added, so that the
+// device can be reconfigured if it was started before.
+class CaptureProfile
+{
+private:
+	mutable std::mutex      m_Mutex;
+	std::vector<std::pair<std::string, uint32_t>> m_vecSinks;
+	std::atomic<uint64_t>   m_nVersion;
+
+public:
+	CaptureProfile() : m_nVersion(0) {}
+
+	// nStreams are capture_stream_flags
+	void require(const std::string & strSink, uint32_t nStreams);
+
+	uint32_t getStreams() const;
+	uint64_t getVersion() const { return m_nVersion; }
+
+	// Turns off the cameras of config that no sink needs. The IMU needs a running camera, so
+	// the depth camera stays on for sinks that only read the IMU. Before any sink is added,
+	// config is left as it is.
+	void apply(k4a_device_configuration_t & config) const;
+
+	// The streams of the resolved config with the estimated USB bandwidth and host CPU, and
+	// what turning off the other streams of the requested config saves, for the status list.
+	// requested is the config before apply().
+	std::wstring describe(const k4a_device_configuration_t & requested, const k4a_device_configuration_t & resolved) const;
+};
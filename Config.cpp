@@ -1,13 +1,15 @@
 //#include "pch.h"
 #include "Config.h"
 
+#include <exception>
 #include <fstream>
 #include <string>
 #include <sstream>
+#include <windows.h>
 
 // Initialization of static variables.
 Config* Config::m_pInstance = nullptr;
-int Config::m_countUpdates = 0;
+std::atomic<int> Config::m_countUpdates(0);
 
 inline static void trim(std::string & str) {
 	const std::string chars = "\t\n\v\f\r ";
@@ -28,15 +30,28 @@ Config* Config::Instance(const std::string & fileName)
 	return m_pInstance;
 }
 
+Config::Config() :
+	m_pParams(std::make_shared<ConfigParams>()),
+	m_nNextListener(0),
+	m_nNotifying(0),
+	m_bWatching(false)
+{
+}
+
 
-void Config::load(const std::string & fileName)
+int Config::load(const std::string & fileName)
 {
+	std::unique_lock<std::mutex> lkLoad(m_MutexLoad);
+	m_strFileName = fileName;
+
 	// Read config from a parameter file
 	std::ifstream ifsConfig(fileName);
 	if (!ifsConfig.is_open())
 	{
-		return;
+		return 0;
 	}
+	const ConfigSnapshot pOld = getSnapshot();
+	std::shared_ptr<ConfigParams> pParams = std::make_shared<ConfigParams>(*pOld);
 	std::string strLine;
 	while (std::getline(ifsConfig, strLine))
 	{
@@ -47,26 +62,159 @@ void Config::load(const std::string & fileName)
 			if (std::getline(ss, strValue)) {
 				trim(strKey);
 				trim(strValue);
-				m_mapParams[strKey] = strValue;
+				(*pParams)[strKey] = strValue;
 			}
 				
 	}
 	ifsConfig.close();
+
+	int nChanged = 0;
+	for (auto & param : *pParams)
+	{
+		auto it = pOld->find(param.first);
+		if (it == pOld->end() || it->second.compare(param.second) != 0)
+			nChanged++;
+	}
+	// Readers keep the snapshot they hold until they are done with it
+	std::atomic_store(&m_pParams, ConfigSnapshot(std::move(pParams)));
+
+	// Values of the ConfigParam handles. A value that cannot be parsed leaves its handles as
+	// they were; the error is passed on once the listeners have seen the new snapshot.
+	std::exception_ptr pError;
+	{
+		std::lock_guard<std::mutex> lk(m_MutexSlots);
+		for (auto & slots : m_mapSlots)
+		{
+			for (auto & pSlot : slots.second)
+			{
+				try
+				{
+					pSlot->refresh(*this, slots.first);
+				}
+				catch (const std::exception &)
+				{
+					if (!pError)
+						pError = std::current_exception();
+				}
+			}
+		}
+	}
+	lkLoad.unlock();
+
+	// Called without a lock held, so that a listener may wait for another thread, e.g. the
+	// window thread, which may be loading the file itself
+	std::vector<ConfigListener> vecListeners;
+	{
+		std::lock_guard<std::mutex> lk(m_MutexListeners);
+		for (auto & listener : m_mapListeners)
+			vecListeners.push_back(listener.second);
+		m_nNotifying++;
+	}
+	for (auto & listener : vecListeners)
+		listener(nChanged);
+	{
+		std::lock_guard<std::mutex> lk(m_MutexListeners);
+		m_nNotifying--;
+	}
+	m_CondNotified.notify_all();
+
+	if (pError)
+		std::rethrow_exception(pError);
+	return nChanged;
+}
+
+int Config::subscribe(ConfigListener funListener)
+{
+	std::lock_guard<std::mutex> lk(m_MutexListeners);
+	m_mapListeners[m_nNextListener] = funListener;
+	return m_nNextListener++;
+}
+
+void Config::unsubscribe(int iListener)
+{
+	std::unique_lock<std::mutex> lk(m_MutexListeners);
+	m_mapListeners.erase(iListener);
+	// A load may still be calling the listener from its copy of the list
+	m_CondNotified.wait(lk, [this] { return m_nNotifying == 0; });
+}
+
+void Config::startWatching()
+{
+	int nIntervalMs = 1000;
+	assign("Config/watchInterval_ms", nIntervalMs);
+	std::lock_guard<std::mutex> lk(m_MutexWatch);
+	if (nIntervalMs <= 0 || m_bWatching)
+		return;
+	m_bWatching = true;
+	m_ThreadWatch = std::thread(&Config::watchProc, this, nIntervalMs);
+}
+
+void Config::stopWatching()
+{
+	{
+		std::lock_guard<std::mutex> lk(m_MutexWatch);
+		m_bWatching = false;
+	}
+	m_CondWatch.notify_all();
+	if (m_ThreadWatch.joinable())
+		m_ThreadWatch.join();
+}
+
+// Last write time of a file in 100 ns, or 0 if it does not exist
+static uint64_t getFileStamp(const std::string & fileName)
+{
+	WIN32_FILE_ATTRIBUTE_DATA data;
+	if (!GetFileAttributesExA(fileName.c_str(), GetFileExInfoStandard, &data))
+		return 0;
+	return (uint64_t(data.ftLastWriteTime.dwHighDateTime) << 32) | data.ftLastWriteTime.dwLowDateTime;
 }
 
+void Config::watchProc(int nIntervalMs)
+{
+	std::string fileName;
+	{
+		std::lock_guard<std::mutex> lk(m_MutexLoad);
+		fileName = m_strFileName;
+	}
+	uint64_t nLoadedStamp = getFileStamp(fileName);
+	uint64_t nLastStamp = nLoadedStamp;
+	std::unique_lock<std::mutex> lk(m_MutexWatch);
+	while (!m_CondWatch.wait_for(lk, std::chrono::milliseconds(nIntervalMs), [this] { return !m_bWatching; }))
+	{
+		// Loaded once the file has stopped changing, so that a file is not read while an editor
+		// is still saving it
+		const uint64_t nStamp = getFileStamp(fileName);
+		const bool bSettled = nStamp == nLastStamp;
+		nLastStamp = nStamp;
+		if (!bSettled || nStamp == nLoadedStamp || nStamp == 0)
+			continue;
+		nLoadedStamp = nStamp;
+		lk.unlock();
+		try
+		{
+			load(fileName);
+		}
+		catch (const std::exception &)
+		{
+			// A value that cannot be parsed, e.g. while the file is being edited. The
+			// parameters parsed so far are applied, the rest at the next change.
+		}
+		lk.lock();
+	}
+}
 
 bool Config::assign(const std::string & strKey, std::string & strValue)
 {
-	ConfigParams::iterator it;
-	it = m_mapParams.find(strKey);
-	if (it == m_mapParams.end())
+	const ConfigSnapshot pParams = getSnapshot();
+	ConfigParams::const_iterator it = pParams->find(strKey);
+	if (it == pParams->end())
 		return false; // Failed to find the parameter.
 	else
 	{
-		if (strValue.compare(m_mapParams[strKey]) != 0)
+		if (strValue.compare(it->second) != 0)
 		{
 			m_countUpdates++;
-			strValue = m_mapParams[strKey];
+			strValue = it->second;
 		}		
 		return true; // Succeeded in assigning the config parameter
 	}
@@ -74,13 +222,13 @@ bool Config::assign(const std::string & strKey, std::string & strValue)
 
 bool Config::assign(const std::string & strKey, float & fValue)
 {
-	ConfigParams::iterator it;
-	it = m_mapParams.find(strKey);
-	if (it == m_mapParams.end())
+	const ConfigSnapshot pParams = getSnapshot();
+	ConfigParams::const_iterator it = pParams->find(strKey);
+	if (it == pParams->end())
 		return false; // Failed to find the parameter.
 	else
 	{
-		float fValueNew = stof(m_mapParams[strKey]);
+		float fValueNew = stof(it->second);
 		if (fabs(fValue - fValueNew) > FLOAT_EPSILON)
 		{
 			m_countUpdates++;
@@ -92,13 +240,13 @@ bool Config::assign(const std::string & strKey, float & fValue)
 
 bool Config::assign(const std::string & strKey, double & fValue)
 {
-	ConfigParams::iterator it;
-	it = m_mapParams.find(strKey);
-	if (it == m_mapParams.end())
+	const ConfigSnapshot pParams = getSnapshot();
+	ConfigParams::const_iterator it = pParams->find(strKey);
+	if (it == pParams->end())
 		return false; // Failed to find the parameter.
 	else
 	{
-		double fValueNew = stof(m_mapParams[strKey]);
+		double fValueNew = stof(it->second);
 		if (fabs(fValue - fValueNew) > FLOAT_EPSILON)
 		{
 			m_countUpdates++;
@@ -110,13 +258,13 @@ bool Config::assign(const std::string & strKey, double & fValue)
 
 bool Config::assign(const std::string & strKey, bool & bValue)
 {
-	ConfigParams::iterator it;
-	it = m_mapParams.find(strKey);
-	if (it == m_mapParams.end())
+	const ConfigSnapshot pParams = getSnapshot();
+	ConfigParams::const_iterator it = pParams->find(strKey);
+	if (it == pParams->end())
 		return false; // Failed to find the parameter.
 	else
 	{
-		const std::string & strParam = m_mapParams[strKey];
+		const std::string & strParam = it->second;
 		bool bValueNew = strParam.compare("1") == 0 || strParam.compare("true") == 0 ||
 			strParam.compare("True") == 0 || strParam.compare("TRUE") == 0;
 		if (bValue != bValueNew)
@@ -130,13 +278,13 @@ bool Config::assign(const std::string & strKey, bool & bValue)
 
 bool Config::assign(const std::string & strKey, int & iValue)
 {
-	ConfigParams::iterator it;
-	it = m_mapParams.find(strKey);
-	if (it == m_mapParams.end())
+	const ConfigSnapshot pParams = getSnapshot();
+	ConfigParams::const_iterator it = pParams->find(strKey);
+	if (it == pParams->end())
 		return false; // Failed to find the parameter.
 	else
 	{
-		int iValueNew = stoi(m_mapParams[strKey]);
+		int iValueNew = stoi(it->second);
 		if (iValue != iValueNew)
 		{
 			m_countUpdates++;
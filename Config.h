@@ -1,26 +1,94 @@
 #pragma once
+#include <atomic>
+#include <condition_variable>
+#include <functional>
 #include <map>
+#include <memory>
+#include <mutex>
 #include <string>
+#include <thread>
+#include <vector>
 
 typedef std::map<std::string, std::string> ConfigParams;
+// The parameters as loaded at one time. A snapshot is never changed; load() replaces it.
+typedef std::shared_ptr<const ConfigParams> ConfigSnapshot;
+// Called after the parameters were loaded, with the number of parameters that changed
+typedef std::function<void(int nChanged)> ConfigListener;
 const float FLOAT_EPSILON = 1e-4;
+
+class Config;
+
+// The parsed value of a parameter, shared by all ConfigParam handles of its key and type
+class ConfigSlotBase
+{
+public:
+	virtual ~ConfigSlotBase() {}
+	// Parses the parameter again, e.g. after Config::load()
+	virtual void refresh(Config & config, const std::string & strKey) = 0;
+};
+
+template <typename T>
+class ConfigSlot : public ConfigSlotBase
+{
+public:
+	std::atomic<T> value;
+
+	explicit ConfigSlot(T defaultValue) : value(defaultValue) {}
+	void refresh(Config & config, const std::string & strKey) override;
+};
+
 // This class is a singleton class. Its life is for the duration of this application.
 
 class Config
 {
 private:
 	static Config* m_pInstance;
-	Config() {}
+	Config();
 	Config(Config const&) {}
 	Config& operator=(Config const&) {}
 
-	ConfigParams   m_mapParams;
-	static int     m_countUpdates;
+	// Read with std::atomic_load, so the threads that read parameters never wait for load()
+	ConfigSnapshot m_pParams;
+	static std::atomic<int> m_countUpdates;
+	std::mutex     m_MutexLoad;
+	std::string    m_strFileName;
+
+	std::mutex     m_MutexListeners;
+	std::map<int, ConfigListener> m_mapListeners;
+	int            m_nNextListener;
+	int            m_nNotifying;        // loads calling the listeners
+	std::condition_variable m_CondNotified;
+
+	// Reloads the file when it changes, see startWatching()
+	std::thread    m_ThreadWatch;
+	std::mutex     m_MutexWatch;
+	std::condition_variable m_CondWatch;
+	bool           m_bWatching;
+
+	// Slots of the ConfigParam handles by key. They live as long as the application.
+	std::mutex     m_MutexSlots;
+	std::map<std::string, std::vector<std::unique_ptr<ConfigSlotBase>>> m_mapSlots;
 
 public:
 	static Config* Instance(const std::string & fileName = "config.txt");
 
-	void load(const std::string & fileName = "config.txt");
+	// Reads the parameter file. Parameters that are no longer in the file keep their value.
+	// Updates the ConfigParam handles, then calls the listeners. Returns the number of
+	// parameters that changed. If a value cannot be parsed, the exception is thrown after the
+	// listeners were called.
+	int load(const std::string & fileName = "config.txt");
+	ConfigSnapshot getSnapshot() const { return std::atomic_load(&m_pParams); }
+
+	// Listeners are called on the thread that loads the file, after the file was read and
+	// without a lock held, one at a time for each load; the calls of two threads loading at
+	// once may overlap. Once unsubscribe() returns, the listener is not running and is not
+	// called again. Neither may be called from a listener.
+	int subscribe(ConfigListener funListener);
+	void unsubscribe(int iListener);
+
+	// Loads the file whenever it changes, every "Config/watchInterval_ms", until stopWatching()
+	void startWatching();
+	void stopWatching();
 
 	bool assign(const std::string &strKey, std::string & strValue);
 	bool assign(const std::string & strKey, float & fValue);
@@ -30,5 +98,56 @@ public:
 
 	static void resetCounter();
 	static int getUpdateCount();
+
+private:
+	void watchProc(int nIntervalMs);
+
+public:
+
+	// The slot of a parameter of type T, created with defaultValue and the value in the file
+	// on the first call for the key. Use ConfigParam instead.
+	template <typename T>
+	std::atomic<T> * intern(const std::string & strKey, T defaultValue)
+	{
+		std::lock_guard<std::mutex> lk(m_MutexSlots);
+		std::vector<std::unique_ptr<ConfigSlotBase>> & vecSlots = m_mapSlots[strKey];
+		for (auto & pSlot : vecSlots)
+		{
+			if (ConfigSlot<T> * pTyped = dynamic_cast<ConfigSlot<T> *>(pSlot.get()))
+				return &pTyped->value;
+		}
+		ConfigSlot<T> * pSlot = new ConfigSlot<T>(defaultValue);
+		vecSlots.emplace_back(pSlot);
+		pSlot->refresh(*this, strKey);
+		return &pSlot->value;
+	}
+};
+
+template <typename T>
+void ConfigSlot<T>::refresh(Config & config, const std::string & strKey)
+{
+	T newValue = value.load();
+	if (config.assign(strKey, newValue))
+		value.store(newValue);
+}
+
+// Handle of a bool, int, float or double parameter for code that reads it often, e.g. per
+// frame. The key is looked up and parsed once, and again when the file is loaded, so get()
+// is a single atomic load. Handles of the same key and type share the value of the first
+// one, including its default. Parameters read once at startup use Config::assign().
+template <typename T>
+class ConfigParam
+{
+private:
+	std::atomic<T> *        m_pValue;
+
+public:
+	ConfigParam(const std::string & strKey, T defaultValue = T()) :
+		m_pValue(Config::Instance()->intern<T>(strKey, defaultValue))
+	{
+	}
+
+	T get() const { return m_pValue->load(std::memory_order_relaxed); }
+	operator T() const { return get(); }
 };
 
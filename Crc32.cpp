@@ -0,0 +1,44 @@
+#include "stdafx.h"
+#include "Crc32.h"
+#include <cstring>
+
+// Tables for eight bytes at a time ("slicing-by-8")
+struct Crc32Tables
+{
+	uint32_t                table[8][256];
+
+	Crc32Tables()
+	{
+		for (uint32_t i = 0; i < 256; i++)
+		{
+			uint32_t crc = i;
+			for (int k = 0; k < 8; k++)
+				crc = (crc >> 1) ^ (0xedb88320u & (0 - (crc & 1)));
+			table[0][i] = crc;
+		}
+		for (uint32_t i = 0; i < 256; i++)
+			for (int t = 1; t < 8; t++)
+				table[t][i] = (table[t - 1][i] >> 8) ^ table[0][table[t - 1][i] & 0xff];
+	}
+};
+
+static const Crc32Tables s_Tables;
+
+uint32_t updateCrc32(uint32_t crc, const void * pData, size_t nBytes)
+{
+	const uint8_t * p = static_cast<const uint8_t *>(pData);
+	const uint32_t (*t)[256] = s_Tables.table;
+	crc = ~crc;
+	for (; nBytes >= 8; nBytes -= 8, p += 8)
+	{
+		uint32_t nLow, nHigh;
+		memcpy(&nLow, p, 4);
+		memcpy(&nHigh, p + 4, 4);
+		nLow ^= crc;
+		crc = t[7][nLow & 0xff] ^ t[6][(nLow >> 8) & 0xff] ^ t[5][(nLow >> 16) & 0xff] ^ t[4][nLow >> 24] ^
+			t[3][nHigh & 0xff] ^ t[2][(nHigh >> 8) & 0xff] ^ t[1][(nHigh >> 16) & 0xff] ^ t[0][nHigh >> 24];
+	}
+	for (; nBytes > 0; nBytes--)
+		crc = (crc >> 8) ^ t[0][(crc ^ *p++) & 0xff];
+	return ~crc;
+}
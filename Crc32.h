@@ -0,0 +1,7 @@
+#pragma once
+#include <cstddef>
+#include <cstdint>
+
+// CRC-32 (IEEE 802.3, as zlib) of the blocks of the session logs. Start with crc = 0 and
+// pass the result of the previous call to continue over more data.
+uint32_t updateCrc32(uint32_t crc, const void * pData, size_t nBytes);
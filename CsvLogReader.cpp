@@ -0,0 +1,368 @@
+#include "stdafx.h"
+#include "CsvLogReader.h"
+#include "NumberFormat.h"
+#include <cstring>
+#include <stdexcept>
+#include <thread>
+#include <unordered_map>
+
+MappedFile::MappedFile(const std::string & strFileName) :
+	m_hFile(INVALID_HANDLE_VALUE),
+	m_hMapping(NULL),
+	m_pData(NULL),
+	m_nSize(0)
+{
+	// Shared for writing, so that the log of a running capture can be read
+	m_hFile = CreateFileA(strFileName.c_str(), GENERIC_READ, FILE_SHARE_READ | FILE_SHARE_WRITE, NULL,
+		OPEN_EXISTING, FILE_FLAG_SEQUENTIAL_SCAN, NULL);
+	LARGE_INTEGER size;
+	if (m_hFile == INVALID_HANDLE_VALUE || !GetFileSizeEx(m_hFile, &size))
+	{
+		if (m_hFile != INVALID_HANDLE_VALUE)
+			CloseHandle(m_hFile);
+		throw std::runtime_error("Cannot open file\n" + strFileName);
+	}
+	m_nSize = static_cast<size_t>(size.QuadPart);
+	if (m_nSize == 0)
+		return; // an empty file cannot be mapped
+
+	m_hMapping = CreateFileMappingA(m_hFile, NULL, PAGE_READONLY, 0, 0, NULL);
+	if (m_hMapping)
+		m_pData = static_cast<const char *>(MapViewOfFile(m_hMapping, FILE_MAP_READ, 0, 0, 0));
+	if (!m_pData)
+	{
+		if (m_hMapping)
+			CloseHandle(m_hMapping);
+		CloseHandle(m_hFile);
+		throw std::runtime_error("Cannot map file\n" + strFileName);
+	}
+}
+
+MappedFile::~MappedFile()
+{
+	if (m_pData)
+		UnmapViewOfFile(m_pData);
+	if (m_hMapping)
+		CloseHandle(m_hMapping);
+	CloseHandle(m_hFile);
+}
+
+// The end of the line starting at p, before its line break, or NULL if there is no line break
+static const char * findLineEnd(const char * p, const char * pEnd)
+{
+	const char * pBreak = static_cast<const char *>(memchr(p, '\n', pEnd - p));
+	if (pBreak && pBreak > p && pBreak[-1] == '\r')
+		return pBreak - 1;
+	return pBreak;
+}
+
+CsvLogCursor::CsvLogCursor(const char * pFile, const char * pBegin, const char * pEnd, size_t nColumns) :
+	m_pFile(pFile),
+	m_pNext(pBegin),
+	m_pEnd(pEnd),
+	m_vecFields(nColumns + 1),
+	m_nFields(0)
+{
+}
+
+bool CsvLogCursor::next()
+{
+	if (m_pNext >= m_pEnd)
+		return false;
+	const char * pLineEnd = findLineEnd(m_pNext, m_pEnd);
+	if (!pLineEnd)
+		return false;
+
+	// Field i spans from m_vecFields[i] to the character before m_vecFields[i + 1]
+	const size_t nColumns = m_vecFields.size() - 1;
+	const char * p = m_pNext;
+	m_nFields = 0;
+	while (m_nFields < nColumns && p < pLineEnd)
+	{
+		m_vecFields[m_nFields++] = p;
+		p = std::find(p, pLineEnd, ',') + 1;
+	}
+	m_vecFields[m_nFields] = p;
+	m_pNext = static_cast<const char *>(memchr(pLineEnd, '\n', m_pEnd - pLineEnd)) + 1;
+	return true;
+}
+
+void CsvLogCursor::seek(uint64_t nOffset)
+{
+	m_pNext = m_pFile + min(nOffset, static_cast<uint64_t>(m_pEnd - m_pFile));
+	m_nFields = 0;
+}
+
+uint64_t CsvLogCursor::getUint64(size_t iField) const
+{
+	uint64_t value = 0;
+	if (iField < m_nFields)
+		parseUint64(m_vecFields[iField], m_vecFields[iField + 1] - 1, value);
+	return value;
+}
+
+float CsvLogCursor::getFloat(size_t iField) const
+{
+	float value = 0;
+	if (iField < m_nFields)
+		parseFloat(m_vecFields[iField], m_vecFields[iField + 1] - 1, value);
+	return value;
+}
+
+std::string CsvLogCursor::getString(size_t iField) const
+{
+	if (iField >= m_nFields)
+		return std::string();
+	return std::string(m_vecFields[iField], m_vecFields[iField + 1] - 1);
+}
+
+bool CsvLogCursor::isEqual(size_t iField, const char * psz) const
+{
+	const size_t nLength = strlen(psz);
+	if (iField >= m_nFields)
+		return nLength == 0;
+	return static_cast<size_t>(m_vecFields[iField + 1] - 1 - m_vecFields[iField]) == nLength &&
+		memcmp(m_vecFields[iField], psz, nLength) == 0;
+}
+
+const char * CsvLogCursor::getField(size_t iField, size_t & nLength) const
+{
+	if (iField >= m_nFields)
+	{
+		nLength = 0;
+		return "";
+	}
+	nLength = m_vecFields[iField + 1] - 1 - m_vecFields[iField];
+	return m_vecFields[iField];
+}
+
+size_t CsvLogTable::findColumn(const std::string & strName) const
+{
+	for (size_t i = 0; i < columns.size(); i++)
+		if (columns[i].first.compare(strName) == 0)
+			return i;
+	return SIZE_MAX;
+}
+
+// The narrowest type that holds the field: an integer, a float or else a string
+static ValueType::value_type_t getFieldType(const char * p, const char * pEnd)
+{
+	uint64_t n;
+	float f;
+	if (p == pEnd || parseUint64(p, pEnd, n) == pEnd)
+		return ValueType::type_uint64;
+	if (parseFloat(p, pEnd, f) == pEnd)
+		return ValueType::type_f;
+	return ValueType::type_str;
+}
+
+CsvLogReader::CsvLogReader(const std::string & strFileName) :
+	m_File(strFileName),
+	m_pRows(m_File.data())
+{
+	const char * pEnd = m_File.data() + m_File.size();
+	const char * pHeaderEnd = m_File.size() ? findLineEnd(m_File.data(), pEnd) : NULL;
+	if (!pHeaderEnd)
+		throw std::runtime_error("No csv header in file\n" + strFileName);
+
+	// The header ends with a comma like every row
+	for (const char * p = m_File.data(); p < pHeaderEnd; )
+	{
+		const char * pComma = std::find(p, pHeaderEnd, ',');
+		m_Columns.emplace_back(std::string(p, pComma), ValueType::type_uint64);
+		p = pComma + 1;
+	}
+	m_pRows = static_cast<const char *>(memchr(pHeaderEnd, '\n', pEnd - pHeaderEnd)) + 1;
+
+	// Columns are integers until a value of the first rows says otherwise
+	CsvLogCursor cursor = begin();
+	for (int iRow = 0; iRow < 256 && cursor.next(); iRow++)
+	{
+		for (size_t i = 0; i < cursor.getFieldCount(); i++)
+		{
+			const std::string strField = cursor.getString(i);
+			m_Columns[i].second = max(m_Columns[i].second, getFieldType(strField.data(), strField.data() + strField.size()));
+		}
+	}
+}
+
+size_t CsvLogReader::findColumn(const std::string & strName) const
+{
+	for (size_t i = 0; i < m_Columns.size(); i++)
+		if (m_Columns[i].first.compare(strName) == 0)
+			return i;
+	return SIZE_MAX;
+}
+
+CsvLogCursor CsvLogReader::begin() const
+{
+	return CsvLogCursor(m_File.data(), m_pRows, m_File.data() + m_File.size(), m_Columns.size());
+}
+
+bool CsvLogReader::parseRange(const char * pBegin, const char * pEnd, size_t iFirstRow, CsvLogTable & table,
+	std::vector<ValueType::value_type_t> & vecTypes, std::vector<std::vector<std::string>> & vecStrings)
+{
+	const size_t nColumns = table.columns.size();
+	std::vector<std::unordered_map<std::string, uint32_t>> vecStringIds(nColumns);
+	vecStrings.assign(nColumns, std::vector<std::string>());
+	bool bTypesHold = true;
+
+	CsvLogCursor cursor(pBegin, pBegin, pEnd, nColumns);
+	std::string strField;
+	for (size_t iRow = iFirstRow; cursor.next(); iRow++)
+	{
+		for (size_t i = 0; i < nColumns; i++)
+		{
+			size_t nLength;
+			const char * p = cursor.getField(i, nLength);
+			const char * pFieldEnd = p + nLength;
+			const char * pParsed = pFieldEnd;
+			switch (table.columns[i].second)
+			{
+			case ValueType::type_uint64:
+			{
+				uint64_t value = 0;
+				if (nLength)
+					pParsed = parseUint64(p, pFieldEnd, value);
+				table.vecUint64[i][iRow] = value;
+				break;
+			}
+			case ValueType::type_f:
+			{
+				float value = 0;
+				if (nLength)
+					pParsed = parseFloat(p, pFieldEnd, value);
+				table.vecFloat[i][iRow] = value;
+				break;
+			}
+			default:
+			{
+				strField.assign(p, nLength);
+				auto it = vecStringIds[i].find(strField);
+				if (it == vecStringIds[i].end())
+				{
+					it = vecStringIds[i].emplace(strField, static_cast<uint32_t>(vecStrings[i].size())).first;
+					vecStrings[i].push_back(strField);
+				}
+				table.vecStringIds[i][iRow] = it->second;
+				break;
+			}
+			}
+
+			// A value that is not all of the field needs a wider type
+			if (pParsed != pFieldEnd)
+			{
+				vecTypes[i] = max(vecTypes[i], getFieldType(p, pFieldEnd));
+				bTypesHold = false;
+			}
+		}
+	}
+	return bTypesHold;
+}
+
+CsvLogTable CsvLogReader::load(size_t nThreads) const
+{
+	if (nThreads == 0)
+		nThreads = max(1u, std::thread::hardware_concurrency());
+	const char * pEnd = m_File.data() + m_File.size();
+
+	// Split the rows into parts of about the same size at line breaks
+	std::vector<const char *> vecParts(1, m_pRows);
+	for (size_t i = 1; i < nThreads; i++)
+	{
+		const char * p = max(vecParts.back(), m_pRows + (pEnd - m_pRows) * i / nThreads);
+		const char * pBreak = p < pEnd ? static_cast<const char *>(memchr(p, '\n', pEnd - p)) : NULL;
+		if (!pBreak)
+			break;
+		if (pBreak + 1 > vecParts.back())
+			vecParts.push_back(pBreak + 1);
+	}
+	vecParts.push_back(pEnd);
+	const size_t nParts = vecParts.size() - 1;
+
+	// Rows of each part: its complete lines
+	std::vector<size_t> vecFirstRows(nParts + 1, 0);
+	{
+		std::vector<std::thread> threads;
+		for (size_t iPart = 0; iPart < nParts; iPart++)
+		{
+			threads.emplace_back([&vecParts, &vecFirstRows, iPart] {
+				size_t nRows = 0;
+				for (const char * p = vecParts[iPart]; (p = static_cast<const char *>(memchr(p, '\n', vecParts[iPart + 1] - p))) != NULL; p++)
+					nRows++;
+				vecFirstRows[iPart + 1] = nRows;
+			});
+		}
+		for (auto & thread : threads)
+			thread.join();
+	}
+	for (size_t iPart = 0; iPart < nParts; iPart++)
+		vecFirstRows[iPart + 1] += vecFirstRows[iPart];
+
+	CsvLogTable table;
+	table.columns = m_Columns;
+	table.nRows = vecFirstRows[nParts];
+	for (;;)
+	{
+		const size_t nColumns = table.columns.size();
+		table.vecUint64.assign(nColumns, std::vector<uint64_t>());
+		table.vecFloat.assign(nColumns, std::vector<float>());
+		table.vecStringIds.assign(nColumns, std::vector<uint32_t>());
+		table.vecStrings.assign(nColumns, std::vector<std::string>());
+		for (size_t i = 0; i < nColumns; i++)
+		{
+			switch (table.columns[i].second)
+			{
+			case ValueType::type_uint64: table.vecUint64[i].resize(table.nRows); break;
+			case ValueType::type_f: table.vecFloat[i].resize(table.nRows); break;
+			default: table.vecStringIds[i].resize(table.nRows); break;
+			}
+		}
+
+		std::vector<std::vector<ValueType::value_type_t>> vecTypes(nParts);
+		std::vector<std::vector<std::vector<std::string>>> vecStrings(nParts);
+		std::vector<char> vecTypesHold(nParts, 1);
+		std::vector<std::thread> threads;
+		for (size_t iPart = 0; iPart < nParts; iPart++)
+		{
+			for (auto & column : table.columns)
+				vecTypes[iPart].push_back(column.second);
+			threads.emplace_back([&, iPart] {
+				vecTypesHold[iPart] = parseRange(vecParts[iPart], vecParts[iPart + 1], vecFirstRows[iPart], table, vecTypes[iPart], vecStrings[iPart]);
+			});
+		}
+		for (auto & thread : threads)
+			thread.join();
+
+		// A value that did not fit its column's type widens the column, and the file is parsed again
+		if (std::find(vecTypesHold.begin(), vecTypesHold.end(), 0) != vecTypesHold.end())
+		{
+			for (size_t iPart = 0; iPart < nParts; iPart++)
+				for (size_t i = 0; i < nColumns; i++)
+					table.columns[i].second = max(table.columns[i].second, vecTypes[iPart][i]);
+			continue;
+		}
+
+		// Merge the strings of the parts into one table per column
+		for (size_t i = 0; i < nColumns; i++)
+		{
+			if (table.columns[i].second != ValueType::type_str)
+				continue;
+			std::unordered_map<std::string, uint32_t> mapIds;
+			for (size_t iPart = 0; iPart < nParts; iPart++)
+			{
+				std::vector<uint32_t> vecIds;
+				for (auto & str : vecStrings[iPart][i])
+				{
+					auto it = mapIds.emplace(str, static_cast<uint32_t>(table.vecStrings[i].size())).first;
+					if (it->second == table.vecStrings[i].size())
+						table.vecStrings[i].push_back(str);
+					vecIds.push_back(it->second);
+				}
+				for (size_t iRow = vecFirstRows[iPart]; iRow < vecFirstRows[iPart + 1]; iRow++)
+					table.vecStringIds[i][iRow] = vecIds[table.vecStringIds[i][iRow]];
+			}
+		}
+		return table;
+	}
+}
@@ -0,0 +1,100 @@
+#pragma once
+#include "CsvLogger.h"
+#include <string>
+#include <vector>
+
+// Readers of the csv files written by CsvLogger, for the replay source and offline tools.
+// The file is memory-mapped and parsed in place, without a copy per line. A file that is
+// still being written can be read up to its size at the time it is opened; a last line
+// without its line break is ignored.
+
+// Read-only mapping of a whole file
+class MappedFile
+{
+private:
+	HANDLE                  m_hFile;
+	HANDLE                  m_hMapping;
+	const char *            m_pData;
+	size_t                  m_nSize;
+
+public:
+	// Throws std::runtime_error if the file cannot be opened
+	explicit MappedFile(const std::string & strFileName);
+	~MappedFile();
+	MappedFile(const MappedFile &) = delete;
+	MappedFile & operator=(const MappedFile &) = delete;
+
+	const char * data() const { return m_pData; }
+	size_t size() const { return m_nSize; }
+};
+
+// Iterates the rows of a csv log, splitting each row into fields that are parsed on demand
+class CsvLogCursor
+{
+private:
+	const char *            m_pFile;        // start of the file, for offsets
+	const char *            m_pNext;        // next row
+	const char *            m_pEnd;
+	std::vector<const char *> m_vecFields;  // start of each field of the current row, and the end of the row
+	size_t                  m_nFields;
+
+public:
+	CsvLogCursor(const char * pFile, const char * pBegin, const char * pEnd, size_t nColumns);
+
+	// Moves to the next row. Returns false at the end of the file.
+	bool next();
+	// Continues at the row at byte nOffset of the file, e.g. from LogIndex
+	void seek(uint64_t nOffset);
+	// Byte offset of the next row, which seek() returns to
+	uint64_t tell() const { return static_cast<uint64_t>(m_pNext - m_pFile); }
+
+	// Fields of the current row. Rows with fewer fields read as 0 or "".
+	size_t getFieldCount() const { return m_nFields; }
+	uint64_t getUint64(size_t iField) const;
+	float getFloat(size_t iField) const;
+	std::string getString(size_t iField) const;
+	// Compares the field with a string, without copying it
+	bool isEqual(size_t iField, const char * psz) const;
+	// The characters of the field, not null-terminated
+	const char * getField(size_t iField, size_t & nLength) const;
+};
+
+// All rows of a csv log, one array per column. String columns hold ids into their own table.
+struct CsvLogTable
+{
+	vector_log_column_t     columns;
+	size_t                  nRows;
+	std::vector<std::vector<uint64_t>> vecUint64;       // of type_uint64 columns
+	std::vector<std::vector<float>> vecFloat;           // of type_f columns
+	std::vector<std::vector<uint32_t>> vecStringIds;    // of type_str columns
+	std::vector<std::vector<std::string>> vecStrings;
+
+	size_t findColumn(const std::string & strName) const;
+};
+
+class CsvLogReader
+{
+private:
+	MappedFile              m_File;
+	vector_log_column_t     m_Columns;
+	const char *            m_pRows;        // first row after the header
+
+public:
+	// Reads the header and takes the type of each column from the first rows: integers,
+	// floats or strings. Throws std::runtime_error if the file cannot be opened.
+	explicit CsvLogReader(const std::string & strFileName);
+
+	const vector_log_column_t & getColumns() const { return m_Columns; }
+	size_t findColumn(const std::string & strName) const;
+
+	// A cursor at the first row
+	CsvLogCursor begin() const;
+
+	// Parses the whole file on nThreads threads, or one per core for 0. The file is split at
+	// line breaks, and each thread parses its part straight into the columns.
+	CsvLogTable load(size_t nThreads = 0) const;
+
+private:
+	static bool parseRange(const char * pBegin, const char * pEnd, size_t iFirstRow, CsvLogTable & table,
+		std::vector<ValueType::value_type_t> & vecTypes, std::vector<std::vector<std::string>> & vecStrings);
+};
@@ -3,6 +3,7 @@
 #include <map>
 #include <sstream>
 #include "Config.h"
+#include "NumberFormat.h"
 
 std::ostream & operator<<(std::ostream & lhs, ValueType & rhs) {
 	switch (rhs.type) {
@@ -53,10 +54,18 @@ const char * getJointTypeString(int enumVal)
 }
 
 
-std::string CsvLogger::s_strDataPath = "";
-time_t CsvLogger::m_rawtime = 0;
-CsvLogger::CsvLogger(const char * name, vector_header_value_t && vectorHeaderValue) :
-	m_VectorHeaderValue(std::move(vectorHeaderValue))
+// The line break that text mode writes on Windows. Writing it in binary mode keeps the byte
+// offsets of the rows known, which the index of the file points to.
+static const char CSV_LINE_BREAK[] = "\r\n";
+static const size_t CSV_LINE_BREAK_LENGTH = sizeof(CSV_LINE_BREAK) - 1;
+
+std::string LogFile::s_strDataPath = "";
+time_t LogFile::m_rawtime = 0;
+LogFile::LogFile(const char * name, vector_log_column_t && columns) :
+	m_Columns(std::move(columns)),
+	m_iIndexColumn(0),
+	m_nFileBytes(0),
+	m_bUncommitted(false)
 {
 	bool enabled = false;
 	Config::Instance()->assign("CsvLogger/enabled", enabled);
@@ -65,27 +74,219 @@ CsvLogger::CsvLogger(const char * name, vector_header_value_t && vectorHeaderVal
 		Config::Instance()->assign("CsvLogger/dataPath", s_strDataPath);
 		if (m_rawtime == 0)
 			time(&m_rawtime); // obtain current time
-		// Open a csv file
-		std::string fileName;
-		generateFileName(fileName, name);
-		m_DataFile.open(fileName, std::ofstream::out); // Open the csv file
+		std::string strFormat = "csv";
+		Config::Instance()->assign("CsvLogger/format", strFormat);
+		const bool bBinary = strFormat.compare("binary") == 0;
+		bool bAsync = true;
+		Config::Instance()->assign("CsvLogger/async/enabled", bAsync);
+		m_Row.resize(m_Columns.size());
+		if (bAsync)
+			m_pAsyncArena.reset(new AsyncLogArena(*this, m_Columns.size()));
+
+		// Open a csv file, or a binary log that can be converted to one later
+		std::string & fileName = m_strFileName;
+		generateFileName(fileName, name, bBinary ? ".bin" : ".csv");
+		// Csv files too are written in binary mode, see CSV_LINE_BREAK
+		m_DataFile.open(fileName, std::ofstream::out | std::ofstream::binary);
 		if (m_DataFile.is_open() == false)
 			throw std::runtime_error("Cannot open file\n" + fileName +
 				"\n\nBaseLogger::openDataFile(const char * name)");
+		if (m_pAsyncArena)
+		{
+			// The writer thread writes a whole buffer of rows at once. Set after open(), as the
+			// file buffer ignores a buffer set while no file is open.
+			m_FileBuffer.resize(m_pAsyncArena->getBlockBytes());
+			m_DataFile.rdbuf()->pubsetbuf(m_FileBuffer.data(), m_FileBuffer.size());
+		}
+
+		// Index the rows by k4a_ts_usec to seek in the file later, see LogIndex.h
+		bool bIndex = true;
+		Config::Instance()->assign("CsvLogger/index/enabled", bIndex);
+		for (size_t i = 0; i < m_Columns.size() && bIndex && !m_pIndex; i++)
+		{
+			if (m_Columns[i].first.compare("k4a_ts_usec") == 0 && m_Columns[i].second == ValueType::type_uint64)
+			{
+				int nBlockRows = 1024;
+				Config::Instance()->assign("CsvLogger/index/blockRows", nBlockRows);
+				m_pIndex.reset(new LogIndexWriter(fileName, max(1, nBlockRows)));
+				m_iIndexColumn = i;
+				if (!m_pIndex->isOpen())
+					throw std::runtime_error("Cannot open file\n" + LogIndexWriter::getFileName(fileName));
+			}
+		}
+
+		if (bBinary)
+		{
+			int nChunkRows = 4096;
+			Config::Instance()->assign("CsvLogger/binary/chunkRows", nChunkRows);
+			std::string strCompression = "none";
+			Config::Instance()->assign("CsvLogger/binary/compression", strCompression);
+			const bool bCompressed = strCompression.compare("delta") == 0;
+			// Step that float columns are rounded to when compressed, 0 (exact) unless set per log or column.
+			// Read as text, as Config::assign(double) ignores changes below FLOAT_EPSILON.
+			std::string strResolution = "0";
+			Config::Instance()->assign("CsvLogger/binary/resolution", strResolution);
+			Config::Instance()->assign(std::string("CsvLogger/binary/resolution/") + name, strResolution);
+			std::vector<BinaryLogField> fields;
+			for (auto & column : m_Columns)
+			{
+				BinaryLogField field;
+				field.strName = column.first;
+				std::string strColumnResolution = strResolution;
+				Config::Instance()->assign(std::string("CsvLogger/binary/resolution/") + name + "/" + column.first, strColumnResolution);
+				field.fResolution = max(0.0, atof(strColumnResolution.c_str()));
+				switch (column.second)
+				{
+				case ValueType::type_uint64: field.type = BLT_Uint64; break;
+				case ValueType::type_f: field.type = BLT_Float; break;
+				default: field.type = BLT_String; break;
+				}
+				fields.push_back(field);
+			}
+			m_pBinaryWriter.reset(new BinaryLogWriter(m_DataFile, fields, max(1, nChunkRows), bCompressed));
+			if (m_pIndex)
+				m_pBinaryWriter->setIndex(m_pIndex.get(), m_iIndexColumn);
+		}
 		else
-			log<true>();
+		{
+			// Significant digits of float columns, 6 as std::ostream unless set per column
+			int nPrecision = FLOAT_PRECISION_DEFAULT;
+			Config::Instance()->assign("CsvLogger/precision", nPrecision);
+			for (auto & column : m_Columns)
+			{
+				int nColumnPrecision = nPrecision;
+				Config::Instance()->assign(std::string("CsvLogger/precision/") + name + "/" + column.first, nColumnPrecision);
+				m_vecPrecision.push_back(nColumnPrecision);
+			}
+			m_LineBuffer.resize(64 * 1024);
+
+			// Header
+			for (auto & column : m_Columns)
+				m_DataFile << column.first << ',';
+			m_DataFile << CSV_LINE_BREAK;
+			m_nFileBytes = static_cast<uint64_t>(m_DataFile.tellp());
+		}
+		if (m_pAsyncArena)
+			AsyncLogWriter::Instance()->addArena(m_pAsyncArena.get());
 	}
 }
 
 
-CsvLogger::~CsvLogger()
+LogFile::~LogFile()
 {
+	// Writes the rows still buffered, then the last chunk and its index entry
+	const bool bCommit = m_pAsyncArena && AsyncLogWriter::Instance()->isCommitEnabled();
+	m_pAsyncArena.reset();
+	if (bCommit)
+		commitFile();
+	m_pBinaryWriter.reset();
+	m_pIndex.reset();
 	if (m_DataFile.is_open()) {
 		m_DataFile.close();
 	}
 }
 
-void CsvLogger::generateFileName(std::string & dest, const char * suffix)
+void LogFile::writeRows(const uint64_t * pSlots, size_t nRows)
+{
+	const size_t nColumns = m_Columns.size();
+	if (m_pBinaryWriter)
+	{
+		for (size_t iRow = 0; iRow < nRows; iRow++, pSlots += nColumns)
+			m_pBinaryWriter->append(pSlots);
+		m_bUncommitted = true;
+		return;
+	}
+
+	// The rows are formatted into the line buffer, which is written whenever it is full
+	char * const pBegin = m_LineBuffer.data();
+	char * const pEnd = pBegin + m_LineBuffer.size();
+	char * p = pBegin;
+	// Start of the bytes not yet added to the checksum of the index block
+	char * pIndexed = pBegin;
+	for (size_t iRow = 0; iRow < nRows; iRow++, pSlots += nColumns)
+	{
+		if (m_pIndex)
+		{
+			m_pIndex->addBytes(pIndexed, p - pIndexed);
+			m_pIndex->addRow(m_nFileBytes + (p - pBegin), pSlots[m_iIndexColumn]);
+			pIndexed = p;
+		}
+		for (size_t i = 0; i < nColumns; i++)
+		{
+			const char * str = NULL;
+			size_t nLength = NUMBER_FORMAT_MAX_LENGTH;
+			if (m_Columns[i].second == ValueType::type_str)
+			{
+				str = ValueType::loadString(pSlots[i]);
+				nLength = str ? strlen(str) : 0;
+			}
+			if (size_t(pEnd - p) < nLength + 1 + CSV_LINE_BREAK_LENGTH)
+			{
+				if (m_pIndex)
+					m_pIndex->addBytes(pIndexed, p - pIndexed);
+				m_DataFile.write(pBegin, p - pBegin);
+				m_nFileBytes += p - pBegin;
+				p = pIndexed = pBegin;
+				if (size_t(pEnd - p) < nLength + 1 + CSV_LINE_BREAK_LENGTH)
+				{
+					// Longer than the line buffer
+					if (m_pIndex)
+						m_pIndex->addBytes(str, nLength);
+					m_DataFile.write(str, nLength);
+					m_nFileBytes += nLength;
+					nLength = 0;
+				}
+			}
+
+			switch (m_Columns[i].second)
+			{
+			case ValueType::type_uint64:
+				p = formatUint64(p, pSlots[i]);
+				break;
+			case ValueType::type_f:
+				p = formatFloat(p, ValueType::loadFloat(pSlots[i]), m_vecPrecision[i]);
+				break;
+			default:
+				memcpy(p, str, nLength);
+				p += nLength;
+				break;
+			}
+			*p++ = ',';
+		}
+		memcpy(p, CSV_LINE_BREAK, CSV_LINE_BREAK_LENGTH);
+		p += CSV_LINE_BREAK_LENGTH;
+	}
+	if (m_pIndex)
+		m_pIndex->addBytes(pIndexed, p - pIndexed);
+	m_DataFile.write(pBegin, p - pBegin);
+	m_nFileBytes += p - pBegin;
+	m_bUncommitted = true;
+}
+
+uint64_t LogFile::getFileSize()
+{
+	return m_pBinaryWriter ? static_cast<uint64_t>(m_DataFile.tellp()) : m_nFileBytes;
+}
+
+bool LogFile::commitFile()
+{
+	if (!m_bUncommitted)
+		return true;
+	m_bUncommitted = false;
+	// The rows of a partly filled chunk are written as a chunk of their own
+	if (m_pBinaryWriter)
+		m_pBinaryWriter->flush();
+	m_DataFile.flush();
+	if (!m_pSync)
+		m_pSync.reset(new FileSync(m_strFileName));
+	// The data is on the disk before the index entries that point to it
+	bool bSynced = m_pSync->sync();
+	if (m_pIndex)
+		bSynced = m_pIndex->commit() && bSynced;
+	return bSynced;
+}
+
+void LogFile::generateFileName(std::string & dest, const char * suffix, const char * extension)
 {
 	//system("mkdir data");
 	std::string strSuffix(suffix);
@@ -106,10 +307,23 @@ void CsvLogger::generateFileName(std::string & dest, const char * suffix)
 		<< std::setw(2) << timeinfo->tm_sec << "_"
 		<< suffix;
 	if (strSuffix.find('.') == std::string::npos)
-		ssFileName << MapCounter[strSuffix] << ".csv";
+		ssFileName << MapCounter[strSuffix] << extension;
 	if (!s_strDataPath.empty() && s_strDataPath.back() != '\\')
 		s_strDataPath += '\\';
 	dest = s_strDataPath + ssFileName.str();
 }
 
 
+CsvLogger::CsvLogger(const char * name, vector_header_value_t && vectorHeaderValue) :
+	LogFile(name, getColumns(vectorHeaderValue)),
+	m_VectorHeaderValue(std::move(vectorHeaderValue))
+{
+}
+
+vector_log_column_t CsvLogger::getColumns(const vector_header_value_t & vectorHeaderValue)
+{
+	vector_log_column_t columns;
+	for (auto & headerValue : vectorHeaderValue)
+		columns.emplace_back(headerValue.first, headerValue.second.getType());
+	return columns;
+}
@@ -1,16 +1,24 @@
 #pragma once
+#include <cstring>
 #include <fstream>
+#include <memory>
 #include <mutex>
 #include <vector>
 #include <utility>
+#include "BinaryLog.h"
+#include "AsyncLogWriter.h"
+#include "LogIndex.h"
 
 // This is a data logger class in compliance with RAII
 class ValueType {
-	enum {
+public:
+	enum value_type_t {
 		type_uint64 = 0,
 		type_f,
 		type_str
-	} type;
+	};
+private:
+	value_type_t type;
 
 	union {
 		const uint64_t * n_;
@@ -31,48 +39,141 @@ public:
 		type = type_str;
 	}
 
+	value_type_t getType() const { return type; }
+
+	// Copies the current value into a 64-bit slot: floats by their bits and strings by
+	// their address, so logged strings have to outlive the logger (e.g. string literals)
+	uint64_t load() const {
+		switch (type) {
+		case type_uint64: return *n_;
+		case type_f: return storeFloat(*f_);
+		default: return storeString(*str_);
+		}
+	}
+	static uint64_t storeFloat(float f) {
+		uint32_t bits;
+		memcpy(&bits, &f, sizeof(bits));
+		return bits;
+	}
+	static uint64_t storeString(const char * str) {
+		return reinterpret_cast<uintptr_t>(str);
+	}
+	static float loadFloat(uint64_t slot) {
+		const uint32_t bits = static_cast<uint32_t>(slot);
+		float f;
+		memcpy(&f, &bits, sizeof(f));
+		return f;
+	}
+	static const char * loadString(uint64_t slot) {
+		return reinterpret_cast<const char *>(static_cast<uintptr_t>(slot));
+	}
+
 	friend std::ostream & operator<<(std::ostream & lhs, ValueType & rhs);
 };
 
 typedef std::vector<std::pair<std::string, ValueType>> vector_header_value_t;
+typedef std::vector<std::pair<std::string, ValueType::value_type_t>> vector_log_column_t;
 
 const char * getJointTypeString(int enumVal);
 
-class CsvLogger
+// One log file with fixed columns: a csv file or a binary log, written on the logging thread
+// or by the writer thread of AsyncLogWriter. The loggers add how a row is taken.
+class LogFile
 {
 private:
 	std::ofstream m_DataFile;
-	CsvLogger::vector_header_value_t m_VectorHeaderValue;
+	vector_log_column_t m_Columns;
+	// Set if "CsvLogger/format" is "binary", see BinaryLog.h
+	std::unique_ptr<BinaryLogWriter> m_pBinaryWriter;
+	// Set if "CsvLogger/async/enabled" is true. The file is then only written by the
+	// writer thread of AsyncLogWriter.
+	std::unique_ptr<AsyncLogArena> m_pAsyncArena;
+	std::vector<char> m_FileBuffer;
+	std::vector<uint64_t> m_Row;
+	// Significant digits of float columns of csv files, and the line buffer they are formatted in
+	std::vector<int> m_vecPrecision;
+	std::vector<char> m_LineBuffer;
+	// Set if the log has a k4a_ts_usec column and "CsvLogger/index/enabled" is true
+	std::unique_ptr<LogIndexWriter> m_pIndex;
+	size_t m_iIndexColumn;
+	uint64_t m_nFileBytes;  // of csv files
+	std::string m_strFileName;
+	// Opened by the first commit, see commitFile()
+	std::unique_ptr<FileSync> m_pSync;
+	bool m_bUncommitted;    // rows were written since the last commit
 protected:
-	std::mutex m_Mutex;
 	static std::string s_strDataPath;
 	static time_t m_rawtime; // the number of seconds elapsed since 1900 at 00:00 UTC
+public:
+	// Argument "name" is suffixed to the file name. Reads the "CsvLogger/..." parameters and
+	// opens the file if logging is enabled.
+	LogFile(const char * name, vector_log_column_t && columns);
+	~LogFile();
+
+	bool isOpen() const { return m_DataFile.is_open(); }
+
+	// Rows dropped because the writer thread fell behind
+	uint64_t getDroppedCount() const { return m_pAsyncArena ? m_pAsyncArena->getDroppedCount() : 0; }
+
+protected:
+	// Logs one row. funEncode(uint64_t * pSlots) stores the values of the row, one slot per
+	// column in the format of ValueType::load().
+	template <typename Encode>
+	void logRow(Encode funEncode)
+	{
+		if (m_pAsyncArena)
+		{
+			m_pAsyncArena->append(funEncode);
+			return;
+		}
+		funEncode(m_Row.data());
+		writeRows(m_Row.data(), 1);
+	}
+
+	friend class AsyncLogWriter;
+	void writeRows(const uint64_t * pSlots, size_t nRows);
+	void flushFile()
+	{
+		m_DataFile.flush();
+		if (m_pIndex) m_pIndex->flush();
+	}
+	// Bytes written to the file so far, without the rows of a binary chunk that is still open
+	uint64_t getFileSize();
+	// Writes all rows given to writeRows() so far and returns once they and their index
+	// entries are on the disk. Ends the open chunk of a binary log and the open index block.
+	bool commitFile();
+
+	// Attach timestamp to the beginning of the file name
+	void generateFileName(std::string & dest, const char * suffix, const char * extension = ".csv");
+};
+
+// This is a data logger class in compliance with RAII. The values are read through the
+// pointers given to the constructor; see TypedLogger.h for loggers of records.
+class CsvLogger : public LogFile
+{
+private:
+	vector_header_value_t m_VectorHeaderValue;
+protected:
+	std::mutex m_Mutex;
 public:
 	// Constructor of BaseLogger
 	// Argument "name" is suffixed to the file name.
 	// Be sure to instantiate it as a member variable or static local variable
 	CsvLogger(const char * name, vector_header_value_t && vectorHeaderValue);
-	~CsvLogger();
 
-	template <bool isHeader=false>
 	void log()
 	{
-		if (m_DataFile.is_open() == false) return;
-		for (auto headerValue : m_VectorHeaderValue)
-		{
-			if (isHeader)
-				m_DataFile << headerValue.first << ',';
-			else
-				m_DataFile << headerValue.second << ',';
-
-		}
-		m_DataFile << '\n';
+		if (isOpen() == false) return;
+		logRow([this](uint64_t * pSlots) { encode(pSlots); });
 	}
 
-protected:
-
-	// Attach timestamp to the beginning of the file name
-	void generateFileName(std::string & dest, const char * suffix);
+	// Loads the current values, one slot per column
+	void encode(uint64_t * pSlots) const
+	{
+		for (size_t i = 0; i < m_VectorHeaderValue.size(); i++)
+			pSlots[i] = m_VectorHeaderValue[i].second.load();
+	}
 
+private:
+	static vector_log_column_t getColumns(const vector_header_value_t & vectorHeaderValue);
 };
-
@@ -0,0 +1,235 @@
+#include "CsvReplaySource.h"
+#include "Config.h"
+#include "CsvLogger.h"
+#include "KinectAzure.h"
+#include "LogIndex.h"
+#include "SkeletonKernels.h"
+
+CsvReplaySource::CsvReplaySource(
+	std::function<void(static_control_type, const wchar_t*)> funPrintMessage,
+	FrameBus & bus
+) :
+	SensorSource(funPrintMessage, bus),
+	m_bLoop(false),
+	m_nStartUsec(0)
+{
+	Config* pConfig = Config::Instance();
+	pConfig->assign("source/csv/skeletonFile", m_strSkeletonFile);
+	pConfig->assign("source/csv/imuFile", m_strImuFile);
+	pConfig->assign("source/loop", m_bLoop);
+	// Device timestamps exceed the range of int
+	std::string strStartUsec;
+	if (pConfig->assign("source/csv/startUsec", strStartUsec))
+		m_nStartUsec = strtoull(strStartUsec.c_str(), nullptr, 10);
+}
+
+CsvReplaySource::~CsvReplaySource()
+{
+	stop();
+}
+
+void CsvReplaySource::seekToStart(CsvLogCursor & cursor, const std::string & strFileName) const
+{
+	if (m_nStartUsec == 0)
+		return;
+	try
+	{
+		LogIndex index(strFileName);
+		const size_t iBlock = index.find(m_nStartUsec);
+		if (iBlock < index.getEntries().size())
+			cursor.seek(index.getEntries()[iBlock].nOffset);
+	}
+	catch (const std::runtime_error &)
+	{
+		// Without an index the rows before the start are read and skipped
+	}
+}
+
+void CsvReplaySource::SkeletonProc()
+{
+	if (m_strSkeletonFile.empty())
+		return;
+
+	uint64_t nOffsetUsec = 0;
+	do
+	{
+		std::unique_ptr<CsvLogReader> pReader;
+		try
+		{
+			pReader.reset(new CsvLogReader(m_strSkeletonFile));
+		}
+		catch (const std::runtime_error &)
+		{
+			if (m_funPrintMessage) m_funPrintMessage(SCT_Kinect, L"Failed to open the skeleton csv file to replay.");
+			return;
+		}
+		if (m_funPrintMessage) m_funPrintMessage(SCT_Kinect, L"Replaying skeleton csv file.");
+
+		CsvLogCursor cursor = pReader->begin();
+		seekToStart(cursor, m_strSkeletonFile);
+
+		// k4a_ts_usec, joint_type, px, py, pz, qw, qx, qy, qz
+		const size_t NUM_FIELDS = 9;
+		BodyFrameRef frame; // the rows are parsed straight into a pooled frame
+		bool bLogged[K4ABT_JOINT_COUNT] = {};
+		uint64_t timestamp_usec = 0, first_usec = 0, last_usec = 0;
+		bool bEmpty = true;
+
+		while (!m_bTerminating && cursor.next())
+		{
+			if (cursor.getFieldCount() < NUM_FIELDS)
+				continue;
+			uint64_t row_usec = cursor.getUint64(0);
+			if (row_usec < m_nStartUsec)
+				continue;
+			row_usec += nOffsetUsec;
+			if (bEmpty || row_usec != timestamp_usec)
+			{
+				if (!bEmpty)
+					deliverSkeleton(timestamp_usec, frame, bLogged);
+				std::fill(std::begin(bLogged), std::end(bLogged), false);
+				frame = m_Bus.bodyFramePool.acquire();
+				if (frame)
+				{
+					frame->timestamp_usec = row_usec;
+					frame->num_bodies = 1;
+					frame->body_ids[0] = 1;
+					frame->clearBody(0);
+				}
+			}
+			if (bEmpty)
+				first_usec = row_usec;
+			timestamp_usec = last_usec = row_usec;
+			bEmpty = false;
+
+			for (int j = 0; j < K4ABT_JOINT_COUNT && frame; j++)
+			{
+				if (cursor.isEqual(1, getJointTypeString(j)))
+				{
+					size_t i = BodyFrame::index(0, j);
+					frame->joints.px[i] = cursor.getFloat(2);
+					frame->joints.py[i] = cursor.getFloat(3);
+					frame->joints.pz[i] = cursor.getFloat(4);
+					frame->joints.qw[i] = cursor.getFloat(5);
+					frame->joints.qx[i] = cursor.getFloat(6);
+					frame->joints.qy[i] = cursor.getFloat(7);
+					frame->joints.qz[i] = cursor.getFloat(8);
+					bLogged[j] = true;
+					break;
+				}
+			}
+		}
+		if (!bEmpty && !m_bTerminating)
+			deliverSkeleton(timestamp_usec, frame, bLogged);
+		frame.reset();
+
+		// Keep the timestamps increasing when starting over
+		nOffsetUsec += last_usec - first_usec + 33333;
+	} while (m_bLoop && !m_bTerminating);
+}
+
+void CsvReplaySource::deliverSkeleton(uint64_t timestamp_usec, const BodyFrameRef & frame, const bool * pbLogged)
+{
+	// Dropped, and counted by the pool, if it had no frame to spare. Its time still passes,
+	// so that the frames after it are not delivered early.
+	if (!frame)
+	{
+		waitForDeviceTime(timestamp_usec);
+		return;
+	}
+	JointArrays & joints = frame->joints;
+
+	// Place the joints that were not logged at the pelvis, or at any logged joint if the pelvis is missing
+	int iAnchor = K4ABT_JOINT_PELVIS;
+	for (int j = 0; j < K4ABT_JOINT_COUNT && !pbLogged[iAnchor]; j++)
+		iAnchor = j;
+	for (int j = 0; j < K4ABT_JOINT_COUNT; j++)
+	{
+		if (!pbLogged[j])
+		{
+			joints.px[j] = joints.px[iAnchor];
+			joints.py[j] = joints.py[iAnchor];
+			joints.pz[j] = joints.pz[iAnchor];
+		}
+	}
+	checkOrientationNorms(joints, 1, MIN_ORIENTATION_NORM2, frame->valid_joints);
+
+	if (!waitForDeviceTime(frame->timestamp_usec))
+		return;
+	frame->stamps.device_usec = frame->timestamp_usec;
+	frame->stamps.captured_ns = LatencyStats::now();
+	m_Bus.publishBodyFrame(frame);
+}
+
+void CsvReplaySource::ImuProc()
+{
+	if (m_strImuFile.empty())
+		return;
+
+	uint64_t nOffsetUsec = 0;
+	do
+	{
+		std::unique_ptr<CsvLogReader> pReader;
+		try
+		{
+			pReader.reset(new CsvLogReader(m_strImuFile));
+		}
+		catch (const std::runtime_error &)
+		{
+			if (m_funPrintMessage) m_funPrintMessage(SCT_IMU, L"Failed to open the IMU csv file to replay.");
+			return;
+		}
+
+		CsvLogCursor cursor = pReader->begin();
+		seekToStart(cursor, m_strImuFile);
+
+		// k4a_ts_usec, wx, wy, wz, ax, ay, az
+		const size_t NUM_FIELDS = 7;
+		uint64_t first_usec = 0, last_usec = 0;
+		bool bEmpty = true;
+		k4a_imu_sample_t imu_samples[IMU_BATCH_SIZE];
+		size_t nCount = 0;
+
+		while (!m_bTerminating && cursor.next())
+		{
+			if (cursor.getFieldCount() < NUM_FIELDS)
+				continue;
+			const uint64_t row_usec = cursor.getUint64(0);
+			if (row_usec < m_nStartUsec)
+				continue;
+			k4a_imu_sample_t & imu_sample = imu_samples[nCount];
+			imu_sample = {};
+			imu_sample.acc_timestamp_usec = row_usec + nOffsetUsec;
+			imu_sample.gyro_timestamp_usec = imu_sample.acc_timestamp_usec;
+			imu_sample.gyro_sample.xyz.x = cursor.getFloat(1);
+			imu_sample.gyro_sample.xyz.y = cursor.getFloat(2);
+			imu_sample.gyro_sample.xyz.z = cursor.getFloat(3);
+			imu_sample.acc_sample.xyz.x = cursor.getFloat(4);
+			imu_sample.acc_sample.xyz.y = cursor.getFloat(5);
+			imu_sample.acc_sample.xyz.z = cursor.getFloat(6);
+			if (bEmpty)
+				first_usec = imu_sample.acc_timestamp_usec;
+			last_usec = imu_sample.acc_timestamp_usec;
+			bEmpty = false;
+
+			// Hand over the samples that are due before waiting for the next one
+			if (nCount > 0 && !isDeviceTimeDue(imu_sample.acc_timestamp_usec))
+			{
+				m_Bus.publishImuSamples(imu_samples, nCount, LatencyStats::now());
+				imu_samples[0] = imu_sample;
+				nCount = 0;
+			}
+			if (!waitForDeviceTime(imu_samples[nCount].acc_timestamp_usec))
+				break;
+			if (++nCount == IMU_BATCH_SIZE)
+			{
+				m_Bus.publishImuSamples(imu_samples, nCount, LatencyStats::now());
+				nCount = 0;
+			}
+		}
+		if (nCount > 0 && !m_bTerminating)
+			m_Bus.publishImuSamples(imu_samples, nCount, LatencyStats::now());
+
+		nOffsetUsec += last_usec - first_usec + 625;
+	} while (m_bLoop && !m_bTerminating);
+}
@@ -0,0 +1,31 @@
+#pragma once
+#include "SensorSource.h"
+#include "CsvLogReader.h"
+
+// Replays the "partial_skeleton" and "imu" csv files written by CsvLogger.
+// Rows of the skeleton log that share a timestamp make up one body. Joints that were not
+// logged are placed at the pelvis with a zero orientation.
+class CsvReplaySource : public SensorSource
+{
+private:
+	std::string             m_strSkeletonFile;
+	std::string             m_strImuFile;
+	bool                    m_bLoop;
+	uint64_t                m_nStartUsec;       // rows before it are skipped
+
+public:
+	CsvReplaySource(
+		std::function<void(static_control_type, const wchar_t*)> funPrintMessage,
+		FrameBus & bus
+	);
+	~CsvReplaySource();
+
+protected:
+	void SkeletonProc() override;
+	void ImuProc() override;
+
+	// Moves the cursor to the block of m_nStartUsec if the file has an index
+	void seekToStart(CsvLogCursor & cursor, const std::string & strFileName) const;
+	// frame is empty if the pool had none to spare; the replay still keeps its pace
+	void deliverSkeleton(uint64_t timestamp_usec, const BodyFrameRef & frame, const bool * pbLogged);
+};
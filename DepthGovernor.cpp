@@ -0,0 +1,218 @@
+#include "stdafx.h"
+#include "DepthGovernor.h"
+#include "Config.h"
+#include <algorithm>
+
+static int getFramesPerSecond(k4a_fps_t camera_fps)
+{
+	return camera_fps == K4A_FRAMES_PER_SECOND_5 ? 5 : camera_fps == K4A_FRAMES_PER_SECOND_15 ? 15 : 30;
+}
+
+static double getDepthPixels(k4a_depth_mode_t depth_mode)
+{
+	switch (depth_mode)
+	{
+	case K4A_DEPTH_MODE_NFOV_2X2BINNED: return 320.0 * 288;
+	case K4A_DEPTH_MODE_NFOV_UNBINNED: return 640.0 * 576;
+	case K4A_DEPTH_MODE_WFOV_2X2BINNED: return 512.0 * 512;
+	case K4A_DEPTH_MODE_WFOV_UNBINNED: return 1024.0 * 1024;
+	default: return 0;
+	}
+}
+
+static bool isSameLevel(const DepthLevel & a, const DepthLevel & b)
+{
+	return a.depth_mode == b.depth_mode && a.camera_fps == b.camera_fps;
+}
+
+DepthGovernor::DepthGovernor() :
+	m_bEnabled(false),
+	m_nBudgetMs(100),
+	m_fUpRatio(0.6),
+	m_nWindowMs(2000),
+	m_nDownWindows(2),
+	m_nUpWindows(5),
+	m_nSettleMs(3000),
+	m_nMinFps(15),
+	m_iLevel(0),
+	m_nOccupancySum(0),
+	m_nWindowStartNs(0),
+	m_nSettleUntilNs(0),
+	m_bSettling(false),
+	m_nOverWindows(0),
+	m_nUnderWindows(0),
+	m_nUpPenalty(1),
+	m_bProbing(false),
+	m_nProbeWindows(0),
+	m_nLastP90Us(0)
+{
+}
+
+double DepthGovernor::getCost(const DepthLevel & level)
+{
+	return getDepthPixels(level.depth_mode) * getFramesPerSecond(level.camera_fps);
+}
+
+void DepthGovernor::setParams(k4a_depth_mode_t depth_mode, k4a_fps_t camera_fps)
+{
+	std::lock_guard<std::mutex> lk(m_Mutex);
+	Config::Instance()->assign("k4a/governor/enabled", m_bEnabled);
+	Config::Instance()->assign("k4a/governor/latencyBudget_ms", m_nBudgetMs);
+	Config::Instance()->assign("k4a/governor/stepUpRatio", m_fUpRatio);
+	Config::Instance()->assign("k4a/governor/window_ms", m_nWindowMs);
+	Config::Instance()->assign("k4a/governor/downWindows", m_nDownWindows);
+	Config::Instance()->assign("k4a/governor/upWindows", m_nUpWindows);
+	Config::Instance()->assign("k4a/governor/settle_ms", m_nSettleMs);
+	Config::Instance()->assign("k4a/governor/minFps", m_nMinFps);
+	m_nWindowMs = max(100, m_nWindowMs);
+	m_nDownWindows = max(1, m_nDownWindows);
+	m_nUpWindows = max(1, m_nUpWindows);
+
+	// The levels keep the field of view and never exceed the configured resolution or frame
+	// rate. Tracking at less than "k4a/governor/minFps" is not worth it, unless configured.
+	const DepthLevel ceiling = { depth_mode, camera_fps };
+	std::vector<DepthLevel> vecLevels(1, ceiling);
+	std::vector<k4a_depth_mode_t> vecModes;
+	if (depth_mode == K4A_DEPTH_MODE_NFOV_UNBINNED || depth_mode == K4A_DEPTH_MODE_NFOV_2X2BINNED)
+		vecModes = { K4A_DEPTH_MODE_NFOV_UNBINNED, K4A_DEPTH_MODE_NFOV_2X2BINNED };
+	else if (depth_mode == K4A_DEPTH_MODE_WFOV_UNBINNED || depth_mode == K4A_DEPTH_MODE_WFOV_2X2BINNED)
+		vecModes = { K4A_DEPTH_MODE_WFOV_UNBINNED, K4A_DEPTH_MODE_WFOV_2X2BINNED };
+	for (k4a_depth_mode_t mode : vecModes)
+	{
+		for (k4a_fps_t fps : { K4A_FRAMES_PER_SECOND_30, K4A_FRAMES_PER_SECOND_15, K4A_FRAMES_PER_SECOND_5 })
+		{
+			const DepthLevel level = { mode, fps };
+			if (isSameLevel(level, ceiling) || getDepthPixels(mode) > getDepthPixels(depth_mode) ||
+				getFramesPerSecond(fps) > getFramesPerSecond(camera_fps) || getFramesPerSecond(fps) < m_nMinFps ||
+				(mode == K4A_DEPTH_MODE_WFOV_UNBINNED && fps == K4A_FRAMES_PER_SECOND_30))
+				continue;
+			vecLevels.push_back(level);
+		}
+	}
+	std::stable_sort(vecLevels.begin() + 1, vecLevels.end(),
+		[](const DepthLevel & a, const DepthLevel & b) { return getCost(a) > getCost(b); });
+
+	// A new configuration starts over from the top, otherwise the level is kept
+	size_t iLevel = 0;
+	if (m_bEnabled && m_iLevel < m_vecLevels.size() && isSameLevel(m_vecLevels[0], ceiling))
+	{
+		for (size_t i = 0; i < vecLevels.size(); i++)
+		{
+			if (isSameLevel(vecLevels[i], m_vecLevels[m_iLevel]))
+				iLevel = i;
+		}
+	}
+	const bool bRestart = !isSameLevel(ceiling, m_vecLevels.empty() ? ceiling : m_vecLevels[0]) || iLevel != m_iLevel;
+	m_vecLevels.swap(vecLevels);
+	m_iLevel = iLevel;
+	if (bRestart)
+	{
+		m_nUpPenalty = 1;
+		m_bProbing = false;
+		setLevel(iLevel, 0);
+	}
+}
+
+bool DepthGovernor::update(uint64_t nNowNs, uint64_t nLatencyUs, int nOccupancy, int nMaxInFlight)
+{
+	std::lock_guard<std::mutex> lk(m_Mutex);
+	if (!m_bEnabled || m_vecLevels.size() < 2)
+		return false;
+
+	// The first frames after a restart carry the downtime and a cold tracker
+	if (m_bSettling)
+	{
+		m_bSettling = false;
+		m_nSettleUntilNs = nNowNs + uint64_t(max(0, m_nSettleMs)) * 1000000;
+	}
+	if (nNowNs < m_nSettleUntilNs)
+		return false;
+
+	if (m_nWindowStartNs == 0)
+		m_nWindowStartNs = nNowNs;
+	m_vecLatencyUs.push_back(nLatencyUs);
+	m_nOccupancySum += nOccupancy;
+	if (nNowNs - m_nWindowStartNs < uint64_t(m_nWindowMs) * 1000000)
+		return false;
+
+	const size_t iLevel = m_iLevel;
+	evaluate(nNowNs, nMaxInFlight);
+	return m_iLevel != iLevel;
+}
+
+void DepthGovernor::evaluate(uint64_t nNowNs, int nMaxInFlight)
+{
+	// The 90th percentile ignores the odd slow frame, e.g. when a body enters the scene
+	std::vector<uint64_t>::iterator itP90 = m_vecLatencyUs.begin() + m_vecLatencyUs.size() * 9 / 10;
+	std::nth_element(m_vecLatencyUs.begin(), itP90, m_vecLatencyUs.end());
+	m_nLastP90Us = *itP90;
+	const double fOccupancy = double(m_nOccupancySum) / m_vecLatencyUs.size();
+	resetWindow();
+
+	// A pipelined queue that is full at nearly every pop means captures are being dropped,
+	// even if the frames that make it through are within budget
+	const bool bSaturated = nMaxInFlight > 1 && fOccupancy > nMaxInFlight - 0.25;
+	const uint64_t nBudgetUs = uint64_t(max(1, m_nBudgetMs)) * 1000;
+	const bool bOver = bSaturated || m_nLastP90Us > nBudgetUs;
+	const bool bUnder = !bSaturated && m_nLastP90Us < m_fUpRatio * nBudgetUs;
+	m_nOverWindows = bOver ? m_nOverWindows + 1 : 0;
+	m_nUnderWindows = bUnder ? m_nUnderWindows + 1 : 0;
+
+	// A level stepped up to has held once it stayed within budget as long as it took to try it
+	if (m_bProbing && !bOver && ++m_nProbeWindows >= m_nUpWindows)
+	{
+		m_bProbing = false;
+		m_nUpPenalty = 1;
+	}
+
+	if (m_nOverWindows >= m_nDownWindows && m_iLevel + 1 < m_vecLevels.size())
+	{
+		if (m_bProbing)
+			m_nUpPenalty = min(16, m_nUpPenalty * 2);
+		m_bProbing = false;
+		setLevel(m_iLevel + 1, nNowNs);
+	}
+	else if (m_nUnderWindows >= m_nUpWindows * m_nUpPenalty && m_iLevel > 0)
+	{
+		m_bProbing = true;
+		m_nProbeWindows = 0;
+		setLevel(m_iLevel - 1, nNowNs);
+	}
+}
+
+void DepthGovernor::setLevel(size_t iLevel, uint64_t nNowNs)
+{
+	m_iLevel = iLevel;
+	m_nOverWindows = 0;
+	m_nUnderWindows = 0;
+	m_bSettling = true;
+	m_nSettleUntilNs = nNowNs;
+	resetWindow();
+}
+
+void DepthGovernor::resetWindow()
+{
+	m_vecLatencyUs.clear();
+	m_nOccupancySum = 0;
+	m_nWindowStartNs = 0;
+}
+
+void DepthGovernor::apply(k4a_device_configuration_t & config)
+{
+	std::lock_guard<std::mutex> lk(m_Mutex);
+	if (m_iLevel < m_vecLevels.size())
+	{
+		config.depth_mode = m_vecLevels[m_iLevel].depth_mode;
+		config.camera_fps = m_vecLevels[m_iLevel].camera_fps;
+	}
+}
+
+std::wstring DepthGovernor::describe()
+{
+	std::lock_guard<std::mutex> lk(m_Mutex);
+	const size_t BUFFER_LEN = 128;
+	wchar_t pszText[BUFFER_LEN];
+	StringCchPrintf(pszText, BUFFER_LEN, L"Governor: level %d of %d, p90 latency %llu ms (budget %d ms, retry x%d).",
+		int(m_iLevel + 1), int(m_vecLevels.size()), m_nLastP90Us / 1000, m_nBudgetMs, m_nUpPenalty);
+	return pszText;
+}
@@ -0,0 +1,78 @@
+#pragma once
+#include "stdafx.h"
+#include <mutex>
+#include <string>
+#include <vector>
+
+// A depth mode and frame rate the governor can run the cameras at
+struct DepthLevel
+{
+	k4a_depth_mode_t        depth_mode;
+	k4a_fps_t               camera_fps;
+};
+
+// Keeps the skeleton latency within a budget on machines where the body tracker cannot keep
+// up with the configured depth mode and frame rate. The latency from capture to body frame
+// and the tracker queue occupancy are evaluated in windows. After "k4a/governor/downWindows"
+// windows over budget or with a full queue, the cameras step down to the next cheaper level,
+// and after "k4a/governor/upWindows" windows well below budget they step back up. A level
+// that was given up again soon after stepping up to it takes twice as long to retry, so the
+// governor settles instead of oscillating.
+class DepthGovernor
+{
+private:
+	std::mutex              m_Mutex;
+	bool                    m_bEnabled;
+	int                     m_nBudgetMs;
+	double                  m_fUpRatio;     // headroom: the latency is below m_fUpRatio * budget
+	int                     m_nWindowMs;
+	int                     m_nDownWindows;
+	int                     m_nUpWindows;
+	int                     m_nSettleMs;
+	int                     m_nMinFps;
+
+	// From the configured depth mode and frame rate (level 0) down to the cheapest one
+	std::vector<DepthLevel> m_vecLevels;
+	size_t                  m_iLevel;
+
+	// The current window
+	std::vector<uint64_t>   m_vecLatencyUs;
+	uint64_t                m_nOccupancySum;
+	uint64_t                m_nWindowStartNs;   // 0 until the first frame of the window
+	uint64_t                m_nSettleUntilNs;   // frames before are ignored after a level change
+	bool                    m_bSettling;        // the first frame after a level change starts settling
+
+	int                     m_nOverWindows;     // consecutive windows over budget
+	int                     m_nUnderWindows;    // consecutive windows with headroom
+	int                     m_nUpPenalty;       // multiplier of m_nUpWindows
+	bool                    m_bProbing;         // the level was stepped up to and has not held yet
+	int                     m_nProbeWindows;
+
+	uint64_t                m_nLastP90Us;
+
+public:
+	DepthGovernor();
+
+	// Reads the "k4a/governor" parameters. The levels are rebuilt below the configured depth
+	// mode and frame rate; if these changed, the governor starts over from them.
+	void setParams(k4a_depth_mode_t depth_mode, k4a_fps_t camera_fps);
+
+	// Records a body frame with its latency from capture to pop and the number of captures
+	// in the tracker queue, out of nMaxInFlight. Returns true if the level changed and the
+	// cameras are to be restarted.
+	bool update(uint64_t nNowNs, uint64_t nLatencyUs, int nOccupancy, int nMaxInFlight);
+
+	// Replaces the depth mode and frame rate of config with those of the current level
+	void apply(k4a_device_configuration_t & config);
+
+	// The current level and the latency that led to it, for the status list
+	std::wstring describe();
+
+	// Relative cost of tracking a level: depth pixels per second
+	static double getCost(const DepthLevel & level);
+
+private:
+	void evaluate(uint64_t nNowNs, int nMaxInFlight);
+	void setLevel(size_t iLevel, uint64_t nNowNs);
+	void resetWindow();
+};
@@ -0,0 +1,40 @@
+#pragma once
+#include "stdafx.h"
+#include <string>
+
+// A second handle to a file that is written through another one, e.g. a std::ofstream, to
+// force its data to the disk or to cut it short. Streams do not expose their handle.
+class FileSync
+{
+private:
+	HANDLE                  m_hFile;
+
+public:
+	explicit FileSync(const std::string & strFileName) :
+		m_hFile(CreateFileA(strFileName.c_str(), GENERIC_WRITE, FILE_SHARE_READ | FILE_SHARE_WRITE, NULL,
+			OPEN_EXISTING, FILE_ATTRIBUTE_NORMAL, NULL))
+	{
+	}
+	~FileSync()
+	{
+		if (m_hFile != INVALID_HANDLE_VALUE)
+			CloseHandle(m_hFile);
+	}
+	FileSync(const FileSync &) = delete;
+	FileSync & operator=(const FileSync &) = delete;
+
+	bool isOpen() const { return m_hFile != INVALID_HANDLE_VALUE; }
+
+	// Returns once the data written so far is on the disk. Flush the stream first.
+	bool sync()
+	{
+		return isOpen() && FlushFileBuffers(m_hFile) != 0;
+	}
+
+	bool truncate(uint64_t nSize)
+	{
+		LARGE_INTEGER position;
+		position.QuadPart = static_cast<LONGLONG>(nSize);
+		return isOpen() && SetFilePointerEx(m_hFile, position, NULL, FILE_BEGIN) && SetEndOfFile(m_hFile);
+	}
+};
@@ -0,0 +1,270 @@
+#pragma once
+#include "stdafx.h"
+#include <atomic>
+#include <condition_variable>
+#include <memory>
+#include <mutex>
+#include <string>
+#include <thread>
+#include <vector>
+#include "Config.h"
+#include "BodyFramePool.h"
+#include "CaptureProfile.h"
+
+// Maximum number of IMU samples carried by one ImuBatch
+const size_t IMU_BATCH_SIZE = 64;
+
+struct ImuBatch
+{
+	size_t                  nCount;
+	k4a_imu_sample_t        samples[IMU_BATCH_SIZE];
+	LatencyStamps           stamps;     // device_usec is the timestamp of the first sample
+};
+
+// A synchronization packet received from the sportsole data logger
+struct SyncEvent
+{
+	INT64                   tsWindows;      // GetTickCount64() on reception
+	INT64                   tsOdroid;
+	int                     nTrigger;
+	uint64_t                k4a_ts_usec;    // timestamp of the latest body frame published before it
+};
+
+// What a subscriber's queue does when a message arrives while it is full
+enum DropPolicy
+{
+	DP_LatestOnly = 0,  // keep only the newest message
+	DP_Block,           // make the publisher wait for space
+	DP_DropOldest       // discard the oldest queued message
+};
+
+// A topic of the in-process frame bus. Every subscriber gets its own bounded queue and
+// worker thread, so a slow subscriber never holds up the publisher or the other subscribers,
+// except under DP_Block. The queue of subscriber <name> on topic <topic> can be configured
+// with "FrameBus/<topic>/<name>/capacity" and "FrameBus/<topic>/<name>/policy"
+// (latest, block or dropOldest).
+template <typename T>
+class Topic
+{
+private:
+	struct Subscriber
+	{
+		std::string             strName;
+		DropPolicy              policy;
+		std::vector<T>          queue;          // circular buffer, allocated on subscription
+		size_t                  nHead;
+		size_t                  nCount;
+		bool                    bTerminating;
+		std::mutex              mutex;
+		std::condition_variable condNotEmpty;
+		std::condition_variable condNotFull;
+		std::atomic<uint64_t>   nDropped;
+		std::function<void(const T &)> funHandler;
+		std::thread             thread;
+
+		Subscriber() : nHead(0), nCount(0), bTerminating(false), nDropped(0) {}
+	};
+
+	typedef std::vector<std::shared_ptr<Subscriber>> Subscribers;
+
+	std::string                 m_strName;
+	// Serializes subscribe() and shutdown(), which replace m_pSubscribers. Publishers read it
+	// with std::atomic_load, so that one waiting on a DP_Block subscriber holds up no one else.
+	std::mutex                  m_Mutex;
+	std::shared_ptr<const Subscribers> m_pSubscribers;
+
+public:
+	explicit Topic(const std::string & strName) : m_strName(strName), m_pSubscribers(std::make_shared<Subscribers>()) {}
+	~Topic() { shutdown(); }
+
+	void subscribe(const std::string & strName, size_t nCapacity, DropPolicy policy, std::function<void(const T &)> funHandler)
+	{
+		std::string strPrefix = "FrameBus/" + m_strName + "/" + strName + "/";
+		int nCapacityConfig = static_cast<int>(nCapacity);
+		Config::Instance()->assign(strPrefix + "capacity", nCapacityConfig);
+		std::string strPolicy;
+		if (Config::Instance()->assign(strPrefix + "policy", strPolicy))
+		{
+			if (strPolicy.compare("latest") == 0)
+				policy = DP_LatestOnly;
+			else if (strPolicy.compare("block") == 0)
+				policy = DP_Block;
+			else if (strPolicy.compare("dropOldest") == 0)
+				policy = DP_DropOldest;
+		}
+
+		std::shared_ptr<Subscriber> pSubscriber = std::make_shared<Subscriber>();
+		pSubscriber->strName = strName;
+		pSubscriber->policy = policy;
+		pSubscriber->queue.resize(policy == DP_LatestOnly ? 1 : max(1, nCapacityConfig));
+		pSubscriber->funHandler = funHandler;
+		pSubscriber->thread = std::thread(&Topic::workerProc, pSubscriber.get());
+
+		std::lock_guard<std::mutex> lk(m_Mutex);
+		std::shared_ptr<Subscribers> pSubscribers = std::make_shared<Subscribers>(*m_pSubscribers);
+		pSubscribers->push_back(std::move(pSubscriber));
+		std::atomic_store(&m_pSubscribers, std::shared_ptr<const Subscribers>(std::move(pSubscribers)));
+	}
+
+	void publish(const T & message)
+	{
+		const std::shared_ptr<const Subscribers> pSubscribers = std::atomic_load(&m_pSubscribers);
+		// The subscribers that never wait get the message first
+		for (int iPass = 0; iPass < 2; iPass++)
+		{
+			for (auto & pSubscriber : *pSubscribers)
+			{
+				Subscriber & sub = *pSubscriber;
+				if ((sub.policy == DP_Block) != (iPass == 1))
+					continue;
+				std::unique_lock<std::mutex> lkSub(sub.mutex);
+				if (sub.bTerminating)
+					continue;
+				const size_t nCapacity = sub.queue.size();
+				if (sub.nCount == nCapacity)
+				{
+					if (sub.policy == DP_Block)
+					{
+						sub.condNotFull.wait(lkSub, [&sub, nCapacity] { return sub.bTerminating || sub.nCount < nCapacity; });
+						if (sub.bTerminating)
+							continue;
+					}
+					else
+					{
+						// Overwrite the oldest message
+						sub.nHead = (sub.nHead + 1) % nCapacity;
+						sub.nCount--;
+						sub.nDropped++;
+					}
+				}
+				sub.queue[(sub.nHead + sub.nCount) % nCapacity] = message;
+				sub.nCount++;
+				lkSub.unlock();
+				sub.condNotEmpty.notify_one();
+			}
+		}
+	}
+
+	// Number of messages the named subscriber has dropped so far
+	uint64_t getDropCount(const std::string & strName)
+	{
+		const std::shared_ptr<const Subscribers> pSubscribers = std::atomic_load(&m_pSubscribers);
+		for (auto & pSubscriber : *pSubscribers)
+			if (pSubscriber->strName == strName)
+				return pSubscriber->nDropped;
+		return 0;
+	}
+
+	// Stops all worker threads. DP_Block subscribers handle the messages still queued first,
+	// the other subscribers discard them.
+	void shutdown()
+	{
+		std::lock_guard<std::mutex> lk(m_Mutex);
+		std::shared_ptr<const Subscribers> pSubscribers = std::make_shared<Subscribers>();
+		pSubscribers = std::atomic_exchange(&m_pSubscribers, pSubscribers);
+		for (auto & pSubscriber : *pSubscribers)
+		{
+			{
+				std::lock_guard<std::mutex> lkSub(pSubscriber->mutex);
+				pSubscriber->bTerminating = true;
+			}
+			pSubscriber->condNotEmpty.notify_all();
+			pSubscriber->condNotFull.notify_all();
+			if (pSubscriber->thread.joinable())
+				pSubscriber->thread.join();
+		}
+	}
+
+private:
+	static void workerProc(Subscriber * pSub)
+	{
+		Subscriber & sub = *pSub;
+		T message;
+		while (true)
+		{
+			{
+				std::unique_lock<std::mutex> lk(sub.mutex);
+				sub.condNotEmpty.wait(lk, [&sub] { return sub.bTerminating || sub.nCount > 0; });
+				if (sub.bTerminating && (sub.policy != DP_Block || sub.nCount == 0))
+					return;
+				message = std::move(sub.queue[sub.nHead]);
+				sub.nHead = (sub.nHead + 1) % sub.queue.size();
+				sub.nCount--;
+			}
+			sub.condNotFull.notify_one();
+			sub.funHandler(message);
+			message = T(); // let go of pooled objects right away
+		}
+	}
+};
+
+// The topics that connect the sensor sources to the sinks (display, csv logger, ROS, ...).
+// Sources publish without knowing who is listening, and sinks are added by subscribing.
+class FrameBus
+{
+public:
+	// Declared first so that it outlives the queues holding its frames
+	BodyFramePool           bodyFramePool;
+
+	Topic<BodyFrameRef>     bodyFrames;
+	Topic<ImuBatch>         imuBatches;
+	Topic<SyncEvent>        syncEvents;
+
+	// Streams of the device that the subscribers consume
+	CaptureProfile          captureProfile;
+
+private:
+	std::atomic<uint64_t>   m_nLastBodyTimestamp;
+
+public:
+	FrameBus() : bodyFramePool(getBodyFramePoolSize()), bodyFrames("bodyFrames"), imuBatches("imuBatches"), syncEvents("syncEvents"), m_nLastBodyTimestamp(0) {}
+
+	void publishBodyFrame(const BodyFrameRef & frame)
+	{
+		m_nLastBodyTimestamp = frame->timestamp_usec;
+		LatencyStats::Instance()->recordBodyDispatch(frame->stamps);
+		bodyFrames.publish(frame);
+	}
+
+	// Splits the samples into batches of at most IMU_BATCH_SIZE. captured_ns is the
+	// LatencyStats::now() at which the samples were read from the device.
+	void publishImuSamples(const k4a_imu_sample_t * pImuSamples, size_t nCount, uint64_t captured_ns)
+	{
+		ImuBatch batch;
+		while (nCount > 0)
+		{
+			batch.nCount = min(nCount, IMU_BATCH_SIZE);
+			std::copy(pImuSamples, pImuSamples + batch.nCount, batch.samples);
+			batch.stamps = LatencyStamps();
+			batch.stamps.device_usec = pImuSamples->acc_timestamp_usec;
+			batch.stamps.captured_ns = captured_ns;
+			LatencyStats::Instance()->recordImuDispatch(batch.stamps);
+			imuBatches.publish(batch);
+			pImuSamples += batch.nCount;
+			nCount -= batch.nCount;
+		}
+	}
+
+	void publishSyncEvent(INT64 tsWindows, INT64 tsOdroid, int nTrigger)
+	{
+		SyncEvent event = { tsWindows, tsOdroid, nTrigger, m_nLastBodyTimestamp };
+		syncEvents.publish(event);
+	}
+
+	void shutdown()
+	{
+		bodyFrames.shutdown();
+		imuBatches.shutdown();
+		syncEvents.shutdown();
+	}
+
+private:
+	// The pool must hold at least as many frames as all body frame queues together,
+	// plus the frames being filled by the sources and handled by the subscribers.
+	static size_t getBodyFramePoolSize()
+	{
+		int nSize = 128;
+		Config::Instance()->assign("FrameBus/bodyFramePool/size", nSize);
+		return static_cast<size_t>(max(1, nSize));
+	}
+};
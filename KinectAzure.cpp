@@ -2,44 +2,102 @@
 #include <chrono>
 #include <ctime>
 #include <array>
+#include <fstream>
+#include <iterator>
+#include <vector>
 #include "CsvLogger.h"
+#include "SkeletonKernels.h"
 
 KinectAzure::KinectAzure(
 	std::function<void(static_control_type, const wchar_t*)> funPrintMessage,
-	std::function<void(uint64_t nTime, int nBodyCount, const k4abt_skeleton_t *pSkeleton, const uint32_t * pID)> funProcessBody,
-	std::function<void(const k4a_imu_sample_t & ImuSample)> funProcessIMU,
+	FrameBus & bus,
+	StartupOrchestrator & startup,
 	std::function<void()> funBroadcastStaticTf
 ):
 	m_Kinect(NULL),
 	m_KinectConfig(K4A_DEVICE_CONFIG_INIT_DISABLE_ALL),
 	m_KinectCalibration({}),
-	m_KinectBodyTracker(NULL),
 	m_pSkeletonClosest(nullptr),
 	m_bTerminating(false),
+	m_Bus(bus),
+	m_Startup(startup),
+	m_bPipelined(false),
+	m_nMaxInFlight(2),
+	m_nTrackers(1),
+	m_nInFlight(),
+	m_nNextTracker(0),
+	m_Reorder(MAX_TRACKERS, [this](size_t iTracker, const BodyFrameRef & frame) { EmitBodyFrame(iTracker, frame); }),
+	m_nStatsStartTime(GetTickCount64()),
+	m_nStatsFrames(0),
+	m_nStatsOccupancySum(0),
+	m_nStatsOccupancyMax(0),
+	m_nStatsDropped(0),
+	m_nImuReadNs(0),
+	m_TrackerManager(funPrintMessage),
+	m_nReconnectIntervalMs(100),
+	m_strCalibrationCache("calibration_cache.json"),
+	m_RunningConfig(K4A_DEVICE_CONFIG_INIT_DISABLE_ALL),
+	m_nRunningProfile(0),
+	m_bReconfigure(false),
+	m_bRestarting(false),
+	m_bImuBusy(false),
+	m_nRestartStartNs(0),
+	m_nRestartCamerasMs(0),
+	m_pSource(SensorSource::create(funPrintMessage, bus)),
 	m_ThreadSkeleton(&KinectAzure::SkeletonProc, this),
 	m_ThreadImu(&KinectAzure::ImuProc, this),
+	m_ThreadImuPublish(&KinectAzure::ImuPublishProc, this),
 	m_ThreadStaticTf(&KinectAzure::StaticTfProc, this),
 	m_funPrintMessage(funPrintMessage),
-	m_funProcessBody(funProcessBody),
-	m_funProcessIMU(funProcessIMU),
 	m_funBroadcastStaticTf(funBroadcastStaticTf)
 {
+	for (size_t i = 0; i < MAX_TRACKERS; i++)
+		m_ThreadsSkeletonPop[i] = std::thread(&KinectAzure::SkeletonPopProc, this, i);
 	setParams();
+	// Applied to the running threads whenever the parameter file is loaded
+	m_iConfigListener = Config::Instance()->subscribe([this](int) { setParams(); });
+	if (m_pSource)
+	{
+		// The source stands in for both the device and its tracker
+		m_pSource->start();
+		m_Startup.signal(SS_Device);
+		m_Startup.signal(SS_Tracker);
+	}
+	else
+	{
+		// Load the tracker model while the device is still being opened. If the device turns out
+		// to have the cached calibration, it takes over this tracker.
+		k4a_calibration_t calibration;
+		if (LoadCachedCalibration(calibration))
+		{
+			m_Startup.begin(SS_Tracker);
+			m_TrackerManager.ensureTracker(calibration);
+		}
+	}
 }
 
 
 KinectAzure::~KinectAzure()
 {
+	Config::Instance()->unsubscribe(m_iConfigListener);
 	ReleaseDefaultSensor();
 }
 
 void KinectAzure::Terminate()
 {
 	m_bTerminating = true;
+	if (m_pSource)
+		m_pSource->stop();
+	m_CondInFlight.notify_all();
 	m_ThreadSkeleton.join();
+	for (auto & thread : m_ThreadsSkeletonPop)
+		thread.join();
 	m_ThreadImu.join();
+	m_CondImuRing.notify_all();
+	m_ThreadImuPublish.join();
 	m_ThreadStaticTf.join();
 	ReleaseDefaultSensor();
+	m_TrackerManager.shutdown();
 	
 }
 
@@ -47,23 +105,110 @@ void KinectAzure::SkeletonProc()
 {
 	while (!m_bTerminating) 
 	{
+		if (m_pSource)
+		{
+			// The device is not used while another source is active
+			std::this_thread::sleep_for(std::chrono::milliseconds(500));
+			continue;
+		}
 		EnsureDefaultSensor();
-		if (m_Kinect && m_KinectBodyTracker)
-			SkeletonUpdate();
+		if (m_Kinect && (m_bReconfigure.exchange(false) || m_Bus.captureProfile.getVersion() != m_nRunningProfile))
+			RestartCameras();
+		// Held for the whole update, so the trackers outlive a concurrent rebuild
+		std::vector<TrackerPtr> vecTrackers = m_TrackerManager.getAll();
+		if (!vecTrackers.empty())
+			m_Startup.signal(SS_Tracker);
+		if (m_Kinect && !vecTrackers.empty())
+		{
+			if (isPipelined())
+				SkeletonEnqueue(vecTrackers);
+			else
+				SkeletonUpdate(vecTrackers[0].get());
+		}
 		else
-			std::this_thread::sleep_for(std::chrono::milliseconds(500));
+			std::this_thread::sleep_for(std::chrono::milliseconds(m_Kinect ? 10 : m_nReconnectIntervalMs.load()));
 	}
 	
 }
 
+void KinectAzure::SkeletonPopProc(size_t iTracker)
+{
+	while (!m_bTerminating)
+	{
+		{
+			// Wait until the skeleton thread has enqueued at least one capture in this tracker
+			std::unique_lock<std::mutex> lk(m_MutexInFlight);
+			m_CondInFlight.wait_for(lk, std::chrono::milliseconds(100),
+				[this, iTracker] { return m_bTerminating || (isPipelined() && m_nInFlight[iTracker] > 0); });
+		}
+		if (!m_bTerminating && isPipelined() && m_nInFlight[iTracker] > 0)
+		{
+			std::vector<TrackerPtr> vecTrackers = m_TrackerManager.getAll();
+			if (iTracker < vecTrackers.size())
+				SkeletonPop(iTracker, vecTrackers[iTracker].get());
+			else
+			{
+				// The captures were queued in a tracker that has been replaced
+				DiscardInFlight(iTracker);
+			}
+		}
+		// Frames held back by a capture that never comes out of its tracker, also those left
+		// over when the tracker count went down to one
+		else if (iTracker == 0)
+			m_nStatsDropped += m_Reorder.poll(LatencyStats::now(), uint64_t(max(0, m_nReorderTimeoutMs.get())) * 1000000);
+	}
+}
+
+void KinectAzure::DiscardInFlight(size_t iTracker)
+{
+	m_nInFlight[iTracker] = 0;
+	m_CondInFlight.notify_all();
+	m_StampsInFlight[iTracker].clear();
+	m_nStatsDropped += m_Reorder.discard(iTracker, LatencyStats::now(), uint64_t(max(0, m_nReorderTimeoutMs.get())) * 1000000);
+}
+
 void KinectAzure::ImuProc()
 {
 	while (!m_bTerminating)
 	{
-		if (m_Kinect)
+		bool bUpdate;
+		{
+			std::lock_guard<std::mutex> lk(m_MutexImu);
+			bUpdate = m_bImuBusy = m_Kinect && !m_bRestarting;
+		}
+		if (bUpdate)
+		{
 			ImuUpdate();
+			{
+				std::lock_guard<std::mutex> lk(m_MutexImu);
+				m_bImuBusy = false;
+			}
+			m_CondImu.notify_all();
+		}
 		else
-			std::this_thread::sleep_for(std::chrono::milliseconds(500));
+			std::this_thread::sleep_for(std::chrono::milliseconds(m_Kinect ? 10 : 500));
+	}
+}
+
+void KinectAzure::ImuPublishProc()
+{
+	while (!m_bTerminating)
+	{
+		{
+			std::unique_lock<std::mutex> lk(m_MutexImuRing);
+			m_CondImuRing.wait_for(lk, std::chrono::milliseconds(100),
+				[this] { return m_bTerminating || !m_RingImu.empty(); });
+		}
+
+		// Publish the samples in at most two contiguous spans
+		const uint64_t captured_ns = m_nImuReadNs;
+		const k4a_imu_sample_t * pImuSamples;
+		size_t nCount;
+		while ((nCount = m_RingImu.peek(pImuSamples)) > 0)
+		{
+			m_Bus.publishImuSamples(pImuSamples, nCount, captured_ns);
+			m_RingImu.consume(nCount);
+		}
 	}
 }
 
@@ -85,12 +230,34 @@ void KinectAzure::StaticTfProc()
 void KinectAzure::setParams()
 {
 
+	// Pipelined capture
+	bool bPipelined = m_bPipelined;
+	int nMaxInFlight = m_nMaxInFlight;
+	int nTrackers = m_nTrackers;
+	int nReconnectIntervalMs = m_nReconnectIntervalMs;
+	Config::Instance()->assign("k4a/pipeline/enabled", bPipelined);
+	Config::Instance()->assign("k4a/pipeline/maxInFlight", nMaxInFlight);
+	Config::Instance()->assign("k4a/trackers/count", nTrackers);
+	Config::Instance()->assign("k4a/reconnectInterval_ms", nReconnectIntervalMs);
+	m_bPipelined = bPipelined;
+	m_nMaxInFlight = max(1, min(int(MAX_IN_FLIGHT), nMaxInFlight));
+	// Built or shut down by the next ensureTracker()
+	m_nTrackers = max(1, min(int(MAX_TRACKERS), nTrackers));
+	m_TrackerManager.setCount(m_nTrackers);
+	m_nReconnectIntervalMs = max(1, nReconnectIntervalMs);
+	m_CondInFlight.notify_all();
+
 	// Configure Kinect device
+	std::lock_guard<std::mutex> lk(m_MutexParams);
+	Config::Instance()->assign("k4a/calibrationCache", m_strCalibrationCache);
 	m_KinectConfig.color_resolution = K4A_COLOR_RESOLUTION_720P;
 
 	int depth_mode_selection = K4A_DEPTH_MODE_NFOV_UNBINNED;
 	Config::Instance()->assign("k4a/depth_mode", depth_mode_selection);
-	m_KinectConfig.camera_fps = K4A_FRAMES_PER_SECOND_30;
+	int camera_fps = 30;
+	Config::Instance()->assign("k4a/camera_fps", camera_fps);
+	m_KinectConfig.camera_fps = camera_fps <= 5 ? K4A_FRAMES_PER_SECOND_5 :
+		camera_fps <= 15 ? K4A_FRAMES_PER_SECOND_15 : K4A_FRAMES_PER_SECOND_30;
 	switch (depth_mode_selection)
 	{
 	case 1:
@@ -109,6 +276,29 @@ void KinectAzure::setParams()
 		m_KinectConfig.depth_mode = K4A_DEPTH_MODE_NFOV_UNBINNED; // 640x576
 
 	}
+	// The wide unbinned mode runs at up to 15 fps
+	if (m_KinectConfig.depth_mode == K4A_DEPTH_MODE_WFOV_UNBINNED && m_KinectConfig.camera_fps == K4A_FRAMES_PER_SECOND_30)
+		m_KinectConfig.camera_fps = K4A_FRAMES_PER_SECOND_15;
+	m_Governor.setParams(m_KinectConfig.depth_mode, m_KinectConfig.camera_fps);
+
+	// Applied to the running device by the skeleton thread
+	if (!isSameCameraConfig(resolveConfig(), m_RunningConfig))
+		m_bReconfigure = true;
+}
+
+k4a_device_configuration_t KinectAzure::resolveConfig(k4a_device_configuration_t * pRequested)
+{
+	k4a_device_configuration_t config = m_KinectConfig;
+	m_Governor.apply(config);
+	if (pRequested)
+		*pRequested = config;
+	m_Bus.captureProfile.apply(config);
+	return config;
+}
+
+bool KinectAzure::isSameCameraConfig(const k4a_device_configuration_t & a, const k4a_device_configuration_t & b)
+{
+	return a.depth_mode == b.depth_mode && a.camera_fps == b.camera_fps && a.color_resolution == b.color_resolution;
 }
 
 /// <summary>
@@ -120,6 +310,8 @@ void KinectAzure::EnsureDefaultSensor()
 	k4a_result_t result;
 	if (!m_Kinect)
 	{
+		m_Startup.begin(SS_Device);
+
 		// Open Kinect device
 		result = k4a_device_open(K4A_DEVICE_DEFAULT, &m_Kinect);
 		if (K4A_FAILED(result))
@@ -129,7 +321,16 @@ void KinectAzure::EnsureDefaultSensor()
 		}
 
 		// Start the camera
-		result = k4a_device_start_cameras(m_Kinect, &m_KinectConfig);
+		k4a_device_configuration_t config;
+		std::wstring strProfile;
+		{
+			std::lock_guard<std::mutex> lk(m_MutexParams);
+			m_nRunningProfile = m_Bus.captureProfile.getVersion();
+			k4a_device_configuration_t requested;
+			config = m_RunningConfig = resolveConfig(&requested);
+			strProfile = m_Bus.captureProfile.describe(requested, config);
+		}
+		result = k4a_device_start_cameras(m_Kinect, &config);
 		if (K4A_FAILED(result))
 		{
 			if (m_funPrintMessage) m_funPrintMessage(SCT_Kinect, L"k4a device was open, but failed to start cameras.");
@@ -148,35 +349,101 @@ void KinectAzure::EnsureDefaultSensor()
 		}
 
 		// Obtain calibration data
-		k4a_device_get_calibration(m_Kinect, m_KinectConfig.depth_mode, m_KinectConfig.color_resolution, &m_KinectCalibration);
-		if (m_funPrintMessage) m_funPrintMessage(SCT_Kinect, L"k4a device is open.");
+		k4a_device_get_calibration(m_Kinect, config.depth_mode, config.color_resolution, &m_KinectCalibration);
+		if (m_funPrintMessage) m_funPrintMessage(SCT_Kinect, (L"k4a device is open: " + strProfile).c_str());
+		m_Startup.signal(SS_Device);
+		SaveCachedCalibration();
+		m_Startup.begin(SS_Tracker);
 	}
 
-	// Create body tracker
-	if (!m_KinectBodyTracker)
+	// Reuses the tracker if the device still has the same calibration, otherwise
+	// creates one in the background
+	m_TrackerManager.ensureTracker(m_KinectCalibration);
+}
+
+// Name of a depth mode for the status list
+static const wchar_t * getDepthModeName(k4a_depth_mode_t depth_mode)
+{
+	switch (depth_mode)
 	{
-		if (m_funPrintMessage) m_funPrintMessage(SCT_BodyTracker, L"Creating body tracker.");
-		result = k4abt_tracker_create(&m_KinectCalibration, &m_KinectBodyTracker);
-		if (K4A_FAILED(result))
-		{
-			if (m_funPrintMessage) m_funPrintMessage(SCT_BodyTracker, L"Failed to create body tracker.");
-			m_KinectBodyTracker = NULL;
-			return;
-		}
-		else
-			if (m_funPrintMessage) m_funPrintMessage(SCT_BodyTracker, L"Successfully created body tracker.");
+	case K4A_DEPTH_MODE_NFOV_2X2BINNED: return L"NFOV 2x2 binned";
+	case K4A_DEPTH_MODE_NFOV_UNBINNED: return L"NFOV unbinned";
+	case K4A_DEPTH_MODE_WFOV_2X2BINNED: return L"WFOV 2x2 binned";
+	case K4A_DEPTH_MODE_WFOV_UNBINNED: return L"WFOV unbinned";
+	case K4A_DEPTH_MODE_PASSIVE_IR: return L"passive IR";
+	default: return L"off";
 	}
 }
 
-void KinectAzure::ReleaseDefaultSensor()
+void KinectAzure::RestartCameras()
 {
+	k4a_device_configuration_t config;
+	std::wstring strProfile;
+	{
+		std::lock_guard<std::mutex> lk(m_MutexParams);
+		m_nRunningProfile = m_Bus.captureProfile.getVersion();
+		k4a_device_configuration_t requested;
+		config = resolveConfig(&requested);
+		if (isSameCameraConfig(config, m_RunningConfig))
+			return;
+		m_RunningConfig = config;
+		strProfile = m_Bus.captureProfile.describe(requested, config);
+	}
 
-	if (m_KinectBodyTracker)
+	// The device stays open and the IMU thread pauses, so only the cameras are down
+	const uint64_t nStartNs = LatencyStats::now();
+	m_nRestartStartNs = 0;
+	PauseImu();
+	k4a_device_stop_imu(m_Kinect);
+	k4a_device_stop_cameras(m_Kinect);
+	k4a_result_t result = k4a_device_start_cameras(m_Kinect, &config);
+	if (K4A_SUCCEEDED(result))
+		result = k4a_device_start_imu(m_Kinect);
+	if (K4A_FAILED(result))
 	{
-		//k4abt_tracker_destroy(m_KinectBodyTracker);
-		m_KinectBodyTracker = NULL;
+		// Opened again with the new configuration by EnsureDefaultSensor()
+		if (m_funPrintMessage) m_funPrintMessage(SCT_Kinect, L"Failed to restart the cameras with the new configuration.");
+		ReleaseDefaultSensor();
+		ResumeImu();
+		return;
 	}
-	
+	ResumeImu();
+
+	// Wait for the first capture, which the skeleton thread would block on anyway
+	k4a_capture_t capture;
+	if (k4a_device_get_capture(m_Kinect, &capture, 5000) == K4A_WAIT_RESULT_SUCCEEDED)
+		k4a_capture_release(capture);
+	m_nRestartCamerasMs = (LatencyStats::now() - nStartNs) / 1000000;
+
+	// A new depth mode changes the calibration and the tracker is rebuilt in the background,
+	// a new frame rate keeps the tracker
+	k4a_device_get_calibration(m_Kinect, config.depth_mode, config.color_resolution, &m_KinectCalibration);
+	m_TrackerManager.ensureTracker(m_KinectCalibration);
+	m_nRestartStartNs = nStartNs;
+
+	const size_t BUFFER_LEN = 128;
+	wchar_t pszText[BUFFER_LEN];
+	StringCchPrintf(pszText, BUFFER_LEN, L"k4a restarted (%s, %llu ms): %s",
+		getDepthModeName(config.depth_mode), m_nRestartCamerasMs, strProfile.c_str());
+	if (m_funPrintMessage) m_funPrintMessage(SCT_Kinect, pszText);
+}
+
+void KinectAzure::PauseImu()
+{
+	// A pending k4a_device_get_imu_sample() returns within its timeout of one second
+	std::unique_lock<std::mutex> lk(m_MutexImu);
+	m_bRestarting = true;
+	m_CondImu.wait(lk, [this] { return !m_bImuBusy; });
+}
+
+void KinectAzure::ResumeImu()
+{
+	m_bRestarting = false;
+}
+
+void KinectAzure::ReleaseDefaultSensor()
+{
+	// The body tracker belongs to m_TrackerManager and survives the device
 	if (m_Kinect)
 	{
 		k4a_device_stop_imu(m_Kinect);
@@ -186,7 +453,7 @@ void KinectAzure::ReleaseDefaultSensor()
 	}
 }
 
-void KinectAzure::SkeletonUpdate()
+void KinectAzure::SkeletonUpdate(k4abt_tracker_t tracker)
 {
 	int32_t timeout_ms = 1000;
 
@@ -196,69 +463,263 @@ void KinectAzure::SkeletonUpdate()
 
 	if (capture_result == K4A_WAIT_RESULT_SUCCEEDED)
 	{
-		k4a_wait_result_t queue_result = k4abt_tracker_enqueue_capture(m_KinectBodyTracker, capture, timeout_ms);
+		LatencyStamps stamps = StampCapture(capture);
+		k4a_wait_result_t queue_result = k4abt_tracker_enqueue_capture(tracker, capture, timeout_ms);
 		k4a_capture_release(capture);
 		
 		if (queue_result == K4A_WAIT_RESULT_SUCCEEDED)
 		{
-			clock_t execution_time = clock();
+			stamps.enqueued_ns = LatencyStats::now();
+			m_StampsInFlight[0].push(stamps);
 
 			k4abt_frame_t body_frame = NULL;
-			k4a_wait_result_t pop_result = k4abt_tracker_pop_result(m_KinectBodyTracker, &body_frame, timeout_ms);
+			k4a_wait_result_t pop_result = k4abt_tracker_pop_result(tracker, &body_frame, timeout_ms);
 			
-			execution_time = clock() - execution_time;
-			static std::array<clock_t, 5> arr_time;
-			static size_t i;
-			arr_time[i++] = execution_time;
-			if (i == arr_time.size())
+			if (pop_result == K4A_WAIT_RESULT_SUCCEEDED)
+				ProcessBodyFrame(0, body_frame, 1);
+		}
+
+
+	}
+	else if (capture_result == K4A_WAIT_RESULT_TIMEOUT)
+	{
+		// Presumably disconnected. The IMU thread may still be reading from the device.
+		PauseImu();
+		ReleaseDefaultSensor();
+		ResumeImu();
+	}
+}
+
+void KinectAzure::SkeletonEnqueue(const std::vector<TrackerPtr> & vecTrackers)
+{
+	int32_t timeout_ms = 1000;
+	const size_t iTracker = m_nNextTracker++ % vecTrackers.size();
+	k4abt_tracker_t tracker = vecTrackers[iTracker].get();
+
+	// Read a sensor capture
+	k4a_capture_t capture;
+	k4a_wait_result_t capture_result = k4a_device_get_capture(m_Kinect, &capture, timeout_ms);
+
+	if (capture_result == K4A_WAIT_RESULT_SUCCEEDED)
+	{
+		LatencyStamps stamps = StampCapture(capture);
+
+		// Wait for a free slot in the tracker queue. If none frees up in time, drop this
+		// capture rather than let the device buffer run stale.
+		bool bSlotAvailable;
+		{
+			std::unique_lock<std::mutex> lk(m_MutexInFlight);
+			bSlotAvailable = m_CondInFlight.wait_for(lk, std::chrono::milliseconds(timeout_ms),
+				[this, iTracker] { return m_bTerminating || m_nInFlight[iTracker] < m_nMaxInFlight; }) && !m_bTerminating;
+		}
+
+		if (bSlotAvailable)
+		{
+			// Expected before the body frame can come out of the tracker
+			const bool bReorder = m_nTrackers > 1;
+			if (bReorder)
+				m_Reorder.expect(iTracker, stamps.device_usec);
+			k4a_wait_result_t queue_result = k4abt_tracker_enqueue_capture(tracker, capture, timeout_ms);
+			if (queue_result == K4A_WAIT_RESULT_SUCCEEDED)
 			{
-				std::wstring wstr; 
-				std::for_each(arr_time.cbegin(), arr_time.cend(), 
-					[&wstr](clock_t t) {wstr += (wstr.empty() ? L"": L", ") + std::to_wstring(t); });
-				wstr = L"Execution time for pop: " + wstr + L" ms";
-				if (m_funPrintMessage) m_funPrintMessage(SCT_BodyTracker, wstr.c_str());
-				i = 0;
+				stamps.enqueued_ns = LatencyStats::now();
+				m_StampsInFlight[iTracker].push(stamps);
+				m_nInFlight[iTracker]++;
+				m_CondInFlight.notify_all();
 			}
-			
-			if (pop_result == K4A_WAIT_RESULT_SUCCEEDED)
+			else
 			{
-				uint64_t timestamp_usec = k4abt_frame_get_timestamp_usec(body_frame);
-				size_t num_bodies = min(MAX_NUM_BODIES, k4abt_frame_get_num_bodies(body_frame));
-				uint32_t body_ids[MAX_NUM_BODIES] = {};
-				k4abt_skeleton_t skeletons[MAX_NUM_BODIES] = {};
-
-				k4a_result_t skeleton_result = K4A_RESULT_SUCCEEDED;
-				for (size_t i = 0; i < num_bodies; i++)
-				{
-					body_ids[i] = k4abt_frame_get_body_id(body_frame, i);
-					k4a_result_t result = k4abt_frame_get_body_skeleton(body_frame, i, &skeletons[i]);
-					if (K4A_FAILED(result)) {
-						skeleton_result = K4A_RESULT_FAILED;
-						break;
-					}
-				}
-				if (K4A_SUCCEEDED(skeleton_result) && m_funProcessBody)
-					for (size_t i = 0; i < num_bodies; i++)
-					{
-						for (auto & joint : skeletons[i].joints) {
-							for (auto & coordinate : joint.position.v)
-								coordinate /= 1000.0;
-						}
-					}
-					m_funProcessBody(timestamp_usec, num_bodies, skeletons, body_ids);
-
-				k4abt_frame_release(body_frame);
+				if (bReorder)
+					m_Reorder.cancel(iTracker, stamps.device_usec);
+				m_nStatsDropped++;
 			}
 		}
+		else
+			m_nStatsDropped++;
+		k4a_capture_release(capture);
+	}
+	else if (capture_result == K4A_WAIT_RESULT_TIMEOUT)
+	{
+		// Presumably disconnected. The IMU thread may still be reading from the device.
+		PauseImu();
+		ReleaseDefaultSensor();
+		ResumeImu();
+	}
+}
+
+void KinectAzure::SkeletonPop(size_t iTracker, k4abt_tracker_t tracker)
+{
+	int32_t timeout_ms = 100;
 
+	k4abt_frame_t body_frame = NULL;
+	k4a_wait_result_t pop_result = k4abt_tracker_pop_result(tracker, &body_frame, timeout_ms);
 
+	if (pop_result == K4A_WAIT_RESULT_SUCCEEDED)
+	{
+		int nOccupancy = m_nInFlight[iTracker]--;
+		m_CondInFlight.notify_all();
+		ProcessBodyFrame(iTracker, body_frame, nOccupancy);
 	}
-	else if (capture_result == K4A_WAIT_RESULT_TIMEOUT)
+	else if (pop_result == K4A_WAIT_RESULT_FAILED)
 	{
-		// Presumably disconnected
-		k4a_device_stop_cameras(m_Kinect);
-		k4a_device_close(m_Kinect);
-		m_Kinect = NULL;
+		// The tracker will never return the outstanding results
+		DiscardInFlight(iTracker);
+	}
+}
+
+void KinectAzure::ProcessBodyFrame(size_t iTracker, k4abt_frame_t body_frame, int nOccupancy)
+{
+	uint64_t popped_ns = LatencyStats::now();
+	const uint64_t timestamp_usec = k4abt_frame_get_timestamp_usec(body_frame);
+
+	// The skeletons are extracted straight into a pooled frame that is shared by all subscribers
+	BodyFrameRef frame = m_Bus.bodyFramePool.acquire();
+	if (!frame)
+		m_nStatsDropped++;
+	else if (ExtractBodyFrame(body_frame, *frame))
+	{
+		// The body frame carries the timestamp of the depth image it was computed from
+		if (m_StampsInFlight[iTracker].match(frame->timestamp_usec, frame->stamps))
+		{
+			frame->stamps.popped_ns = popped_ns;
+			// Restarted by the skeleton thread at the new level
+			if (m_Governor.update(popped_ns, (popped_ns - frame->stamps.captured_ns) / 1000, nOccupancy,
+				isPipelined() ? m_nMaxInFlight.load() : 1))
+			{
+				m_bReconfigure = true;
+				if (m_funPrintMessage) m_funPrintMessage(SCT_Pipeline, m_Governor.describe().c_str());
+			}
+		}
+
+		// Tracking has resumed after a live reconfiguration
+		const uint64_t nRestartStartNs = m_nRestartStartNs.exchange(0);
+		if (nRestartStartNs != 0)
+		{
+			const size_t BUFFER_LEN = 128;
+			wchar_t pszText[BUFFER_LEN];
+			StringCchPrintf(pszText, BUFFER_LEN, L"Reconfiguration downtime: cameras %llu ms, body frames %llu ms.",
+				m_nRestartCamerasMs, (popped_ns - nRestartStartNs) / 1000000);
+			if (m_funPrintMessage) m_funPrintMessage(SCT_Pipeline, pszText);
+		}
+	}
+	else
+		frame.reset();
+
+	k4abt_frame_release(body_frame);
+	// Published by EmitBodyFrame() once the frames of earlier captures are out. A single
+	// tracker returns them in order.
+	if (m_nTrackers > 1)
+		m_nStatsDropped += m_Reorder.popped(iTracker, timestamp_usec, frame, popped_ns,
+			uint64_t(max(0, m_nReorderTimeoutMs.get())) * 1000000);
+	else if (frame)
+		EmitBodyFrame(iTracker, frame);
+	UpdatePipelineStats(nOccupancy);
+}
+
+void KinectAzure::EmitBodyFrame(size_t iTracker, const BodyFrameRef & frame)
+{
+	if (m_nTrackers > 1)
+		m_BodyIds.remap(iTracker, *frame, m_fMatchDistance, uint64_t(max(0, m_nIdTimeoutMs.get())) * 1000);
+	m_Bus.publishBodyFrame(frame);
+}
+
+LatencyStamps KinectAzure::StampCapture(k4a_capture_t capture)
+{
+	LatencyStamps stamps = {};
+	stamps.captured_ns = LatencyStats::now();
+	k4a_image_t depth = k4a_capture_get_depth_image(capture);
+	if (depth)
+	{
+		stamps.device_usec = k4a_image_get_timestamp_usec(depth);
+		k4a_image_release(depth);
+	}
+	return stamps;
+}
+
+bool KinectAzure::LoadCachedCalibration(k4a_calibration_t & calibration)
+{
+	std::lock_guard<std::mutex> lk(m_MutexParams);
+	if (m_strCalibrationCache.empty())
+		return false;
+	std::ifstream file(m_strCalibrationCache, std::ios::binary);
+	std::vector<char> raw((std::istreambuf_iterator<char>(file)), std::istreambuf_iterator<char>());
+	if (raw.empty())
+		return false;
+	raw.push_back('\0');
+	const k4a_device_configuration_t config = resolveConfig();
+	return K4A_SUCCEEDED(k4a_calibration_get_from_raw(raw.data(), raw.size(),
+		config.depth_mode, config.color_resolution, &calibration));
+}
+
+void KinectAzure::SaveCachedCalibration()
+{
+	std::lock_guard<std::mutex> lk(m_MutexParams);
+	if (m_strCalibrationCache.empty())
+		return;
+	size_t nSize = 0;
+	if (k4a_device_get_raw_calibration(m_Kinect, NULL, &nSize) != K4A_BUFFER_RESULT_TOO_SMALL)
+		return;
+	std::vector<uint8_t> raw(nSize);
+	if (k4a_device_get_raw_calibration(m_Kinect, raw.data(), &nSize) != K4A_BUFFER_RESULT_SUCCEEDED)
+		return;
+	// The raw calibration is null-terminated json
+	std::ofstream file(m_strCalibrationCache, std::ios::binary | std::ios::trunc);
+	file.write(reinterpret_cast<const char *>(raw.data()), nSize > 0 && raw[nSize - 1] == 0 ? nSize - 1 : nSize);
+}
+
+bool KinectAzure::ExtractBodyFrame(k4abt_frame_t body_frame, BodyFrame & frame)
+{
+	frame.timestamp_usec = k4abt_frame_get_timestamp_usec(body_frame);
+	frame.num_bodies = min(MAX_NUM_BODIES, k4abt_frame_get_num_bodies(body_frame));
+
+	for (size_t i = 0; i < frame.num_bodies; i++)
+	{
+		frame.body_ids[i] = k4abt_frame_get_body_id(body_frame, i);
+		k4abt_skeleton_t skeleton;
+		k4a_result_t result = k4abt_frame_get_body_skeleton(body_frame, i, &skeleton);
+		if (K4A_FAILED(result))
+			return false;
+		frame.setSkeleton(i, skeleton);
+	}
+
+	scaleJointPositions(frame.joints, frame.num_bodies, 0.001f);
+	checkOrientationNorms(frame.joints, frame.num_bodies, MIN_ORIENTATION_NORM2, frame.valid_joints);
+	return true;
+}
+
+void KinectAzure::UpdatePipelineStats(int nOccupancy)
+{
+	// Called by the pop thread of each tracker
+	std::lock_guard<std::mutex> lk(m_MutexStats);
+	m_nStatsFrames++;
+	m_nStatsOccupancySum += nOccupancy;
+	m_nStatsOccupancyMax = max(m_nStatsOccupancyMax, nOccupancy);
+
+	INT64 now = GetTickCount64();
+	if (now - m_nStatsStartTime >= 1000)
+	{
+		const size_t BUFFER_LEN = 128;
+		wchar_t pszText[BUFFER_LEN];
+		// The occupancy is that of the tracker a frame came from
+		const size_t MODE_LEN = 32;
+		wchar_t pszMode[MODE_LEN];
+		if (m_nTrackers > 1)
+			StringCchPrintf(pszMode, MODE_LEN, L"Round-robin over %d trackers", m_nTrackers.load());
+		else
+			StringCchPrintf(pszMode, MODE_LEN, L"%s", m_bPipelined ? L"Pipelined" : L"Serial");
+		StringCchPrintf(pszText, BUFFER_LEN, L"%s: %.1f fps, queue occupancy avg %.2f max %d (limit %d), dropped %llu",
+			pszMode,
+			m_nStatsFrames * 1000.0 / (now - m_nStatsStartTime),
+			double(m_nStatsOccupancySum) / m_nStatsFrames,
+			m_nStatsOccupancyMax,
+			isPipelined() ? m_nMaxInFlight.load() : 1,
+			m_nStatsDropped.exchange(0));
+		if (m_funPrintMessage) m_funPrintMessage(SCT_Pipeline, pszText);
+
+		m_nStatsStartTime = now;
+		m_nStatsFrames = 0;
+		m_nStatsOccupancySum = 0;
+		m_nStatsOccupancyMax = 0;
 	}
 }
 
@@ -266,17 +727,34 @@ void KinectAzure::ImuUpdate()
 {
 	
 	int32_t timeout_ms = 1000;
-	k4a_imu_sample_t imu_data;
-	k4a_wait_result_t imu_result = k4a_device_get_imu_sample(m_Kinect, &imu_data, timeout_ms);
-	if (imu_result == K4A_WAIT_RESULT_SUCCEEDED)
+
+	// Block for the first sample, then drain whatever else the device has queued without waiting
+	k4a_imu_sample_t * pImuSample = m_RingImu.reserve();
+	k4a_wait_result_t imu_result = pImuSample ? 
+		k4a_device_get_imu_sample(m_Kinect, pImuSample, timeout_ms) : K4A_WAIT_RESULT_FAILED;
+	while (imu_result == K4A_WAIT_RESULT_SUCCEEDED)
+	{
+		m_RingImu.commit();
+		pImuSample = m_RingImu.reserve();
+		if (!pImuSample)
+			break;
+		imu_result = k4a_device_get_imu_sample(m_Kinect, pImuSample, 0);
+	}
+
+	// Published by ImuPublishProc(). If the ring is full, the rest stays queued in the device.
+	if (!m_RingImu.empty())
 	{
-		m_funProcessIMU(imu_data);
+		m_nImuReadNs = LatencyStats::now();
+		std::lock_guard<std::mutex> lk(m_MutexImuRing);
+		m_CondImuRing.notify_one();
 	}
 }
 
 const k4a_calibration_t * KinectAzure::GetKinectCalibrationPointer()
 {
-	if (m_KinectCalibration.depth_mode != 0)
+	if (m_pSource)
+		return m_pSource->getCalibration();
+	else if (m_KinectCalibration.depth_mode != 0)
 		return &m_KinectCalibration;
 	else
 		return nullptr;
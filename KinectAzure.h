@@ -1,8 +1,18 @@
 #pragma once
 #include "stdafx.h"
 #include "RosSocket.h"
-
-const size_t MAX_NUM_BODIES = 6;
+#include "FrameBus.h"
+#include "SensorSource.h"
+#include "SpscRing.h"
+#include "TrackerManager.h"
+#include "DepthGovernor.h"
+#include "BodyFrameReorder.h"
+#include "BodyIdMap.h"
+#include "StartupOrchestrator.h"
+#include <array>
+#include <atomic>
+#include <memory>
+#include <condition_variable>
 
 class KinectAzure
 {
@@ -10,37 +20,144 @@ private:
 	k4a_device_t			m_Kinect;
 	k4a_device_configuration_t	m_KinectConfig;
 	k4a_calibration_t		m_KinectCalibration;
-	k4abt_tracker_t			m_KinectBodyTracker;
 	k4abt_skeleton_t*		m_pSkeletonClosest;
 	bool                    m_bTerminating;
+	FrameBus &              m_Bus;
+	StartupOrchestrator &   m_Startup;
+
+	// Pipelined capture: the skeleton thread keeps up to m_nMaxInFlight captures
+	// queued in each tracker while m_ThreadsSkeletonPop pop the results, one per tracker.
+	// With more than one tracker the captures are distributed round-robin and the capture
+	// is always pipelined.
+	std::atomic<bool>       m_bPipelined;
+	std::atomic<int>        m_nMaxInFlight;
+	std::atomic<int>        m_nTrackers;
+	std::array<std::atomic<int>, MAX_TRACKERS> m_nInFlight;
+	size_t                  m_nNextTracker;
+	std::mutex              m_MutexInFlight;
+	std::condition_variable m_CondInFlight;
+	// Stamps of the captures queued in each tracker, matched with the body frames by timestamp
+	std::array<LatencyStampQueue, MAX_TRACKERS> m_StampsInFlight;
+
+	// Body frames of the trackers are published in capture order, with consistent body IDs
+	BodyFrameReorder        m_Reorder;
+	BodyIdMap               m_BodyIds;
+	ConfigParam<int>        m_nReorderTimeoutMs{ "k4a/trackers/reorderTimeout_ms", 500 };
+	ConfigParam<float>      m_fMatchDistance{ "k4a/trackers/matchDistance_m", 0.3f };
+	ConfigParam<int>        m_nIdTimeoutMs{ "k4a/trackers/idTimeout_ms", 1000 };
+
+	// Body frame rate and tracker queue occupancy statistics
+	INT64                   m_nStatsStartTime;
+	uint64_t                m_nStatsFrames;
+	uint64_t                m_nStatsOccupancySum;
+	int                     m_nStatsOccupancyMax;
+	std::atomic<uint64_t>   m_nStatsDropped;
+	std::mutex              m_MutexStats;
+
+	// IMU samples drained from the device by the IMU thread. The IMU publish thread takes
+	// them out in contiguous batches and publishes them on the bus, so that a subscriber that
+	// blocks does not keep the IMU thread from reading the device.
+	SpscRing<k4a_imu_sample_t, 1024> m_RingImu;
+	std::atomic<uint64_t>   m_nImuReadNs;       // when the IMU thread last drained the device
+	std::mutex              m_MutexImuRing;
+	std::condition_variable m_CondImuRing;
+
+	// Body tracker of the live device, kept across reconnects
+	TrackerManager          m_TrackerManager;
+	// Delay between attempts to open the device
+	std::atomic<int>        m_nReconnectIntervalMs;
+	// Raw calibration of the last device, so that the tracker can be created before it is open
+	std::string             m_strCalibrationCache;
+
+	// Guards m_KinectConfig, m_RunningConfig and m_strCalibrationCache, which setParams()
+	// changes when the parameter file is loaded again
+	std::mutex              m_MutexParams;
+	int                     m_iConfigListener;
+
+	// Live reconfiguration: the configuration the cameras were started with. setParams() sets
+	// m_bReconfigure if the depth mode or frame rate differ, and the skeleton thread restarts
+	// the cameras. The downtime is reported with the first body frame after the restart.
+	k4a_device_configuration_t	m_RunningConfig;
+	uint64_t                m_nRunningProfile;  // version of the capture profile applied to it
+	std::atomic<bool>       m_bReconfigure;
+	// Set while the cameras are restarted. The IMU thread stays out of ImuUpdate() meanwhile;
+	// m_bImuBusy is set while it is inside.
+	std::atomic<bool>       m_bRestarting;
+	bool                    m_bImuBusy;
+	std::mutex              m_MutexImu;
+	std::condition_variable m_CondImu;
+	std::atomic<uint64_t>   m_nRestartStartNs;  // 0 unless a body frame is awaited
+	uint64_t                m_nRestartCamerasMs;
+	// Steps the depth mode and frame rate down while the tracker falls behind, see "k4a/governor"
+	DepthGovernor           m_Governor;
+
+	// Alternative to the live device, selected by "source/type"; nullptr for the device.
+	std::unique_ptr<SensorSource> m_pSource;
+
 	std::thread             m_ThreadSkeleton;
+	std::array<std::thread, MAX_TRACKERS> m_ThreadsSkeletonPop;
 	std::thread             m_ThreadImu;
+	std::thread             m_ThreadImuPublish;
 	std::thread             m_ThreadStaticTf;
 
 	// Status update
 	std::wstring            m_WstrStatusMessage;
 	std::function<void(static_control_type, const wchar_t *)>   m_funPrintMessage;
-	std::function<void(uint64_t nTime, int nBodyCount, const k4abt_skeleton_t *pSkeleton, const uint32_t * pID)>   m_funProcessBody;
-	std::function<void(const k4a_imu_sample_t & ImuSample)> m_funProcessIMU;
 	std::function<void()> m_funBroadcastStaticTf;
 public:
 	KinectAzure(
 		std::function<void(static_control_type, const wchar_t*)> funPrintMessage,
-		std::function<void(uint64_t nTime, int nBodyCount, const k4abt_skeleton_t *pSkeleton, const uint32_t * pID)> funProcessBody,
-		std::function<void(const k4a_imu_sample_t & ImuSample)> funProcessIMU,
+		FrameBus & bus,
+		StartupOrchestrator & startup,
 		std::function<void()> m_funBroadcastStaticTf
 	);
 	
 	~KinectAzure();
 	void Terminate();
 	void SkeletonProc();
+	void SkeletonPopProc(size_t iTracker);
 	void ImuProc();
+	void ImuPublishProc();
 	void StaticTfProc();
 	void setParams();
 	void EnsureDefaultSensor();
 	void ReleaseDefaultSensor();
-	void SkeletonUpdate();
+	// Restarts the cameras of the open device with m_KinectConfig, on the skeleton thread
+	void RestartCameras();
+	// Keeps the IMU thread out of the device, waiting until it has left ImuUpdate()
+	void PauseImu();
+	void ResumeImu();
+	void SkeletonUpdate(k4abt_tracker_t tracker);
+	void SkeletonEnqueue(const std::vector<TrackerPtr> & vecTrackers);
+	void SkeletonPop(size_t iTracker, k4abt_tracker_t tracker);
+	void ProcessBodyFrame(size_t iTracker, k4abt_frame_t body_frame, int nOccupancy);
+	// Called by m_Reorder in capture order
+	void EmitBodyFrame(size_t iTracker, const BodyFrameRef & frame);
+	void UpdatePipelineStats(int nOccupancy);
 	void ImuUpdate();
 	const k4a_calibration_t * GetKinectCalibrationPointer();
+
+	// Copies the skeletons of up to MAX_NUM_BODIES bodies out of a body frame, converting
+	// joint positions to meters and checking the joint orientations.
+	// Returns false if any skeleton could not be read.
+	static bool ExtractBodyFrame(k4abt_frame_t body_frame, BodyFrame & frame);
+
+private:
+	bool isPipelined() const { return m_bPipelined || m_nTrackers > 1; }
+	// Gives up the captures outstanding in iTracker, e.g. after it was replaced
+	void DiscardInFlight(size_t iTracker);
+
+	// Stamps a capture as returned by the device, with the timestamp of its depth image
+	static LatencyStamps StampCapture(k4a_capture_t capture);
+
+	// m_KinectConfig at the level of the governor and without the streams that no sink
+	// consumes. pRequested receives the config before the streams were turned off.
+	// Expects m_MutexParams to be held.
+	k4a_device_configuration_t resolveConfig(k4a_device_configuration_t * pRequested = nullptr);
+	static bool isSameCameraConfig(const k4a_device_configuration_t & a, const k4a_device_configuration_t & b);
+
+	// Calibration cache in m_strCalibrationCache; both fail silently
+	bool LoadCachedCalibration(k4a_calibration_t & calibration);
+	void SaveCachedCalibration();
 };
 
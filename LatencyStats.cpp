@@ -0,0 +1,246 @@
+#include "LatencyStats.h"
+#include "CsvLogger.h"
+#include <chrono>
+#include <cmath>
+#include <limits>
+
+static const size_t SUB_BUCKET_COUNT = 1 << LatencyHistogram::SUB_BUCKET_BITS;
+static const size_t SUB_BUCKET_HALF = SUB_BUCKET_COUNT / 2;
+
+LatencyHistogram::LatencyHistogram() : m_nMax(0)
+{
+	for (auto & count : m_Counts)
+		count = 0;
+}
+
+size_t LatencyHistogram::bucketIndex(uint64_t nUsec)
+{
+	if (nUsec < SUB_BUCKET_COUNT)
+		return static_cast<size_t>(nUsec);
+
+	const uint64_t nLimit = (uint64_t(1) << (MAX_MAGNITUDE + 1)) - 1;
+	nUsec = min(nUsec, nLimit);
+
+	// The position of the highest set bit selects the power of two, the next
+	// SUB_BUCKET_BITS - 1 bits the linear sub-bucket within it
+	int nMagnitude = SUB_BUCKET_BITS;
+	while ((nUsec >> (nMagnitude + 1)) != 0)
+		nMagnitude++;
+	const int nShift = nMagnitude - (SUB_BUCKET_BITS - 1);
+	const size_t iSubBucket = static_cast<size_t>(nUsec >> nShift) - SUB_BUCKET_HALF;
+	return SUB_BUCKET_COUNT + (nMagnitude - SUB_BUCKET_BITS) * SUB_BUCKET_HALF + iSubBucket;
+}
+
+uint64_t LatencyHistogram::bucketUpperBound(size_t iBucket)
+{
+	if (iBucket < SUB_BUCKET_COUNT)
+		return iBucket;
+
+	const size_t i = iBucket - SUB_BUCKET_COUNT;
+	const int nShift = static_cast<int>(i / SUB_BUCKET_HALF) + 1;
+	const uint64_t nSubBucket = i % SUB_BUCKET_HALF + SUB_BUCKET_HALF;
+	return ((nSubBucket + 1) << nShift) - 1;
+}
+
+void LatencyHistogram::record(uint64_t nUsec)
+{
+	m_Counts[bucketIndex(nUsec)].fetch_add(1, std::memory_order_relaxed);
+
+	uint64_t nMax = m_nMax.load(std::memory_order_relaxed);
+	while (nUsec > nMax && !m_nMax.compare_exchange_weak(nMax, nUsec, std::memory_order_relaxed))
+		;
+}
+
+LatencyHistogram::Summary LatencyHistogram::summarize(bool bReset)
+{
+	// Take a copy first so that the percentiles are computed over one consistent set of counts
+	std::array<uint64_t, NUM_BUCKETS> counts;
+	Summary summary = {};
+	for (size_t i = 0; i < NUM_BUCKETS; i++)
+	{
+		counts[i] = bReset ? m_Counts[i].exchange(0, std::memory_order_relaxed) : m_Counts[i].load(std::memory_order_relaxed);
+		summary.count += counts[i];
+	}
+	summary.max = bReset ? m_nMax.exchange(0, std::memory_order_relaxed) : m_nMax.load(std::memory_order_relaxed);
+	if (summary.count == 0)
+		return summary;
+
+	const double quantiles[] = { 0.5, 0.99, 0.999 };
+	uint64_t * results[] = { &summary.p50, &summary.p99, &summary.p999 };
+	uint64_t nCumulative = 0;
+	size_t iQuantile = 0;
+	for (size_t i = 0; i < NUM_BUCKETS && iQuantile < 3; i++)
+	{
+		nCumulative += counts[i];
+		while (iQuantile < 3 && nCumulative >= static_cast<uint64_t>(std::ceil(quantiles[iQuantile] * summary.count)))
+		{
+			// The maximum is exact, the bucket bound is not
+			*results[iQuantile] = min(bucketUpperBound(i), summary.max);
+			iQuantile++;
+		}
+	}
+	return summary;
+}
+
+void LatencyStampQueue::push(const LatencyStamps & stamps)
+{
+	std::lock_guard<std::mutex> lk(m_Mutex);
+	if (m_nCount == CAPACITY)
+	{
+		m_nHead = (m_nHead + 1) % CAPACITY;
+		m_nCount--;
+	}
+	m_Stamps[(m_nHead + m_nCount) % CAPACITY] = stamps;
+	m_nCount++;
+}
+
+bool LatencyStampQueue::match(uint64_t device_usec, LatencyStamps & stamps)
+{
+	std::lock_guard<std::mutex> lk(m_Mutex);
+	// Captures come out of the tracker in order, so anything before the match was dropped
+	for (size_t n = 0; n < m_nCount; n++)
+	{
+		const LatencyStamps & entry = m_Stamps[(m_nHead + n) % CAPACITY];
+		if (entry.device_usec == device_usec)
+		{
+			stamps = entry;
+			m_nHead = (m_nHead + n + 1) % CAPACITY;
+			m_nCount -= n + 1;
+			return true;
+		}
+	}
+	return false;
+}
+
+void LatencyStampQueue::clear()
+{
+	std::lock_guard<std::mutex> lk(m_Mutex);
+	m_nHead = 0;
+	m_nCount = 0;
+}
+
+LatencyStats::LatencyStats() :
+	m_nMinBodyOffsetUsec(std::numeric_limits<int64_t>::max()),
+	m_nMinImuOffsetUsec(std::numeric_limits<int64_t>::max())
+{
+}
+
+LatencyStats * LatencyStats::Instance()
+{
+	static LatencyStats instance;
+	return &instance;
+}
+
+uint64_t LatencyStats::now()
+{
+	return static_cast<uint64_t>(std::chrono::duration_cast<std::chrono::nanoseconds>(
+		std::chrono::steady_clock::now().time_since_epoch()).count());
+}
+
+void LatencyStats::recordBodyDispatch(LatencyStamps & stamps)
+{
+	stamps.dispatched_ns = now();
+	recordCapture(LS_BodyCapture, m_nMinBodyOffsetUsec, stamps.device_usec, stamps.captured_ns);
+	recordInterval(LS_BodyEnqueue, stamps.captured_ns, stamps.enqueued_ns);
+	recordInterval(LS_BodyTracker, stamps.enqueued_ns, stamps.popped_ns);
+	recordInterval(LS_BodyDispatch, stamps.popped_ns ? stamps.popped_ns : stamps.captured_ns, stamps.dispatched_ns);
+}
+
+void LatencyStats::recordImuDispatch(LatencyStamps & stamps)
+{
+	stamps.dispatched_ns = now();
+	recordCapture(LS_ImuCapture, m_nMinImuOffsetUsec, stamps.device_usec, stamps.captured_ns);
+	recordInterval(LS_ImuDispatch, stamps.captured_ns, stamps.dispatched_ns);
+}
+
+void LatencyStats::recordSink(latency_stage stage, const LatencyStamps & stamps)
+{
+	recordInterval(stage, stamps.dispatched_ns, now());
+}
+
+void LatencyStats::recordCapture(latency_stage stage, std::atomic<int64_t> & nMinOffsetUsec, uint64_t device_usec, uint64_t captured_ns)
+{
+	if (device_usec == 0 || captured_ns == 0)
+		return;
+
+	// The device clock has an unknown offset to the host clock. The smallest offset seen so
+	// far stands in for a capture without delay, so this stage shows the jitter on top of it.
+	const int64_t nOffset = static_cast<int64_t>(captured_ns / 1000) - static_cast<int64_t>(device_usec);
+	int64_t nMinOffset = nMinOffsetUsec.load(std::memory_order_relaxed);
+	while (nOffset < nMinOffset && !nMinOffsetUsec.compare_exchange_weak(nMinOffset, nOffset, std::memory_order_relaxed))
+		;
+	m_Histograms[stage].record(static_cast<uint64_t>(nOffset - min(nOffset, nMinOffset)));
+}
+
+void LatencyStats::recordInterval(latency_stage stage, uint64_t t0_ns, uint64_t t1_ns)
+{
+	if (t0_ns == 0 || t1_ns < t0_ns)
+		return;
+	m_Histograms[stage].record((t1_ns - t0_ns) / 1000);
+}
+
+void LatencyStats::report(std::function<void(static_control_type, const wchar_t *)> funPrintMessage)
+{
+	static uint64_t windows_ts_msec;
+	static const char * stage;
+	static uint64_t count, p50_us, p99_us, p999_us, max_us;
+	static CsvLogger logger("latency", vector_header_value_t{
+		{"windows_ts_msec", &windows_ts_msec},
+		{"stage", &stage},
+		{"count", &count},
+		{"p50_us", &p50_us},
+		{"p99_us", &p99_us},
+		{"p999_us", &p999_us},
+		{"max_us", &max_us}
+		});
+
+	std::array<LatencyHistogram::Summary, LS_Count> summaries;
+	windows_ts_msec = GetTickCount64();
+	for (int i = 0; i < LS_Count; i++)
+	{
+		summaries[i] = m_Histograms[i].summarize(true);
+		if (summaries[i].count == 0)
+			continue;
+		stage = getStageString(static_cast<latency_stage>(i));
+		count = summaries[i].count;
+		p50_us = summaries[i].p50;
+		p99_us = summaries[i].p99;
+		p999_us = summaries[i].p999;
+		max_us = summaries[i].max;
+		logger.log();
+	}
+
+	if (funPrintMessage && summaries[LS_BodyDispatch].count > 0)
+	{
+		// Capture to the tracker result, then the sinks
+		auto ms = [&summaries](latency_stage s, bool bP99) { return (bP99 ? summaries[s].p99 : summaries[s].p50) / 1.0e3; };
+		const size_t BUFFER_LEN = 128;
+		wchar_t pszText[BUFFER_LEN];
+		StringCchPrintf(pszText, BUFFER_LEN, L"Latency p50/p99 ms: cap %.1f/%.1f trk %.1f/%.1f csv %.1f/%.1f ros %.1f/%.1f draw %.1f/%.1f",
+			ms(LS_BodyCapture, false), ms(LS_BodyCapture, true),
+			ms(LS_BodyTracker, false), ms(LS_BodyTracker, true),
+			ms(LS_BodyCsv, false), ms(LS_BodyCsv, true),
+			ms(LS_BodyRos, false), ms(LS_BodyRos, true),
+			ms(LS_BodyRender, false), ms(LS_BodyRender, true));
+		funPrintMessage(SCT_Latency, pszText);
+	}
+}
+
+const char * LatencyStats::getStageString(latency_stage stage)
+{
+	switch (stage)
+	{
+	case LS_BodyCapture: return "body_capture";
+	case LS_BodyEnqueue: return "body_enqueue";
+	case LS_BodyTracker: return "body_tracker";
+	case LS_BodyDispatch: return "body_dispatch";
+	case LS_BodyCsv: return "body_csv";
+	case LS_BodyRos: return "body_ros";
+	case LS_BodyRender: return "body_render";
+	case LS_ImuCapture: return "imu_capture";
+	case LS_ImuDispatch: return "imu_dispatch";
+	case LS_ImuCsv: return "imu_csv";
+	case LS_ImuRos: return "imu_ros";
+	default: return "unknown";
+	}
+}
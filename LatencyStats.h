@@ -0,0 +1,125 @@
+#pragma once
+#include "stdafx.h"
+#include <array>
+#include <atomic>
+#include <mutex>
+
+// Stages of the pipeline whose latency is measured. Each stage is the interval between
+// two of the timestamps in LatencyStamps, or between the dispatch and the completion of a sink.
+enum latency_stage
+{
+	LS_BodyCapture = 0, // device timestamp -> capture returned (relative to the smallest offset seen)
+	LS_BodyEnqueue,     // capture returned -> enqueued in the tracker
+	LS_BodyTracker,     // enqueued -> popped from the tracker
+	LS_BodyDispatch,    // popped -> published on the frame bus
+	LS_BodyCsv,         // published -> csv logger done
+	LS_BodyRos,         // published -> ROS publisher done
+	LS_BodyRender,      // published -> display done
+	LS_ImuCapture,      // device timestamp of the oldest sample -> batch drained from the device
+	LS_ImuDispatch,     // drained -> published on the frame bus
+	LS_ImuCsv,          // published -> csv logger done
+	LS_ImuRos,          // published -> ROS publisher done
+	LS_Count
+};
+
+// High-resolution timestamps of a body frame or IMU batch as it passes the pipeline, in
+// nanoseconds of LatencyStats::now(). Zero means the stage does not apply to the source.
+struct LatencyStamps
+{
+	uint64_t                device_usec;
+	uint64_t                captured_ns;
+	uint64_t                enqueued_ns;
+	uint64_t                popped_ns;
+	uint64_t                dispatched_ns;
+};
+
+// HDR-style histogram of latencies in microseconds: exact below 64 us, then 32 buckets per
+// power of two (about 3% resolution) up to 2^40 us. Recording is lock-free and wait-free
+// apart from the maximum.
+class LatencyHistogram
+{
+public:
+	static const int        SUB_BUCKET_BITS = 6;
+	static const int        MAX_MAGNITUDE = 40;
+	static const size_t     NUM_BUCKETS = (1 << SUB_BUCKET_BITS) + (MAX_MAGNITUDE - SUB_BUCKET_BITS + 1) * (1 << (SUB_BUCKET_BITS - 1));
+
+	struct Summary
+	{
+		uint64_t            count;
+		uint64_t            p50;
+		uint64_t            p99;
+		uint64_t            p999;
+		uint64_t            max;
+	};
+
+private:
+	std::array<std::atomic<uint64_t>, NUM_BUCKETS> m_Counts;
+	std::atomic<uint64_t>   m_nMax;
+
+public:
+	LatencyHistogram();
+
+	void record(uint64_t nUsec);
+	// Percentiles of the values recorded since the last reset. With bReset the counts are
+	// moved out atomically, so that no value is lost or counted twice.
+	Summary summarize(bool bReset);
+
+	static size_t bucketIndex(uint64_t nUsec);
+	// The largest value that falls into the bucket
+	static uint64_t bucketUpperBound(size_t iBucket);
+};
+
+// Matches the stamps taken when a capture is enqueued with the body frame popped for it,
+// using the device timestamp. Older entries without a body frame are discarded.
+class LatencyStampQueue
+{
+private:
+	static const size_t     CAPACITY = 64;
+	std::array<LatencyStamps, CAPACITY> m_Stamps;
+	size_t                  m_nHead;
+	size_t                  m_nCount;
+	std::mutex              m_Mutex;
+
+public:
+	LatencyStampQueue() : m_nHead(0), m_nCount(0) {}
+
+	void push(const LatencyStamps & stamps);
+	// Returns false and leaves stamps untouched if no entry has the device timestamp
+	bool match(uint64_t device_usec, LatencyStamps & stamps);
+	void clear();
+};
+
+class LatencyStats
+{
+private:
+	std::array<LatencyHistogram, LS_Count> m_Histograms;
+	// Smallest host - device clock offset seen, per stream
+	std::atomic<int64_t>    m_nMinBodyOffsetUsec;
+	std::atomic<int64_t>    m_nMinImuOffsetUsec;
+
+	LatencyStats();
+	LatencyStats(LatencyStats const &) = delete;
+	LatencyStats & operator=(LatencyStats const &) = delete;
+
+public:
+	static LatencyStats * Instance();
+
+	// Nanoseconds of a monotonic high-resolution clock
+	static uint64_t now();
+
+	// Stamp the stamps as dispatched and record the stages up to the dispatch
+	void recordBodyDispatch(LatencyStamps & stamps);
+	void recordImuDispatch(LatencyStamps & stamps);
+	// Record the completion of a sink for a message that was dispatched with the stamps
+	void recordSink(latency_stage stage, const LatencyStamps & stamps);
+
+	// Summarizes and resets all histograms: the body stages go to the status line and every
+	// stage goes to the "latency" csv file.
+	void report(std::function<void(static_control_type, const wchar_t *)> funPrintMessage);
+
+	static const char * getStageString(latency_stage stage);
+
+private:
+	void recordCapture(latency_stage stage, std::atomic<int64_t> & nMinOffsetUsec, uint64_t device_usec, uint64_t captured_ns);
+	void recordInterval(latency_stage stage, uint64_t t0_ns, uint64_t t1_ns);
+};
@@ -0,0 +1,194 @@
+#include "stdafx.h"
+#include "LogIndex.h"
+#include "BinaryLog.h"
+#include "Crc32.h"
+#include <cstring>
+#include <stdexcept>
+
+LogIndexWriter::LogIndexWriter(const std::string & strDataFile, size_t nMaxBlockRows) :
+	m_File(getFileName(strDataFile), std::ofstream::out | std::ofstream::binary),
+	m_Sync(getFileName(strDataFile)),
+	m_Block(),
+	m_nMaxBlockRows(max(size_t(1), nMaxBlockRows)),
+	m_nRows(0)
+{
+	if (!m_File.is_open())
+		return;
+	LogIndexFileHeader header = {};
+	memcpy(header.magic, LOG_INDEX_MAGIC, sizeof(header.magic));
+	header.nEntryBytes = sizeof(LogIndexEntry);
+	m_File.write(reinterpret_cast<const char *>(&header), sizeof(header));
+}
+
+LogIndexWriter::~LogIndexWriter()
+{
+	endBlock();
+}
+
+void LogIndexWriter::addRow(uint64_t nOffset, uint64_t usec)
+{
+	if (m_Block.nRows == m_nMaxBlockRows)
+		endBlock();
+	if (m_Block.nRows == 0)
+	{
+		m_Block = LogIndexEntry();
+		m_Block.nOffset = nOffset;
+		m_Block.nFirstRow = m_nRows;
+		m_Block.nMinUsec = m_Block.nMaxUsec = usec;
+	}
+	m_Block.nMinUsec = min(m_Block.nMinUsec, usec);
+	m_Block.nMaxUsec = max(m_Block.nMaxUsec, usec);
+	m_Block.nRows++;
+	m_nRows++;
+}
+
+void LogIndexWriter::addBytes(const void * pData, size_t nBytes)
+{
+	m_Block.nBytes += static_cast<uint32_t>(nBytes);
+	m_Block.nCrc = updateCrc32(m_Block.nCrc, pData, nBytes);
+}
+
+void LogIndexWriter::endBlock()
+{
+	if (m_Block.nRows == 0)
+		return;
+	writeEntry(m_Block);
+	m_Block.nRows = 0;
+}
+
+void LogIndexWriter::addBlock(uint64_t nOffset, uint64_t nRows, uint32_t nBytes, uint32_t nCrc, uint64_t nMinUsec, uint64_t nMaxUsec)
+{
+	endBlock();
+	if (nRows == 0)
+		return;
+	LogIndexEntry entry = {};
+	entry.nOffset = nOffset;
+	entry.nFirstRow = m_nRows;
+	entry.nMinUsec = nMinUsec;
+	entry.nMaxUsec = nMaxUsec;
+	entry.nRows = static_cast<uint32_t>(nRows);
+	entry.nBytes = nBytes;
+	entry.nCrc = nCrc;
+	writeEntry(entry);
+	m_nRows += nRows;
+}
+
+void LogIndexWriter::writeEntry(const LogIndexEntry & entry)
+{
+	m_File.write(reinterpret_cast<const char *>(&entry), sizeof(entry));
+}
+
+void LogIndexWriter::flush()
+{
+	m_File.flush();
+}
+
+bool LogIndexWriter::commit()
+{
+	endBlock();
+	m_File.flush();
+	return m_Sync.sync();
+}
+
+LogIndex::LogIndex(const std::string & strDataFile)
+{
+	const std::string strFileName = LogIndexWriter::getFileName(strDataFile);
+	std::ifstream file(strFileName, std::ios::binary);
+	LogIndexFileHeader header;
+	if (!file.read(reinterpret_cast<char *>(&header), sizeof(header)) ||
+		memcmp(header.magic, LOG_INDEX_MAGIC, sizeof(header.magic)) != 0 ||
+		header.nEntryBytes != sizeof(LogIndexEntry))
+		throw std::runtime_error("Not a log index file:\n" + strFileName);
+
+	LogIndexEntry entry;
+	uint64_t nMaxUsec = 0;
+	while (file.read(reinterpret_cast<char *>(&entry), sizeof(entry)))
+	{
+		nMaxUsec = max(nMaxUsec, entry.nMaxUsec);
+		m_vecEntries.push_back(entry);
+		m_vecMaxUsec.push_back(nMaxUsec);
+	}
+}
+
+size_t LogIndex::find(uint64_t usec) const
+{
+	return std::lower_bound(m_vecMaxUsec.begin(), m_vecMaxUsec.end(), usec) - m_vecMaxUsec.begin();
+}
+
+SyncClock::SyncClock(const std::string & strSyncLog)
+{
+	const bool bBinary = strSyncLog.size() >= 4 && strSyncLog.compare(strSyncLog.size() - 4, 4, ".bin") == 0;
+	if (bBinary)
+	{
+		BinaryLogReader reader(strSyncLog);
+		size_t iOdroid = SIZE_MAX, iUsec = SIZE_MAX;
+		for (size_t i = 0; i < reader.getFields().size(); i++)
+		{
+			const BinaryLogField & field = reader.getFields()[i];
+			if (field.type != BLT_Uint64)
+				continue;
+			if (field.strName.compare("odroid_ts") == 0)
+				iOdroid = i;
+			else if (field.strName.compare("k4a_ts_usec") == 0)
+				iUsec = i;
+		}
+		if (iOdroid == SIZE_MAX || iUsec == SIZE_MAX)
+			throw std::runtime_error("Not a sync log:\n" + strSyncLog);
+		while (reader.nextChunk())
+		{
+			for (size_t iRow = 0; iRow < reader.getRowCount(); iRow++)
+				m_vecEvents.emplace_back(static_cast<int64_t>(reader.getUint64Column(iOdroid)[iRow]), reader.getUint64Column(iUsec)[iRow]);
+		}
+	}
+	else
+	{
+		std::ifstream file(strSyncLog);
+		std::string strLine;
+		if (!std::getline(file, strLine))
+			throw std::runtime_error("Cannot open file\n" + strSyncLog);
+
+		// Columns of the header, which ends with a comma like every row
+		size_t iOdroid = SIZE_MAX, iUsec = SIZE_MAX, nColumns = 0;
+		for (size_t nStart = 0, nComma; (nComma = strLine.find(',', nStart)) != std::string::npos; nStart = nComma + 1, nColumns++)
+		{
+			const std::string strName = strLine.substr(nStart, nComma - nStart);
+			if (strName.compare("odroid_ts") == 0)
+				iOdroid = nColumns;
+			else if (strName.compare("k4a_ts_usec") == 0)
+				iUsec = nColumns;
+		}
+		if (iOdroid == SIZE_MAX || iUsec == SIZE_MAX)
+			throw std::runtime_error("Not a sync log:\n" + strSyncLog);
+
+		std::vector<uint64_t> vecValues(nColumns);
+		while (std::getline(file, strLine))
+		{
+			const char * p = strLine.c_str();
+			size_t i = 0;
+			for (; i < nColumns && *p; i++)
+			{
+				char * pEnd;
+				vecValues[i] = strtoull(p, &pEnd, 10);
+				p = *pEnd == ',' ? pEnd + 1 : pEnd;
+			}
+			if (i == nColumns)
+				m_vecEvents.emplace_back(static_cast<int64_t>(vecValues[iOdroid]), vecValues[iUsec]);
+		}
+	}
+
+	// Events before the first body frame have no device time
+	m_vecEvents.erase(std::remove_if(m_vecEvents.begin(), m_vecEvents.end(),
+		[](const std::pair<int64_t, uint64_t> & event) { return event.second == 0; }), m_vecEvents.end());
+	std::stable_sort(m_vecEvents.begin(), m_vecEvents.end(),
+		[](const std::pair<int64_t, uint64_t> & a, const std::pair<int64_t, uint64_t> & b) { return a.first < b.first; });
+}
+
+bool SyncClock::toK4aUsec(int64_t tsOdroid, uint64_t & usec) const
+{
+	auto it = std::upper_bound(m_vecEvents.begin(), m_vecEvents.end(), tsOdroid,
+		[](int64_t ts, const std::pair<int64_t, uint64_t> & event) { return ts < event.first; });
+	if (it == m_vecEvents.begin())
+		return false;
+	usec = (--it)->second;
+	return true;
+}
@@ -0,0 +1,106 @@
+#pragma once
+#include "FileSync.h"
+#include <cstdint>
+#include <fstream>
+#include <string>
+#include <utility>
+#include <vector>
+
+// Time index of a log file, written next to it as "<log file>.idx" by LogFile for every log
+// with a "k4a_ts_usec" column. The rows of the log are split into blocks: the chunks of a
+// binary log, or every "CsvLogger/index/blockRows" rows of a csv file and at every commit
+// (LogFile::commitFile()). The index file is a LogIndexFileHeader followed by one
+// LogIndexEntry per block, appended as the blocks are written, so it is usable while the log
+// is still being captured. The checksum of every block lets RecoverLog() find where a log
+// that was not closed cleanly is damaged.
+
+const char LOG_INDEX_MAGIC[8] = { 'B', 'T', 'I', 'D', 'X', 0, 0, 1 };
+
+struct LogIndexFileHeader
+{
+	char                    magic[8];
+	uint32_t                nEntryBytes;    // sizeof(LogIndexEntry)
+	uint32_t                nReserved;
+};
+
+struct LogIndexEntry
+{
+	uint64_t                nOffset;        // byte offset of the block in the log file
+	uint64_t                nFirstRow;
+	uint64_t                nMinUsec;       // range of k4a_ts_usec in the block
+	uint64_t                nMaxUsec;
+	uint32_t                nRows;
+	uint32_t                nBytes;
+	uint32_t                nCrc;           // CRC-32 of the nBytes bytes of the block
+	uint32_t                nReserved;
+};
+
+class LogIndexWriter
+{
+private:
+	std::ofstream           m_File;
+	FileSync                m_Sync;
+	LogIndexEntry           m_Block;        // open if nRows > 0
+	size_t                  m_nMaxBlockRows;
+	uint64_t                m_nRows;
+
+public:
+	// Creates the index of strDataFile. Blocks added row by row end after nMaxBlockRows rows.
+	LogIndexWriter(const std::string & strDataFile, size_t nMaxBlockRows);
+	~LogIndexWriter();
+
+	bool isOpen() const { return m_File.is_open(); }
+
+	// Starts a row at byte nOffset of the log file, after the rows before it are complete
+	void addRow(uint64_t nOffset, uint64_t usec);
+	// Adds bytes of the rows of the open block as they are written
+	void addBytes(const void * pData, size_t nBytes);
+	// Ends the open block
+	void endBlock();
+	// Adds a block of rows that was written at once, e.g. a chunk of a binary log
+	void addBlock(uint64_t nOffset, uint64_t nRows, uint32_t nBytes, uint32_t nCrc, uint64_t nMinUsec, uint64_t nMaxUsec);
+
+	void flush();
+	// Ends the open block and returns once the index is on the disk
+	bool commit();
+
+	static std::string getFileName(const std::string & strDataFile) { return strDataFile + ".idx"; }
+
+private:
+	void writeEntry(const LogIndexEntry & entry);
+};
+
+// Reads the index of a log file to seek to a time
+class LogIndex
+{
+private:
+	std::vector<LogIndexEntry> m_vecEntries;
+	std::vector<uint64_t>   m_vecMaxUsec;   // of the block and all before it
+
+public:
+	// Throws std::runtime_error if the log has no index. A partly written last entry is ignored.
+	explicit LogIndex(const std::string & strDataFile);
+
+	const std::vector<LogIndexEntry> & getEntries() const { return m_vecEntries; }
+
+	// The first block that may hold rows at or after usec, or getEntries().size() if no block
+	// does. The blocks before it only hold earlier rows. O(log n).
+	size_t find(uint64_t usec) const;
+};
+
+// Maps Odroid time to Kinect device time by the events of a "sync" log, csv or binary
+class SyncClock
+{
+private:
+	std::vector<std::pair<int64_t, uint64_t>> m_vecEvents;  // odroid_ts, k4a_ts_usec
+
+public:
+	// Throws std::runtime_error if the file cannot be read or has no sync columns
+	explicit SyncClock(const std::string & strSyncLog);
+
+	bool empty() const { return m_vecEvents.empty(); }
+
+	// The k4a_ts_usec of the last sync event at or before tsOdroid. Returns false if there
+	// is none. O(log n).
+	bool toK4aUsec(int64_t tsOdroid, uint64_t & usec) const;
+};
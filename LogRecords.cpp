@@ -0,0 +1,33 @@
+#include "stdafx.h"
+#include "LogRecords.h"
+#include "CsvLogger.h"
+
+static const uint32_t s_EmptyIds[MAX_NUM_BODIES] = {};
+const JointArrays SkeletonRecord::s_EmptyJoints = {};
+
+SkeletonRecord::SkeletonRecord() :
+	k4a_ts_usec(0),
+	num_bodies(0),
+	body_ids(s_EmptyIds),
+	valid_joints(s_EmptyIds),
+	joints(&s_EmptyJoints)
+{
+}
+
+SkeletonRecord::SkeletonRecord(const BodyFrame & frame) :
+	k4a_ts_usec(frame.timestamp_usec),
+	num_bodies(min(frame.num_bodies, MAX_NUM_BODIES)),
+	body_ids(frame.body_ids),
+	valid_joints(frame.valid_joints),
+	joints(&frame.joints)
+{
+}
+
+std::string getLogColumnName(const SkeletonRecord::Column & column)
+{
+	static const char * components[] = { "id", "valid", "px", "py", "pz", "qw", "qx", "qy", "qz" };
+	std::string strName = "b" + std::to_string(column.iBody) + "_";
+	if (column.iJoint >= 0)
+		strName += std::string(getJointTypeString(column.iJoint)) + "_";
+	return strName + components[column.component];
+}
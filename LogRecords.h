@@ -0,0 +1,101 @@
+#pragma once
+#include "stdafx.h"
+#include "BodyFramePool.h"
+#include <cstdint>
+#include <string>
+
+// Records of the logs written with TypedLogger. The order of the fields is the column order
+// of the files, which CsvReplaySource relies on.
+
+// One joint of the closest body, "partial_skeleton" log
+struct PartialSkeletonRecord
+{
+	uint64_t                k4a_ts_usec;
+	const char *            joint_type;
+	float                   px, py, pz;         // position
+	float                   qw, qx, qy, qz;     // orientation
+
+	template <typename Visitor>
+	void fields(Visitor & visitor) const
+	{
+		visitor("k4a_ts_usec", k4a_ts_usec);
+		visitor("joint_type", joint_type);
+		visitor("px", px); visitor("py", py); visitor("pz", pz);
+		visitor("qw", qw); visitor("qx", qx); visitor("qy", qy); visitor("qz", qz);
+	}
+};
+
+// One IMU sample, "imu" log
+struct ImuRecord
+{
+	k4a_imu_sample_t        sample;
+
+	template <typename Visitor>
+	void fields(Visitor & visitor) const
+	{
+		visitor("k4a_ts_usec", static_cast<uint64_t>(sample.acc_timestamp_usec));
+		visitor("wx", sample.gyro_sample.xyz.x);
+		visitor("wy", sample.gyro_sample.xyz.y);
+		visitor("wz", sample.gyro_sample.xyz.z);
+		visitor("ax", sample.acc_sample.xyz.x);
+		visitor("ay", sample.acc_sample.xyz.y);
+		visitor("az", sample.acc_sample.xyz.z);
+	}
+};
+
+// Every joint of every body slot of a body frame, "skeleton" log. One row per frame, so a
+// frame is one contiguous record: the timestamp and number of bodies, then for each of the
+// MAX_NUM_BODIES slots the body id, the valid_joints mask and the position and orientation
+// of all K4ABT_JOINT_COUNT joints. Slots without a body are written as zeros.
+struct SkeletonRecord
+{
+	enum column_component { CC_Id = 0, CC_Valid, CC_Px, CC_Py, CC_Pz, CC_Qw, CC_Qx, CC_Qy, CC_Qz };
+
+	// Name of a column: "b<i>_id", "b<i>_valid" or "b<i>_<JOINT>_<px..qz>"
+	struct Column
+	{
+		size_t              iBody;
+		int                 iJoint;
+		column_component    component;
+	};
+
+	uint64_t                k4a_ts_usec;
+	uint64_t                num_bodies;
+	const uint32_t *        body_ids;
+	const uint32_t *        valid_joints;
+	const JointArrays *     joints;
+
+	// All zeros, as used for the column names
+	SkeletonRecord();
+	explicit SkeletonRecord(const BodyFrame & frame);
+
+	template <typename Visitor>
+	void fields(Visitor & visitor) const
+	{
+		visitor("k4a_ts_usec", k4a_ts_usec);
+		visitor("num_bodies", num_bodies);
+		for (size_t i = 0; i < MAX_NUM_BODIES; i++)
+		{
+			const bool bBody = i < num_bodies;
+			const JointArrays & source = bBody ? *joints : s_EmptyJoints;
+			visitor(Column{ i, -1, CC_Id }, static_cast<uint64_t>(bBody ? body_ids[i] : 0));
+			visitor(Column{ i, -1, CC_Valid }, static_cast<uint64_t>(bBody ? valid_joints[i] : 0));
+			for (int j = 0; j < K4ABT_JOINT_COUNT; j++)
+			{
+				const size_t k = BodyFrame::index(bBody ? i : 0, j);
+				visitor(Column{ i, j, CC_Px }, source.px[k]);
+				visitor(Column{ i, j, CC_Py }, source.py[k]);
+				visitor(Column{ i, j, CC_Pz }, source.pz[k]);
+				visitor(Column{ i, j, CC_Qw }, source.qw[k]);
+				visitor(Column{ i, j, CC_Qx }, source.qx[k]);
+				visitor(Column{ i, j, CC_Qy }, source.qy[k]);
+				visitor(Column{ i, j, CC_Qz }, source.qz[k]);
+			}
+		}
+	}
+
+private:
+	static const JointArrays s_EmptyJoints;
+};
+
+std::string getLogColumnName(const SkeletonRecord::Column & column);
@@ -0,0 +1,161 @@
+#include "stdafx.h"
+#include "LogRecovery.h"
+#include "BinaryLog.h"
+#include "Crc32.h"
+#include "CsvLogReader.h"
+#include "FileSync.h"
+#include "LogIndex.h"
+#include <cstring>
+#include <fstream>
+#include <stdexcept>
+#include <vector>
+
+// Reads the entries of the index of strDataFile. Returns false if the log has no index; an
+// index without a valid header, e.g. one that was never committed, has no entries.
+static bool readIndex(const std::string & strDataFile, std::vector<LogIndexEntry> & vecEntries)
+{
+	if (!std::ifstream(LogIndexWriter::getFileName(strDataFile)).is_open())
+		return false;
+	try
+	{
+		vecEntries = LogIndex(strDataFile).getEntries();
+	}
+	catch (const std::runtime_error &)
+	{
+		vecEntries.clear();
+	}
+	return true;
+}
+
+static void writeIndex(const std::string & strDataFile, const std::vector<LogIndexEntry> & vecEntries)
+{
+	const std::string strFileName = LogIndexWriter::getFileName(strDataFile);
+	{
+		std::ofstream file(strFileName, std::ofstream::out | std::ofstream::binary | std::ofstream::trunc);
+		LogIndexFileHeader header = {};
+		memcpy(header.magic, LOG_INDEX_MAGIC, sizeof(header.magic));
+		header.nEntryBytes = sizeof(LogIndexEntry);
+		file.write(reinterpret_cast<const char *>(&header), sizeof(header));
+		if (!vecEntries.empty())
+			file.write(reinterpret_cast<const char *>(vecEntries.data()), vecEntries.size() * sizeof(LogIndexEntry));
+		if (!file.flush())
+			throw std::runtime_error("Cannot write file\n" + strFileName);
+	}
+	FileSync(strFileName).sync();
+}
+
+// Byte offset after the last intact chunk of a binary log
+static uint64_t findBinaryEnd(const std::string & strDataFile)
+{
+	BinaryLogReader reader(strDataFile);
+	uint64_t nEnd = reader.tell();
+	while (reader.nextChunk())
+		nEnd = reader.tell();
+	return nEnd;
+}
+
+// Byte offset after the last intact row of a csv file. The index entries of the intact blocks
+// are kept in vecEntries, and the rows after them get an entry of their own.
+static uint64_t findCsvEnd(const std::string & strDataFile, uint64_t nFileSize, bool bIndex, std::vector<LogIndexEntry> & vecEntries)
+{
+	MappedFile file(strDataFile);
+	const char * const pData = file.data();
+	const char * const pEnd = pData + file.size();
+	const char * pHeaderEnd = pData ? static_cast<const char *>(memchr(pData, '\n', file.size())) : NULL;
+	if (!pHeaderEnd || memchr(pData, '\0', pHeaderEnd - pData))
+		return 0;
+
+	// Column of the index
+	size_t nColumns = 0, iUsec = SIZE_MAX;
+	for (const char * p = pData, * pComma; (pComma = static_cast<const char *>(memchr(p, ',', pHeaderEnd - p))) != NULL; p = pComma + 1, nColumns++)
+	{
+		if (size_t(pComma - p) == strlen("k4a_ts_usec") && memcmp(p, "k4a_ts_usec", pComma - p) == 0)
+			iUsec = nColumns;
+	}
+
+	// Blocks in the index, in the order they were written
+	uint64_t nEnd = static_cast<uint64_t>(pHeaderEnd + 1 - pData);
+	uint64_t nRows = 0;
+	size_t nGoodEntries = 0;
+	for (; nGoodEntries < vecEntries.size(); nGoodEntries++)
+	{
+		const LogIndexEntry & entry = vecEntries[nGoodEntries];
+		if (entry.nOffset != nEnd || entry.nFirstRow != nRows || entry.nBytes > nFileSize - nEnd)
+			break;
+		if (updateCrc32(0, pData + entry.nOffset, entry.nBytes) != entry.nCrc)
+		{
+			// The block was damaged after it was committed, so nothing from it on is kept
+			vecEntries.resize(nGoodEntries);
+			return nEnd;
+		}
+		nEnd += entry.nBytes;
+		nRows += entry.nRows;
+	}
+	vecEntries.resize(nGoodEntries);
+
+	// Complete lines after them. A torn write can leave zeros in the file.
+	const char * const pTail = pData + nEnd;
+	const char * p = pTail;
+	while (p < pEnd)
+	{
+		const char * pBreak = static_cast<const char *>(memchr(p, '\n', pEnd - p));
+		if (!pBreak || memchr(p, '\0', pBreak - p))
+			break;
+		p = pBreak + 1;
+	}
+
+	if (bIndex && iUsec != SIZE_MAX && p > pTail)
+	{
+		LogIndexEntry entry = {};
+		entry.nOffset = nEnd;
+		entry.nFirstRow = nRows;
+		entry.nMinUsec = UINT64_MAX;
+		entry.nBytes = static_cast<uint32_t>(p - pTail);
+		entry.nCrc = updateCrc32(0, pTail, p - pTail);
+		CsvLogCursor cursor(pData, pTail, p, nColumns);
+		while (cursor.next())
+		{
+			const uint64_t usec = cursor.getUint64(iUsec);
+			entry.nMinUsec = min(entry.nMinUsec, usec);
+			entry.nMaxUsec = max(entry.nMaxUsec, usec);
+			entry.nRows++;
+		}
+		if (entry.nRows > 0)
+			vecEntries.push_back(entry);
+	}
+	return static_cast<uint64_t>(p - pData);
+}
+
+uint64_t RecoverLog(const std::string & strDataFile)
+{
+	const bool bBinary = strDataFile.size() >= 4 && strDataFile.compare(strDataFile.size() - 4, 4, ".bin") == 0;
+	std::ifstream data(strDataFile, std::ios::binary | std::ios::ate);
+	if (!data.is_open())
+		throw std::runtime_error("Cannot open file\n" + strDataFile);
+	const uint64_t nFileSize = static_cast<uint64_t>(data.tellg());
+	data.close();
+
+	std::vector<LogIndexEntry> vecEntries;
+	const bool bIndex = readIndex(strDataFile, vecEntries);
+	uint64_t nEnd;
+	if (bBinary)
+	{
+		nEnd = findBinaryEnd(strDataFile);
+		// An entry is written after its chunk
+		while (!vecEntries.empty() && vecEntries.back().nOffset >= nEnd)
+			vecEntries.pop_back();
+	}
+	else
+		nEnd = findCsvEnd(strDataFile, nFileSize, bIndex, vecEntries);
+
+	// The file is no longer mapped, so it can be cut
+	if (nEnd < nFileSize)
+	{
+		FileSync file(strDataFile);
+		if (!file.truncate(nEnd) || !file.sync())
+			throw std::runtime_error("Cannot truncate file\n" + strDataFile);
+	}
+	if (bIndex)
+		writeIndex(strDataFile, vecEntries);
+	return nFileSize - nEnd;
+}
@@ -0,0 +1,11 @@
+#pragma once
+#include <cstdint>
+#include <string>
+
+// Repairs a log that was not closed cleanly, e.g. after a crash or a power loss while
+// "CsvLogger/durability/..." commits were enabled. The log is cut after its last intact row:
+// a binary log after the last chunk whose checksum matches, a csv file after the last index
+// block whose checksum matches and the complete lines that follow it. The index is rewritten
+// to cover the rows that are kept. Returns the number of bytes removed from the log.
+// Throws std::runtime_error if the log cannot be read or written.
+uint64_t RecoverLog(const std::string & strDataFile);
@@ -0,0 +1,96 @@
+#include "stdafx.h"
+#include "LoggerBenchmark.h"
+#include "TypedLogger.h"
+#include "LogRecords.h"
+#include "LatencyStats.h"
+#include <sstream>
+
+namespace
+{
+	// Synthetic IMU samples at 1.6 kHz
+	void fillSample(k4a_imu_sample_t & sample, size_t i)
+	{
+		sample.acc_timestamp_usec = 1000000 + i * 625;
+		sample.gyro_sample.xyz.x = 0.001f * (i % 1000);
+		sample.gyro_sample.xyz.y = -0.002f * (i % 500);
+		sample.gyro_sample.xyz.z = 0.5f;
+		sample.acc_sample.xyz.x = 9.81f;
+		sample.acc_sample.xyz.y = 0.01f * (i % 100);
+		sample.acc_sample.xyz.z = -0.03f;
+	}
+
+	double nsPerRow(uint64_t t0_ns, size_t nRows)
+	{
+		return double(LatencyStats::now() - t0_ns) / max(size_t(1), nRows);
+	}
+}
+
+std::wstring BenchmarkLoggers(size_t nRows)
+{
+	static k4a_imu_sample_t imu_sample;
+	CsvLogger csvLogger("bench_csvlogger", vector_header_value_t{
+		{"k4a_ts_usec", &imu_sample.acc_timestamp_usec},
+		{"wx", &imu_sample.gyro_sample.xyz.x},
+		{"wy", &imu_sample.gyro_sample.xyz.y},
+		{"wz", &imu_sample.gyro_sample.xyz.z},
+		{"ax", &imu_sample.acc_sample.xyz.x},
+		{"ay", &imu_sample.acc_sample.xyz.y},
+		{"az", &imu_sample.acc_sample.xyz.z}
+		});
+	TypedLogger<ImuRecord> typedLogger("bench_typedlogger");
+
+	// Encoding only, into a row that is summed up so that it is not optimized away
+	uint64_t row[7];
+	uint64_t nChecksum = 0;
+	uint64_t t0 = LatencyStats::now();
+	for (size_t i = 0; i < nRows; i++)
+	{
+		fillSample(imu_sample, i);
+		csvLogger.encode(row);
+		nChecksum += row[0] ^ row[6];
+	}
+	const double fCsvEncodeNs = nsPerRow(t0, nRows);
+
+	t0 = LatencyStats::now();
+	for (size_t i = 0; i < nRows; i++)
+	{
+		ImuRecord record;
+		fillSample(record.sample, i);
+		TypedLogger<ImuRecord>::encode(record, row);
+		nChecksum -= row[0] ^ row[6];
+	}
+	const double fTypedEncodeNs = nsPerRow(t0, nRows);
+
+	std::wstringstream ss;
+	ss << L"Encoding a row of the imu log, " << nRows << L" rows:\n"
+		<< L"CsvLogger " << fCsvEncodeNs << L" ns, TypedLogger " << fTypedEncodeNs << L" ns\n";
+	if (nChecksum != 0)
+		ss << L"Rows differ between the loggers!\n";
+
+	if (csvLogger.isOpen() && typedLogger.isOpen())
+	{
+		t0 = LatencyStats::now();
+		for (size_t i = 0; i < nRows; i++)
+		{
+			fillSample(imu_sample, i);
+			csvLogger.log();
+		}
+		const double fCsvLogNs = nsPerRow(t0, nRows);
+
+		t0 = LatencyStats::now();
+		for (size_t i = 0; i < nRows; i++)
+		{
+			ImuRecord record;
+			fillSample(record.sample, i);
+			typedLogger.log(record);
+		}
+		const double fTypedLogNs = nsPerRow(t0, nRows);
+
+		ss << L"\nLogging a row (including buffer waits):\n"
+			<< L"CsvLogger " << fCsvLogNs << L" ns, TypedLogger " << fTypedLogNs << L" ns\n"
+			<< L"Dropped rows: " << csvLogger.getDroppedCount() << L", " << typedLogger.getDroppedCount() << L"\n";
+	}
+	else
+		ss << L"\nSet CsvLogger/enabled=true to also time logging to files.\n";
+	return ss.str();
+}
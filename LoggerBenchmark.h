@@ -0,0 +1,8 @@
+#pragma once
+#include <string>
+
+// Compares CsvLogger, which reads its values through pointers with a runtime type switch,
+// with TypedLogger on the columns of the "imu" log. Encoding a row is timed by itself, and
+// logging as well if "CsvLogger/enabled" is true, in which case two bench_ files are written.
+// Run with "BodyTracker.exe --bench-logger". Returns the results as text.
+std::wstring BenchmarkLoggers(size_t nRows);
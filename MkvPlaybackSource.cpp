@@ -0,0 +1,176 @@
+#include "MkvPlaybackSource.h"
+#include "Config.h"
+#include "KinectAzure.h"
+
+MkvPlaybackSource::MkvPlaybackSource(
+	std::function<void(static_control_type, const wchar_t*)> funPrintMessage,
+	FrameBus & bus
+) :
+	SensorSource(funPrintMessage, bus),
+	m_Playback(NULL),
+	m_PlaybackImu(NULL),
+	m_Calibration({}),
+	m_Tracker(NULL),
+	m_nFramesEnqueued(0),
+	m_nFramesPopped(0),
+	m_bEndOfFile(false)
+{
+	Config::Instance()->assign("source/mkv/file", m_strFile);
+
+	if (K4A_FAILED(k4a_playback_open(m_strFile.c_str(), &m_Playback)))
+	{
+		m_Playback = NULL;
+		return;
+	}
+	if (K4A_FAILED(k4a_playback_get_calibration(m_Playback, &m_Calibration)))
+	{
+		k4a_playback_close(m_Playback);
+		m_Playback = NULL;
+		return;
+	}
+	if (K4A_FAILED(k4a_playback_open(m_strFile.c_str(), &m_PlaybackImu)))
+		m_PlaybackImu = NULL;
+}
+
+MkvPlaybackSource::~MkvPlaybackSource()
+{
+	stop();
+	if (m_Tracker)
+	{
+		k4abt_tracker_shutdown(m_Tracker);
+		k4abt_tracker_destroy(m_Tracker);
+		m_Tracker = NULL;
+	}
+	if (m_PlaybackImu)
+		k4a_playback_close(m_PlaybackImu);
+	if (m_Playback)
+		k4a_playback_close(m_Playback);
+}
+
+const k4a_calibration_t * MkvPlaybackSource::getCalibration()
+{
+	return m_Playback ? &m_Calibration : nullptr;
+}
+
+void MkvPlaybackSource::SkeletonProc()
+{
+	if (!m_Playback)
+	{
+		if (m_funPrintMessage) m_funPrintMessage(SCT_Kinect, L"Failed to open the recording to play back.");
+		return;
+	}
+	if (m_funPrintMessage) m_funPrintMessage(SCT_Kinect, L"Playing back recording.");
+
+	if (m_funPrintMessage) m_funPrintMessage(SCT_BodyTracker, L"Creating body tracker.");
+	if (K4A_FAILED(k4abt_tracker_create(&m_Calibration, &m_Tracker)))
+	{
+		if (m_funPrintMessage) m_funPrintMessage(SCT_BodyTracker, L"Failed to create body tracker.");
+		m_Tracker = NULL;
+		return;
+	}
+	if (m_funPrintMessage) m_funPrintMessage(SCT_BodyTracker, L"Successfully created body tracker.");
+
+	auto tStart = std::chrono::steady_clock::now();
+	std::thread threadPop(&MkvPlaybackSource::PopProc, this);
+
+	k4a_capture_t capture = NULL;
+	k4a_stream_result_t stream_result = K4A_STREAM_RESULT_SUCCEEDED;
+	while (!m_bTerminating && (stream_result = k4a_playback_get_next_capture(m_Playback, &capture)) == K4A_STREAM_RESULT_SUCCEEDED)
+	{
+		// The tracker only accepts captures with a depth image
+		k4a_image_t depth = k4a_capture_get_depth_image(capture);
+		if (depth)
+		{
+			uint64_t timestamp_usec = k4a_image_get_timestamp_usec(depth);
+			k4a_image_release(depth);
+
+			if (waitForDeviceTime(timestamp_usec))
+			{
+				LatencyStamps stamps = {};
+				stamps.device_usec = timestamp_usec;
+				stamps.captured_ns = LatencyStats::now();
+
+				// Block while the tracker queue is full; this is what paces the fast mode
+				k4a_wait_result_t queue_result;
+				while ((queue_result = k4abt_tracker_enqueue_capture(m_Tracker, capture, 100)) == K4A_WAIT_RESULT_TIMEOUT
+					&& !m_bTerminating);
+				if (queue_result == K4A_WAIT_RESULT_SUCCEEDED)
+				{
+					stamps.enqueued_ns = LatencyStats::now();
+					m_StampsInFlight.push(stamps);
+					m_nFramesEnqueued++;
+				}
+			}
+		}
+		k4a_capture_release(capture);
+	}
+	m_bEndOfFile = true;
+	threadPop.join();
+
+	if (stream_result == K4A_STREAM_RESULT_EOF)
+	{
+		double fSeconds = std::chrono::duration<double>(std::chrono::steady_clock::now() - tStart).count();
+		const size_t BUFFER_LEN = 128;
+		wchar_t pszText[BUFFER_LEN];
+		StringCchPrintf(pszText, BUFFER_LEN, L"Playback finished: %llu body frames in %.1f s (%.1f fps).",
+			(unsigned long long)m_nFramesPopped.load(), fSeconds, m_nFramesPopped / max(fSeconds, 1e-3));
+		if (m_funPrintMessage) m_funPrintMessage(SCT_Kinect, pszText);
+	}
+	else if (stream_result == K4A_STREAM_RESULT_FAILED)
+	{
+		if (m_funPrintMessage) m_funPrintMessage(SCT_Kinect, L"Failed to read a capture from the recording.");
+	}
+}
+
+void MkvPlaybackSource::PopProc()
+{
+	// Keep popping until every enqueued capture has come back after the end of the file
+	while (!m_bTerminating && !(m_bEndOfFile && m_nFramesPopped == m_nFramesEnqueued))
+	{
+		k4abt_frame_t body_frame = NULL;
+		k4a_wait_result_t pop_result = k4abt_tracker_pop_result(m_Tracker, &body_frame, 100);
+		if (pop_result == K4A_WAIT_RESULT_SUCCEEDED)
+		{
+			uint64_t popped_ns = LatencyStats::now();
+			BodyFrameRef frame = m_Bus.bodyFramePool.acquire();
+			if (frame && KinectAzure::ExtractBodyFrame(body_frame, *frame))
+			{
+				if (m_StampsInFlight.match(frame->timestamp_usec, frame->stamps))
+					frame->stamps.popped_ns = popped_ns;
+				m_Bus.publishBodyFrame(frame);
+			}
+			k4abt_frame_release(body_frame);
+			m_nFramesPopped++;
+		}
+		else if (pop_result == K4A_WAIT_RESULT_FAILED)
+			break;
+	}
+}
+
+void MkvPlaybackSource::ImuProc()
+{
+	if (!m_PlaybackImu)
+		return;
+
+	k4a_imu_sample_t imu_samples[IMU_BATCH_SIZE];
+	size_t nCount = 0;
+	while (!m_bTerminating && k4a_playback_get_next_imu_sample(m_PlaybackImu, &imu_samples[nCount]) == K4A_STREAM_RESULT_SUCCEEDED)
+	{
+		// Hand over the samples that are due before waiting for the next one
+		if (nCount > 0 && !isDeviceTimeDue(imu_samples[nCount].acc_timestamp_usec))
+		{
+			m_Bus.publishImuSamples(imu_samples, nCount, LatencyStats::now());
+			imu_samples[0] = imu_samples[nCount];
+			nCount = 0;
+		}
+		if (!waitForDeviceTime(imu_samples[nCount].acc_timestamp_usec))
+			break;
+		if (++nCount == IMU_BATCH_SIZE)
+		{
+			m_Bus.publishImuSamples(imu_samples, nCount, LatencyStats::now());
+			nCount = 0;
+		}
+	}
+	if (nCount > 0 && !m_bTerminating)
+		m_Bus.publishImuSamples(imu_samples, nCount, LatencyStats::now());
+}
@@ -0,0 +1,38 @@
+#pragma once
+#include "SensorSource.h"
+#include <k4arecord/playback.h>
+#include <atomic>
+
+// Plays back an Azure Kinect recording (.mkv) through its own body tracker.
+// Captures are read and enqueued on the skeleton thread while a second thread pops the
+// results, so that in the as-fast-as-possible mode (source/speed=0) the tracker is never
+// starved. IMU samples are read through a separate playback handle on the IMU thread.
+class MkvPlaybackSource : public SensorSource
+{
+private:
+	std::string             m_strFile;
+	k4a_playback_t          m_Playback;
+	k4a_playback_t          m_PlaybackImu;
+	k4a_calibration_t       m_Calibration;
+	k4abt_tracker_t         m_Tracker;
+
+	std::atomic<uint64_t>   m_nFramesEnqueued;
+	std::atomic<uint64_t>   m_nFramesPopped;
+	std::atomic<bool>       m_bEndOfFile;
+	// Stamps of the captures queued in the tracker
+	LatencyStampQueue       m_StampsInFlight;
+
+public:
+	MkvPlaybackSource(
+		std::function<void(static_control_type, const wchar_t*)> funPrintMessage,
+		FrameBus & bus
+	);
+	~MkvPlaybackSource();
+
+	const k4a_calibration_t * getCalibration() override;
+
+protected:
+	void SkeletonProc() override;
+	void ImuProc() override;
+	void PopProc();
+};
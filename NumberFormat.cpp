@@ -0,0 +1,287 @@
+#include "stdafx.h"
+#include "NumberFormat.h"
+#include <cfloat>
+#include <cmath>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+
+static const char DIGIT_PAIRS[] =
+	"00010203040506070809"
+	"10111213141516171819"
+	"20212223242526272829"
+	"30313233343536373839"
+	"40414243444546474849"
+	"50515253545556575859"
+	"60616263646566676869"
+	"70717273747576777879"
+	"80818283848586878889"
+	"90919293949596979899";
+
+// Powers of ten that are exact in a double
+static const double POW10[] = {
+	1e0, 1e1, 1e2, 1e3, 1e4, 1e5, 1e6, 1e7, 1e8, 1e9, 1e10, 1e11,
+	1e12, 1e13, 1e14, 1e15, 1e16, 1e17, 1e18, 1e19, 1e20, 1e21, 1e22
+};
+static const int POW10_MAX = 22;
+
+char * formatUint64(char * p, uint64_t value)
+{
+	char buffer[20];
+	char * q = buffer + sizeof(buffer);
+	while (value >= 100)
+	{
+		const size_t i = static_cast<size_t>(value % 100) * 2;
+		value /= 100;
+		q -= 2;
+		memcpy(q, DIGIT_PAIRS + i, 2);
+	}
+	if (value >= 10)
+	{
+		q -= 2;
+		memcpy(q, DIGIT_PAIRS + value * 2, 2);
+	}
+	else
+		*--q = static_cast<char>('0' + value);
+
+	const size_t n = buffer + sizeof(buffer) - q;
+	memcpy(p, q, n);
+	return p + n;
+}
+
+static char * formatFloatPrintf(char * p, float value, int nPrecision)
+{
+	char buffer[NUMBER_FORMAT_MAX_LENGTH];
+	const int n = snprintf(buffer, sizeof(buffer), "%.*g", nPrecision, value);
+	if (n <= 0)
+		return p;
+	memcpy(p, buffer, n);
+	return p + n;
+}
+
+// Rounds x > 0 to nPrecision significant digits, so that x ~ nDigits * 10^(nExponent - nPrecision + 1).
+// Returns false where double arithmetic cannot decide the rounding: x is out of the range of
+// the exact powers of ten, or within the rounding error of halfway between two results.
+static bool roundSignificant(double x, int nPrecision, uint32_t & nDigits, int & nExponent)
+{
+	int k = static_cast<int>(floor(log10(x)));
+	double y = 0;
+	// log10() may be off by one next to a power of ten
+	for (int nTries = 0; ; nTries++)
+	{
+		const int s = nPrecision - 1 - k;
+		if (s > POW10_MAX || s < -POW10_MAX || nTries == 3)
+			return false;
+		// A single rounding: |y - exact| <= 2^-53 * 10^9 < 1e-6
+		y = s >= 0 ? x * POW10[s] : x / POW10[-s];
+		if (y < POW10[nPrecision - 1])
+			k--;
+		else if (y >= POW10[nPrecision])
+			k++;
+		else
+			break;
+	}
+
+	const double fFloor = floor(y);
+	const double fFraction = y - fFloor;
+	if (fabs(fFraction - 0.5) < 1e-6)
+		return false;
+	uint64_t n = static_cast<uint64_t>(fFloor) + (fFraction > 0.5 ? 1 : 0);
+	if (n == static_cast<uint64_t>(POW10[nPrecision]))
+	{
+		n /= 10;
+		k++;
+	}
+	nDigits = static_cast<uint32_t>(n);
+	nExponent = k;
+	return true;
+}
+
+// The layout of %g for the significant digits of a value
+static char * formatSignificant(char * p, uint32_t nDigits, int nExponent, int nPrecision)
+{
+	char digits[FLOAT_PRECISION_MAX];
+	for (int i = nPrecision - 1; i >= 0; i--)
+	{
+		digits[i] = static_cast<char>('0' + nDigits % 10);
+		nDigits /= 10;
+	}
+	// Trailing zeros are not written
+	int nSignificant = nPrecision;
+	while (nSignificant > 1 && digits[nSignificant - 1] == '0')
+		nSignificant--;
+
+	if (nExponent < -4 || nExponent >= nPrecision)
+	{
+		*p++ = digits[0];
+		if (nSignificant > 1)
+		{
+			*p++ = '.';
+			memcpy(p, digits + 1, nSignificant - 1);
+			p += nSignificant - 1;
+		}
+		*p++ = 'e';
+		*p++ = nExponent < 0 ? '-' : '+';
+		const int nAbsExponent = nExponent < 0 ? -nExponent : nExponent;
+		if (nAbsExponent < 10)
+			*p++ = '0';
+		return formatUint64(p, nAbsExponent);
+	}
+	if (nExponent >= 0)
+	{
+		memcpy(p, digits, nExponent + 1);
+		p += nExponent + 1;
+		if (nSignificant > nExponent + 1)
+		{
+			*p++ = '.';
+			memcpy(p, digits + nExponent + 1, nSignificant - nExponent - 1);
+			p += nSignificant - nExponent - 1;
+		}
+		return p;
+	}
+	*p++ = '0';
+	*p++ = '.';
+	for (int i = 0; i < -nExponent - 1; i++)
+		*p++ = '0';
+	memcpy(p, digits, nSignificant);
+	return p + nSignificant;
+}
+
+static char * formatFloatPrecision(char * p, float value, int nPrecision)
+{
+	if (!std::isfinite(value))
+		return formatFloatPrintf(p, value, nPrecision);
+	if (std::signbit(value))
+		*p++ = '-';
+	const double x = fabs(static_cast<double>(value));
+	if (x == 0)
+	{
+		*p++ = '0';
+		return p;
+	}
+
+	uint32_t nDigits;
+	int nExponent;
+	if (!roundSignificant(x, nPrecision, nDigits, nExponent))
+		return formatFloatPrintf(p, static_cast<float>(x), nPrecision);
+	return formatSignificant(p, nDigits, nExponent, nPrecision);
+}
+
+char * formatFloat(char * p, float value, int nPrecision)
+{
+	if (nPrecision != FLOAT_PRECISION_SHORTEST)
+		return formatFloatPrecision(p, value, min(max(nPrecision, 1), FLOAT_PRECISION_MAX));
+
+	// The fewest digits that read back as the same value
+	char buffer[NUMBER_FORMAT_MAX_LENGTH];
+	char * pEnd = buffer;
+	for (nPrecision = 1; nPrecision <= FLOAT_PRECISION_MAX; nPrecision++)
+	{
+		pEnd = formatFloatPrecision(buffer, value, nPrecision);
+		*pEnd = '\0';
+		if (strtof(buffer, NULL) == value)
+			break;
+	}
+	memcpy(p, buffer, pEnd - buffer);
+	return p + (pEnd - buffer);
+}
+
+const char * parseUint64(const char * p, const char * pEnd, uint64_t & value)
+{
+	const char * q = p;
+	uint64_t n = 0;
+	for (; q < pEnd && static_cast<unsigned>(*q - '0') < 10; q++)
+		n = n * 10 + static_cast<unsigned>(*q - '0');
+	if (q == p)
+		return NULL;
+	value = n;
+	return q;
+}
+
+static const char * parseFloatStrtof(const char * p, const char * pEnd, float & value)
+{
+	char buffer[2 * NUMBER_FORMAT_MAX_LENGTH];
+	const size_t n = min(static_cast<size_t>(pEnd - p), sizeof(buffer) - 1);
+	memcpy(buffer, p, n);
+	buffer[n] = '\0';
+	char * pParsed;
+	value = strtof(buffer, &pParsed);
+	return pParsed == buffer ? NULL : p + (pParsed - buffer);
+}
+
+const char * parseFloat(const char * p, const char * pEnd, float & value)
+{
+	const char * q = p;
+	const bool bNegative = q < pEnd && *q == '-';
+	if (q < pEnd && (*q == '-' || *q == '+'))
+		q++;
+
+	// Up to 19 significant digits, so that nMantissa * 10^nExponent is the exact value
+	uint64_t nMantissa = 0;
+	int nSignificant = 0, nExponent = 0, nDigits = 0;
+	bool bExact = true;
+	for (bool bFraction = false; q < pEnd; q++)
+	{
+		if (*q == '.' && !bFraction)
+		{
+			bFraction = true;
+			continue;
+		}
+		const unsigned nDigit = static_cast<unsigned>(*q - '0');
+		if (nDigit >= 10)
+			break;
+		nDigits++;
+		if (nSignificant < 19)
+		{
+			nMantissa = nMantissa * 10 + nDigit;
+			if (nMantissa != 0)
+				nSignificant++;
+			if (bFraction)
+				nExponent--;
+		}
+		else
+		{
+			bExact = bExact && nDigit == 0;
+			if (!bFraction)
+				nExponent++;
+		}
+	}
+	if (nDigits == 0)
+		return parseFloatStrtof(p, pEnd, value); // "nan", "inf" or not a number
+
+	if (q < pEnd && (*q == 'e' || *q == 'E'))
+	{
+		const char * pExponent = q + 1;
+		const bool bNegativeExponent = pExponent < pEnd && *pExponent == '-';
+		if (pExponent < pEnd && (*pExponent == '-' || *pExponent == '+'))
+			pExponent++;
+		uint64_t nValue;
+		const char * pExponentEnd = parseUint64(pExponent, pEnd, nValue);
+		if (pExponentEnd)
+		{
+			if (nValue > 1000)
+				return parseFloatStrtof(p, pEnd, value);
+			nExponent += bNegativeExponent ? -static_cast<int>(nValue) : static_cast<int>(nValue);
+			q = pExponentEnd;
+		}
+	}
+
+	// One correctly rounded double operation, then the rounding to float. The double may only
+	// round differently if it lies next to the halfway point between two floats, which is
+	// left to strtof(), as are subnormal and out of range values.
+	if (!bExact || nMantissa > (uint64_t(1) << 53) || nExponent > POW10_MAX || nExponent < -POW10_MAX)
+		return parseFloatStrtof(p, pEnd, value);
+	const double x = nExponent >= 0 ? static_cast<double>(nMantissa) * POW10[nExponent] : static_cast<double>(nMantissa) / POW10[-nExponent];
+	if (x != 0 && (x < FLT_MIN || x > FLT_MAX))
+		return parseFloatStrtof(p, pEnd, value);
+	uint64_t nBits;
+	memcpy(&nBits, &x, sizeof(nBits));
+	const uint64_t nDropped = nBits & ((uint64_t(1) << 29) - 1);
+	const uint64_t nHalfway = uint64_t(1) << 28;
+	if (nDropped + 1 >= nHalfway && nDropped <= nHalfway + 1)
+		return parseFloatStrtof(p, pEnd, value);
+
+	const float f = static_cast<float>(x);
+	value = bNegative ? -f : f;
+	return q;
+}
@@ -0,0 +1,30 @@
+#pragma once
+#include <cstdint>
+
+// Number formatting for the text logs, without streams, locales or allocations. The output
+// matches what std::ostream writes by default, so csv files stay byte-compatible.
+
+// Enough for any value written by the functions below
+const size_t NUMBER_FORMAT_MAX_LENGTH = 32;
+
+// Precision that selects the shortest representation that reads back as the same float
+const int FLOAT_PRECISION_SHORTEST = 0;
+// Precision of std::ostream
+const int FLOAT_PRECISION_DEFAULT = 6;
+const int FLOAT_PRECISION_MAX = 9;
+
+// Each writes the value at p and returns the end of the written characters. No terminating
+// null character is written.
+char * formatUint64(char * p, uint64_t value);
+
+// Same as printf("%.*g", nPrecision, value) for nPrecision in 1..9, or the shortest such
+// representation that round-trips for FLOAT_PRECISION_SHORTEST
+char * formatFloat(char * p, float value, int nPrecision = FLOAT_PRECISION_DEFAULT);
+
+// The reverse, for the readers of csv logs. Each parses the number at p, which ends at pEnd
+// or at the first character that does not belong to it, and returns the end of the number,
+// or NULL if there is none.
+const char * parseUint64(const char * p, const char * pEnd, uint64_t & value);
+
+// Same value as strtof(), without its locale and null-terminated input
+const char * parseFloat(const char * p, const char * pEnd, float & value);
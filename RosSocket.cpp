@@ -13,6 +13,7 @@ RosSocket::RosSocket() :
 	m_nSpinCounter(0),
 	m_PubSkeleton(m_strSkeletonTopic.c_str(), &m_MsgSkeleton),
 	m_PubIMU(m_strImuTopic.c_str(), &m_MsgIMU),
+	m_bDepthToBaseSet(false),
 	m_Thread(&RosSocket::threadProc, this)
 {	
 	std::for_each(m_TfBroadcasters.begin(), m_TfBroadcasters.end(), 
@@ -93,21 +94,22 @@ void RosSocket::threadProc()
 	
 }
 
-void RosSocket::publishMsgSkeleton(const k4abt_skeleton_t & skeleton, uint32_t id, uint64_t k4a_timestamp_usec)
+void RosSocket::publishMsgSkeleton(const BodyFrame & frame, size_t iBody)
 {
 	std::wstringstream wss;
-	const k4abt_joint_t & pelvis = skeleton.joints[K4ABT_JOINT_PELVIS];
-	const float & px = pelvis.position.xyz.x;
-	const float & py = pelvis.position.xyz.y;
-	const float & pz = pelvis.position.xyz.z;
+	const uint64_t k4a_timestamp_usec = frame.timestamp_usec;
+	const size_t iPelvis = BodyFrame::index(iBody, K4ABT_JOINT_PELVIS);
+	const float & px = frame.joints.px[iPelvis];
+	const float & py = frame.joints.py[iPelvis];
+	const float & pz = frame.joints.pz[iPelvis];
 	
-	const float & qw = pelvis.orientation.wxyz.w;
-	const float & qx = pelvis.orientation.wxyz.x;
-	const float & qy = pelvis.orientation.wxyz.y;
-	const float & qz = pelvis.orientation.wxyz.z;
+	const float & qw = frame.joints.qw[iPelvis];
+	const float & qx = frame.joints.qx[iPelvis];
+	const float & qy = frame.joints.qy[iPelvis];
+	const float & qz = frame.joints.qz[iPelvis];
 
 	// Sometimes, the quaternion has four zero components. If so, discard this skeleton.
-	if ((qw * qw + qx * qx + qy * qy + qz * qz) < 0.8) return;
+	if (!(frame.valid_joints[iBody] & (1u << K4ABT_JOINT_PELVIS))) return;
 
 	// Broadcast transform
 	static geometry_msgs::TransformStamped transform_stamped;
@@ -126,30 +128,40 @@ void RosSocket::publishMsgSkeleton(const k4abt_skeleton_t & skeleton, uint32_t i
 	m_TfBroadcasters[0].sendTransform(transform_stamped);
 	wss << L"Published pelvis tf with seq = " << transform_stamped.header.seq << L". ";
 
-	bool bSkeletonPubEnabled = false;
-	Config::Instance()->assign("RosSocket/skeletonPub/enabled", bSkeletonPubEnabled);
-	if (bSkeletonPubEnabled) 
+	if (m_bSkeletonPubEnabled) 
 	{
+		// Optionally express the skeleton in camera_base instead of the depth camera frame
+		const JointArrays * pJoints = &frame.joints;
+		m_MsgSkeleton.header.frame_id = m_strDepthFrame.c_str();
+		if (m_bSkeletonPubCameraBase)
+		{
+			std::lock_guard<std::mutex> lk(m_MutexTransform);
+			if (m_bDepthToBaseSet)
+			{
+				transformJoints(frame.joints, m_JointsBase, frame.num_bodies, m_DepthToBase);
+				pJoints = &m_JointsBase;
+				m_MsgSkeleton.header.frame_id = m_strCameraBaseFrame.c_str();
+			}
+		}
+
 		// Prepare skeleton message to be published
 		m_MsgSkeleton.header.seq++;
 		m_MsgSkeleton.header.stamp = timestampToROS(k4a_timestamp_usec);
-		m_MsgSkeleton.id = id;
+		m_MsgSkeleton.id = frame.body_ids[iBody];
 		m_MsgSkeleton.k4a_timestamp_usec = k4a_timestamp_usec;
 
-		geometry_msgs::Point jointPoints[K4ABT_JOINT_COUNT];
-		for (int i = 0; i < K4ABT_JOINT_COUNT; i++) {
-			geometry_msgs::Point & position_lhs = m_MsgSkeleton.poses[i].position;
-			const k4a_float3_t & position_rhs = skeleton.joints[i].position;
-			position_lhs.x = position_rhs.xyz.x;
-			position_lhs.y = position_rhs.xyz.y;
-			position_lhs.z = position_rhs.xyz.z;
-
-			geometry_msgs::Quaternion & orientation_lhs = m_MsgSkeleton.poses[i].orientation;
-			const k4a_quaternion_t & orientation_rhs = skeleton.joints[i].orientation;
-			orientation_lhs.x = orientation_rhs.wxyz.x;
-			orientation_lhs.y = orientation_rhs.wxyz.y;
-			orientation_lhs.z = orientation_rhs.wxyz.z;
-			orientation_lhs.w = orientation_rhs.wxyz.w;
+		for (int j = 0; j < K4ABT_JOINT_COUNT; j++) {
+			const size_t i = BodyFrame::index(iBody, j);
+			geometry_msgs::Point & position_lhs = m_MsgSkeleton.poses[j].position;
+			position_lhs.x = pJoints->px[i];
+			position_lhs.y = pJoints->py[i];
+			position_lhs.z = pJoints->pz[i];
+
+			geometry_msgs::Quaternion & orientation_lhs = m_MsgSkeleton.poses[j].orientation;
+			orientation_lhs.x = pJoints->qx[i];
+			orientation_lhs.y = pJoints->qy[i];
+			orientation_lhs.z = pJoints->qz[i];
+			orientation_lhs.w = pJoints->qw[i];
 		}
 
 		m_PubSkeleton.publish(&m_MsgSkeleton);
@@ -162,33 +174,36 @@ void RosSocket::publishMsgSkeleton(const k4abt_skeleton_t & skeleton, uint32_t i
 	if (m_funPrintMessage) m_funPrintMessage(SCT_RosSocket_Skeleton, wss.str().c_str());
 }
 
-void RosSocket::publishMsgImu(const k4a_imu_sample_t & imu_sample)
+void RosSocket::publishMsgImu(const k4a_imu_sample_t * pImuSamples, size_t nCount)
 {
+	if (nCount == 0) return;
 	std::wstringstream wss;
-	bool bImuPubEnabled = false;
-	Config::Instance()->assign("RosSocket/imuPub/enabled", bImuPubEnabled);
-
-	m_MsgIMU.header.stamp = timestampToROS(imu_sample.acc_timestamp_usec);
-	if (bImuPubEnabled)
+	if (m_bImuPubEnabled)
 	{ 
-		m_MsgIMU.header.seq++;
+		for (size_t i = 0; i < nCount; i++)
+		{
+			const k4a_imu_sample_t & imu_sample = pImuSamples[i];
+			m_MsgIMU.header.stamp = timestampToROS(imu_sample.acc_timestamp_usec);
+			m_MsgIMU.header.seq++;
 
-		m_MsgIMU.angular_velocity.x = -1.0 * imu_sample.gyro_sample.xyz.x;
-		m_MsgIMU.angular_velocity.y = 1.0 * imu_sample.gyro_sample.xyz.y;
-		m_MsgIMU.angular_velocity.z = -1.0 * imu_sample.gyro_sample.xyz.z;
+			m_MsgIMU.angular_velocity.x = -1.0 * imu_sample.gyro_sample.xyz.x;
+			m_MsgIMU.angular_velocity.y = 1.0 * imu_sample.gyro_sample.xyz.y;
+			m_MsgIMU.angular_velocity.z = -1.0 * imu_sample.gyro_sample.xyz.z;
 
-		m_MsgIMU.linear_acceleration.x = -1.0 * imu_sample.acc_sample.xyz.x;
-		m_MsgIMU.linear_acceleration.y = 1.0 * imu_sample.acc_sample.xyz.y;
-		m_MsgIMU.linear_acceleration.z = -1.0 * imu_sample.acc_sample.xyz.z;
+			m_MsgIMU.linear_acceleration.x = -1.0 * imu_sample.acc_sample.xyz.x;
+			m_MsgIMU.linear_acceleration.y = 1.0 * imu_sample.acc_sample.xyz.y;
+			m_MsgIMU.linear_acceleration.z = -1.0 * imu_sample.acc_sample.xyz.z;
 
-		m_MsgIMU.orientation_covariance[0] = -1.0;
+			m_MsgIMU.orientation_covariance[0] = -1.0;
 
-		m_PubIMU.publish(&m_MsgIMU);
+			m_PubIMU.publish(&m_MsgIMU);
+		}
 
 		wss << L"Published IMU msg with seq = " << m_MsgIMU.header.seq;
 	}
 	else
 	{
+		m_MsgIMU.header.stamp = timestampToROS(pImuSamples[nCount - 1].acc_timestamp_usec);
 		wss << L"IMU msg publisher disabled.";
 	}
 	if (m_funPrintMessage) m_funPrintMessage(SCT_RosSocket_IMU, wss.str().c_str());
@@ -217,6 +232,16 @@ void RosSocket::broadcastDepthTf(const k4a_calibration_t * k4a_calibration)
 	static_transform.transform.rotation.w = depth_rotation.w();
 
 	m_TfBroadcasters[1].sendTransform(static_transform);
+
+	// Keep the same transform for skeletons published in camera_base
+	std::lock_guard<std::mutex> lk(m_MutexTransform);
+	m_DepthToBase = makeRigidTransform(
+		static_cast<float>(depth_rotation.w()), static_cast<float>(depth_rotation.x()),
+		static_cast<float>(depth_rotation.y()), static_cast<float>(depth_rotation.z()),
+		static_cast<float>(static_transform.transform.translation.x),
+		static_cast<float>(static_transform.transform.translation.y),
+		static_cast<float>(static_transform.transform.translation.z));
+	m_bDepthToBaseSet = true;
 }
 
 void RosSocket::broadcastImuTf(const k4a_calibration_t * k4a_calibration)
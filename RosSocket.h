@@ -5,6 +5,8 @@
 #include <mutex>
 #include <chrono>
 #include <array>
+#include "BodyFramePool.h"
+#include "SkeletonKernels.h"
 #include "gait_training_robot/HumanSkeletonAzure.h"
 #include "gait_training_robot/ImuAzure.h"
 #include "rosserial_windows/ros_lib/sensor_msgs/Imu.h"
@@ -31,6 +33,11 @@ private:
 
 	std::string m_strSkeletonTopic = "/skeleton";
 	std::string m_strImuTopic = "/kinect_azure_imu";
+
+	// Read per frame and per IMU sample
+	ConfigParam<bool> m_bSkeletonPubEnabled{ "RosSocket/skeletonPub/enabled", false };
+	ConfigParam<bool> m_bSkeletonPubCameraBase{ "RosSocket/skeletonPub/cameraBase", false };
+	ConfigParam<bool> m_bImuPubEnabled{ "RosSocket/imuPub/enabled", false };
 public:
 	RosSocket();
 	~RosSocket();
@@ -38,8 +45,8 @@ public:
 	void updateStatus();
 	RosSocketStatus_t getStatus();
 	void threadProc();
-	void publishMsgSkeleton(const k4abt_skeleton_t & skeleton, uint32_t id, uint64_t k4a_timestamp_usec);
-	void publishMsgImu(const k4a_imu_sample_t & imu_sample);
+	void publishMsgSkeleton(const BodyFrame & frame, size_t iBody);
+	void publishMsgImu(const k4a_imu_sample_t * pImuSamples, size_t nCount);
 	
 	// reference: https://github.com/microsoft/Azure_Kinect_ROS_Driver/blob/melodic/src/k4a_calibration_transform_data.cpp
 	void broadcastDepthTf(const k4a_calibration_t * k4a_calibration);
@@ -68,6 +75,12 @@ private:
 	std::array<tf::TransformBroadcaster, 3> m_TfBroadcasters;
 	ros::Time				m_tStartTime;
 
+	// Depth camera to camera_base, set by broadcastDepthTf()
+	std::mutex              m_MutexTransform;
+	bool                    m_bDepthToBaseSet;
+	RigidTransform          m_DepthToBase;
+	JointArrays             m_JointsBase;
+
 	std::mutex              m_Mutex;
 	std::thread             m_Thread;
 };
@@ -0,0 +1,105 @@
+#include "SensorSource.h"
+#include "Config.h"
+#include "SyntheticSource.h"
+#include "CsvReplaySource.h"
+#include "MkvPlaybackSource.h"
+
+SensorSource::SensorSource(
+	std::function<void(static_control_type, const wchar_t*)> funPrintMessage,
+	FrameBus & bus
+) :
+	m_bTerminating(false),
+	m_fSpeed(1.0),
+	m_bEpochSet(false),
+	m_nEpochDeviceUsec(0),
+	m_funPrintMessage(funPrintMessage),
+	m_Bus(bus)
+{
+	Config::Instance()->assign("source/speed", m_fSpeed);
+}
+
+SensorSource::~SensorSource()
+{
+	stop();
+}
+
+void SensorSource::start()
+{
+	if (m_ThreadSkeleton.joinable() || m_ThreadImu.joinable())
+		return;
+	m_bTerminating = false;
+	resetEpoch();
+	m_ThreadSkeleton = std::thread(&SensorSource::SkeletonProc, this);
+	m_ThreadImu = std::thread(&SensorSource::ImuProc, this);
+}
+
+void SensorSource::stop()
+{
+	m_bTerminating = true;
+	if (m_ThreadSkeleton.joinable())
+		m_ThreadSkeleton.join();
+	if (m_ThreadImu.joinable())
+		m_ThreadImu.join();
+}
+
+SensorSource * SensorSource::create(
+	std::function<void(static_control_type, const wchar_t*)> funPrintMessage,
+	FrameBus & bus
+)
+{
+	std::string strType = "kinect";
+	Config::Instance()->assign("source/type", strType);
+
+	if (strType.compare("synthetic") == 0)
+		return new SyntheticSource(funPrintMessage, bus);
+	else if (strType.compare("csv") == 0)
+		return new CsvReplaySource(funPrintMessage, bus);
+	else if (strType.compare("mkv") == 0)
+		return new MkvPlaybackSource(funPrintMessage, bus);
+	else
+		return nullptr;
+}
+
+std::chrono::steady_clock::time_point SensorSource::getDeadline(uint64_t nDeviceUsec)
+{
+	std::lock_guard<std::mutex> lk(m_MutexEpoch);
+	if (!m_bEpochSet)
+	{
+		m_nEpochDeviceUsec = nDeviceUsec;
+		m_tEpoch = std::chrono::steady_clock::now();
+		m_bEpochSet = true;
+	}
+	if (nDeviceUsec <= m_nEpochDeviceUsec)
+		return m_tEpoch;
+	return m_tEpoch + std::chrono::microseconds(
+		static_cast<int64_t>((nDeviceUsec - m_nEpochDeviceUsec) / m_fSpeed));
+}
+
+bool SensorSource::waitForDeviceTime(uint64_t nDeviceUsec)
+{
+	if (m_fSpeed <= 0.0)
+		return !m_bTerminating;
+
+	// Sleep in short slices so that stop() is not held up by a long gap in the data
+	std::chrono::steady_clock::time_point tDeadline = getDeadline(nDeviceUsec);
+	const auto tSlice = std::chrono::milliseconds(100);
+	while (!m_bTerminating)
+	{
+		auto now = std::chrono::steady_clock::now();
+		if (now >= tDeadline)
+			break;
+		std::this_thread::sleep_for(min(tDeadline - now, std::chrono::steady_clock::duration(tSlice)));
+	}
+	return !m_bTerminating;
+}
+
+bool SensorSource::isDeviceTimeDue(uint64_t nDeviceUsec)
+{
+	return m_fSpeed <= 0.0 || std::chrono::steady_clock::now() >= getDeadline(nDeviceUsec);
+}
+
+void SensorSource::resetEpoch()
+{
+	std::lock_guard<std::mutex> lk(m_MutexEpoch);
+	m_bEpochSet = false;
+}
@@ -0,0 +1,66 @@
+#pragma once
+#include "stdafx.h"
+#include <string>
+#include <thread>
+#include <mutex>
+#include <chrono>
+#include "FrameBus.h"
+
+// A source of body and IMU data other than the live Kinect device, e.g. a synthetic
+// generator or a replay of a recorded session. It publishes its data on the same
+// frame bus as KinectAzure, so everything downstream is unaware of where the data came from.
+// A derived class implements SkeletonProc() and ImuProc(), which run on their own threads
+// between start() and stop() and must return once m_bTerminating is set. Its destructor
+// calls stop(), as the threads would otherwise outlive the overrides they run.
+class SensorSource
+{
+protected:
+	bool                    m_bTerminating;
+	std::thread             m_ThreadSkeleton;
+	std::thread             m_ThreadImu;
+
+	// Pacing: device timestamps are mapped to wall-clock time relative to the first
+	// timestamp seen by either thread. A speed of 0 delivers as fast as possible.
+	double                  m_fSpeed;
+	std::mutex              m_MutexEpoch;
+	bool                    m_bEpochSet;
+	uint64_t                m_nEpochDeviceUsec;
+	std::chrono::steady_clock::time_point m_tEpoch;
+
+	std::function<void(static_control_type, const wchar_t *)>   m_funPrintMessage;
+	FrameBus &              m_Bus;
+
+public:
+	SensorSource(
+		std::function<void(static_control_type, const wchar_t*)> funPrintMessage,
+		FrameBus & bus
+	);
+	virtual ~SensorSource();
+
+	void start();
+	void stop();
+
+	// Calibration of the recorded or simulated device, or nullptr if there is none.
+	virtual const k4a_calibration_t * getCalibration() { return nullptr; }
+
+	// Creates the source selected by "source/type" in the config file.
+	// Returns nullptr if the live Kinect device is to be used.
+	static SensorSource * create(
+		std::function<void(static_control_type, const wchar_t*)> funPrintMessage,
+		FrameBus & bus
+	);
+
+protected:
+	virtual void SkeletonProc() = 0;
+	virtual void ImuProc() = 0;
+
+	// Blocks until the wall-clock time that corresponds to the device timestamp.
+	// Returns false if the source is terminating.
+	bool waitForDeviceTime(uint64_t nDeviceUsec);
+	// Returns true if the wall-clock time that corresponds to the device timestamp has passed.
+	bool isDeviceTimeDue(uint64_t nDeviceUsec);
+	void resetEpoch();
+
+private:
+	std::chrono::steady_clock::time_point getDeadline(uint64_t nDeviceUsec);
+};
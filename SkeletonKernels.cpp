@@ -0,0 +1,114 @@
+#include "SkeletonKernels.h"
+#include <xmmintrin.h>
+
+static_assert(JOINT_STRIDE % 4 == 0 && JOINT_STRIDE >= K4ABT_JOINT_COUNT, "JOINT_STRIDE must be a multiple of the SSE width");
+static_assert(JOINT_STRIDE <= 32, "valid joint masks are 32 bit wide");
+
+RigidTransform makeRigidTransform(float rw, float rx, float ry, float rz, float tx, float ty, float tz)
+{
+	RigidTransform transform;
+	transform.R[0] = 1 - 2 * (ry * ry + rz * rz);
+	transform.R[1] = 2 * (rx * ry - rz * rw);
+	transform.R[2] = 2 * (rx * rz + ry * rw);
+	transform.R[3] = 2 * (rx * ry + rz * rw);
+	transform.R[4] = 1 - 2 * (rx * rx + rz * rz);
+	transform.R[5] = 2 * (ry * rz - rx * rw);
+	transform.R[6] = 2 * (rx * rz - ry * rw);
+	transform.R[7] = 2 * (ry * rz + rx * rw);
+	transform.R[8] = 1 - 2 * (rx * rx + ry * ry);
+	transform.t[0] = tx;
+	transform.t[1] = ty;
+	transform.t[2] = tz;
+	transform.r[0] = rw;
+	transform.r[1] = rx;
+	transform.r[2] = ry;
+	transform.r[3] = rz;
+	return transform;
+}
+
+void scaleJointPositions(JointArrays & joints, size_t nBodies, float fScale)
+{
+	const size_t n = nBodies * JOINT_STRIDE;
+	const __m128 scale = _mm_set1_ps(fScale);
+	for (size_t i = 0; i < n; i += 4)
+	{
+		_mm_store_ps(joints.px + i, _mm_mul_ps(_mm_load_ps(joints.px + i), scale));
+		_mm_store_ps(joints.py + i, _mm_mul_ps(_mm_load_ps(joints.py + i), scale));
+		_mm_store_ps(joints.pz + i, _mm_mul_ps(_mm_load_ps(joints.pz + i), scale));
+	}
+}
+
+void transformJoints(const JointArrays & src, JointArrays & dst, size_t nBodies, const RigidTransform & transform)
+{
+	const size_t n = nBodies * JOINT_STRIDE;
+	const float * R = transform.R;
+	const __m128 r00 = _mm_set1_ps(R[0]), r01 = _mm_set1_ps(R[1]), r02 = _mm_set1_ps(R[2]);
+	const __m128 r10 = _mm_set1_ps(R[3]), r11 = _mm_set1_ps(R[4]), r12 = _mm_set1_ps(R[5]);
+	const __m128 r20 = _mm_set1_ps(R[6]), r21 = _mm_set1_ps(R[7]), r22 = _mm_set1_ps(R[8]);
+	const __m128 tx = _mm_set1_ps(transform.t[0]), ty = _mm_set1_ps(transform.t[1]), tz = _mm_set1_ps(transform.t[2]);
+	const __m128 rw = _mm_set1_ps(transform.r[0]), rx = _mm_set1_ps(transform.r[1]);
+	const __m128 ry = _mm_set1_ps(transform.r[2]), rz = _mm_set1_ps(transform.r[3]);
+
+	for (size_t i = 0; i < n; i += 4)
+	{
+		// p' = R p + t
+		__m128 px = _mm_load_ps(src.px + i), py = _mm_load_ps(src.py + i), pz = _mm_load_ps(src.pz + i);
+		__m128 x = _mm_add_ps(_mm_add_ps(_mm_mul_ps(r00, px), _mm_mul_ps(r01, py)), _mm_add_ps(_mm_mul_ps(r02, pz), tx));
+		__m128 y = _mm_add_ps(_mm_add_ps(_mm_mul_ps(r10, px), _mm_mul_ps(r11, py)), _mm_add_ps(_mm_mul_ps(r12, pz), ty));
+		__m128 z = _mm_add_ps(_mm_add_ps(_mm_mul_ps(r20, px), _mm_mul_ps(r21, py)), _mm_add_ps(_mm_mul_ps(r22, pz), tz));
+
+		// q' = r q
+		__m128 qw = _mm_load_ps(src.qw + i), qx = _mm_load_ps(src.qx + i);
+		__m128 qy = _mm_load_ps(src.qy + i), qz = _mm_load_ps(src.qz + i);
+		__m128 w = _mm_sub_ps(_mm_sub_ps(_mm_mul_ps(rw, qw), _mm_mul_ps(rx, qx)), _mm_add_ps(_mm_mul_ps(ry, qy), _mm_mul_ps(rz, qz)));
+		__m128 a = _mm_add_ps(_mm_add_ps(_mm_mul_ps(rw, qx), _mm_mul_ps(rx, qw)), _mm_sub_ps(_mm_mul_ps(ry, qz), _mm_mul_ps(rz, qy)));
+		__m128 b = _mm_add_ps(_mm_sub_ps(_mm_mul_ps(rw, qy), _mm_mul_ps(rx, qz)), _mm_add_ps(_mm_mul_ps(ry, qw), _mm_mul_ps(rz, qx)));
+		__m128 c = _mm_add_ps(_mm_sub_ps(_mm_mul_ps(rw, qz), _mm_mul_ps(ry, qx)), _mm_add_ps(_mm_mul_ps(rx, qy), _mm_mul_ps(rz, qw)));
+
+		_mm_store_ps(dst.px + i, x);
+		_mm_store_ps(dst.py + i, y);
+		_mm_store_ps(dst.pz + i, z);
+		_mm_store_ps(dst.qw + i, w);
+		_mm_store_ps(dst.qx + i, a);
+		_mm_store_ps(dst.qy + i, b);
+		_mm_store_ps(dst.qz + i, c);
+	}
+}
+
+void checkOrientationNorms(const JointArrays & joints, size_t nBodies, float fMinNorm2, uint32_t * pValidJoints)
+{
+	const __m128 threshold = _mm_set1_ps(fMinNorm2);
+	const uint32_t nJointMask = (1u << K4ABT_JOINT_COUNT) - 1;
+	for (size_t iBody = 0; iBody < nBodies; iBody++)
+	{
+		uint32_t nValid = 0;
+		for (size_t j = 0; j < JOINT_STRIDE; j += 4)
+		{
+			size_t i = iBody * JOINT_STRIDE + j;
+			__m128 qw = _mm_load_ps(joints.qw + i), qx = _mm_load_ps(joints.qx + i);
+			__m128 qy = _mm_load_ps(joints.qy + i), qz = _mm_load_ps(joints.qz + i);
+			__m128 norm2 = _mm_add_ps(_mm_add_ps(_mm_mul_ps(qw, qw), _mm_mul_ps(qx, qx)),
+				_mm_add_ps(_mm_mul_ps(qy, qy), _mm_mul_ps(qz, qz)));
+			nValid |= static_cast<uint32_t>(_mm_movemask_ps(_mm_cmpgt_ps(norm2, threshold))) << j;
+		}
+		pValidJoints[iBody] = nValid & nJointMask;
+	}
+}
+
+void computeHorizontalDistances(const JointArrays & joints, size_t nBodies, int iJoint, float * pDistances)
+{
+	// Gather the joint of four bodies at a time; the lanes past nBodies are computed but not stored
+	for (size_t iBody = 0; iBody < nBodies; iBody += 4)
+	{
+		alignas(16) float x[4] = {}, z[4] = {}, d[4];
+		for (size_t k = 0; k < 4 && iBody + k < nBodies; k++)
+		{
+			x[k] = joints.px[(iBody + k) * JOINT_STRIDE + iJoint];
+			z[k] = joints.pz[(iBody + k) * JOINT_STRIDE + iJoint];
+		}
+		__m128 px = _mm_load_ps(x), pz = _mm_load_ps(z);
+		_mm_store_ps(d, _mm_sqrt_ps(_mm_add_ps(_mm_mul_ps(px, px), _mm_mul_ps(pz, pz))));
+		for (size_t k = 0; k < 4 && iBody + k < nBodies; k++)
+			pDistances[iBody + k] = d[k];
+	}
+}
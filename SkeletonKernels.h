@@ -0,0 +1,30 @@
+#pragma once
+#include "BodyFramePool.h"
+
+// Squared norm above which a joint orientation is considered valid. The tracker
+// sometimes reports quaternions with four zero components.
+const float MIN_ORIENTATION_NORM2 = 0.8f;
+
+// Rigid transform p' = R p + t, q' = r q, e.g. from the depth camera to camera_base
+struct RigidTransform
+{
+	float                   R[9];   // rotation matrix, row-major
+	float                   t[3];   // translation in meters
+	float                   r[4];   // the same rotation as quaternion w, x, y, z
+};
+
+RigidTransform makeRigidTransform(float rw, float rx, float ry, float rz, float tx, float ty, float tz);
+
+// SSE kernels over all joints of the first nBodies bodies of a JointArrays.
+
+// Multiplies the joint positions by fScale, e.g. 0.001 to convert millimeters to meters.
+void scaleJointPositions(JointArrays & joints, size_t nBodies, float fScale);
+
+// Applies a rigid transform to the joint positions and orientations. src and dst may be the same.
+void transformJoints(const JointArrays & src, JointArrays & dst, size_t nBodies, const RigidTransform & transform);
+
+// Sets bit j of pValidJoints[i] if joint j of body i has a squared orientation norm above fMinNorm2.
+void checkOrientationNorms(const JointArrays & joints, size_t nBodies, float fMinNorm2, uint32_t * pValidJoints);
+
+// Distance of joint iJoint of every body from the camera in the x-z-plane.
+void computeHorizontalDistances(const JointArrays & joints, size_t nBodies, int iJoint, float * pDistances);
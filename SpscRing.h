@@ -0,0 +1,75 @@
+#pragma once
+#include <atomic>
+#include <array>
+#include <cstddef>
+
+// Fixed-capacity lock-free ring buffer for a single producer thread and a single consumer thread.
+// The storage is allocated once with the ring; N must be a power of two.
+// The consumer reads elements in place through peek(), which returns the longest contiguous
+// run of readable elements, and then releases them with consume().
+template <typename T, size_t N>
+class SpscRing
+{
+	static_assert(N >= 2 && (N & (N - 1)) == 0, "SpscRing capacity must be a power of two");
+
+private:
+	std::array<T, N>        m_Buffer;
+	// Keep the indices on separate cache lines so the two threads do not contend
+	alignas(64) std::atomic<size_t> m_nHead; // next element to read, written by the consumer
+	alignas(64) std::atomic<size_t> m_nTail; // next element to write, written by the producer
+
+public:
+	SpscRing() : m_nHead(0), m_nTail(0) {}
+
+	static size_t capacity() { return N; }
+
+	size_t size() const
+	{
+		return m_nTail.load(std::memory_order_acquire) - m_nHead.load(std::memory_order_acquire);
+	}
+
+	bool empty() const { return size() == 0; }
+
+	// Producer: appends one element. Returns false if the ring is full.
+	bool push(const T & value)
+	{
+		size_t nTail = m_nTail.load(std::memory_order_relaxed);
+		if (nTail - m_nHead.load(std::memory_order_acquire) == N)
+			return false;
+		m_Buffer[nTail & (N - 1)] = value;
+		m_nTail.store(nTail + 1, std::memory_order_release);
+		return true;
+	}
+
+	// Producer: returns a slot to write the next element into, or nullptr if the ring is full.
+	// The element becomes visible to the consumer with commit().
+	T * reserve()
+	{
+		size_t nTail = m_nTail.load(std::memory_order_relaxed);
+		if (nTail - m_nHead.load(std::memory_order_acquire) == N)
+			return nullptr;
+		return &m_Buffer[nTail & (N - 1)];
+	}
+
+	void commit()
+	{
+		m_nTail.store(m_nTail.load(std::memory_order_relaxed) + 1, std::memory_order_release);
+	}
+
+	// Consumer: points pData at the oldest element and returns how many elements follow it
+	// contiguously in memory (0 if the ring is empty).
+	size_t peek(const T *& pData) const
+	{
+		size_t nHead = m_nHead.load(std::memory_order_relaxed);
+		size_t nAvailable = m_nTail.load(std::memory_order_acquire) - nHead;
+		size_t iHead = nHead & (N - 1);
+		pData = &m_Buffer[iHead];
+		return nAvailable < N - iHead ? nAvailable : N - iHead;
+	}
+
+	// Consumer: releases the n oldest elements.
+	void consume(size_t n)
+	{
+		m_nHead.store(m_nHead.load(std::memory_order_relaxed) + n, std::memory_order_release);
+	}
+};
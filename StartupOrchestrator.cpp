@@ -0,0 +1,160 @@
+#include "StartupOrchestrator.h"
+#include "CsvLogger.h"
+#include <cstring>
+#include <string>
+
+StartupOrchestrator::StartupOrchestrator(std::function<void(static_control_type, const wchar_t*)> funPrintMessage) :
+	m_tStart(std::chrono::steady_clock::now()),
+	m_bTerminating(false),
+	m_funPrintMessage(funPrintMessage)
+{
+	for (auto & entry : m_Entries)
+		entry = { STS_Pending, 0.0, 0.0 };
+}
+
+StartupOrchestrator::~StartupOrchestrator()
+{
+	shutdown();
+}
+
+void StartupOrchestrator::run(startup_subsystem ss, std::initializer_list<startup_subsystem> dependencies, std::function<bool()> funStart)
+{
+	std::vector<startup_subsystem> vecDependencies(dependencies);
+	std::lock_guard<std::mutex> lk(m_Mutex);
+	m_vecThreads.emplace_back([this, ss, vecDependencies, funStart]() {
+		bool bDependenciesReady;
+		{
+			std::unique_lock<std::mutex> lk(m_Mutex);
+			auto isSettled = [this](startup_subsystem dep) { return m_Entries[dep].state == STS_Ready || m_Entries[dep].state == STS_Failed; };
+			m_CondChanged.wait(lk, [this, &vecDependencies, &isSettled] {
+				return m_bTerminating || std::all_of(vecDependencies.begin(), vecDependencies.end(), isSettled);
+			});
+			if (m_bTerminating)
+				return;
+			bDependenciesReady = std::all_of(vecDependencies.begin(), vecDependencies.end(),
+				[this](startup_subsystem dep) { return m_Entries[dep].state == STS_Ready; });
+		}
+		if (bDependenciesReady)
+		{
+			begin(ss);
+			signal(ss, funStart());
+		}
+		else
+			signal(ss, false);
+	});
+}
+
+void StartupOrchestrator::begin(startup_subsystem ss)
+{
+	std::lock_guard<std::mutex> lk(m_Mutex);
+	if (m_Entries[ss].state == STS_Pending)
+		setState(ss, STS_Started);
+}
+
+void StartupOrchestrator::signal(startup_subsystem ss, bool bReady)
+{
+	Entry entry;
+	{
+		std::lock_guard<std::mutex> lk(m_Mutex);
+		if (m_Entries[ss].state == STS_Ready || m_Entries[ss].state == STS_Failed)
+			return;
+		setState(ss, bReady ? STS_Ready : STS_Failed);
+		entry = m_Entries[ss];
+	}
+	m_CondChanged.notify_all();
+	report(ss, entry);
+}
+
+std::wstring StartupOrchestrator::getTimeline()
+{
+	std::lock_guard<std::mutex> lk(m_Mutex);
+	std::wstring wstrTimeline = L"Startup [ms]:";
+	for (int i = 0; i < SS_Count; i++)
+	{
+		const Entry & entry = m_Entries[i];
+		const char * pszName = getSubsystemString(static_cast<startup_subsystem>(i));
+		wstrTimeline += L" " + std::wstring(pszName, pszName + strlen(pszName)) + L" ";
+		if (entry.state == STS_Ready)
+			wstrTimeline += std::to_wstring(static_cast<int>(entry.fReadyMs));
+		else if (entry.state == STS_Failed)
+			wstrTimeline += L"failed";
+		else
+			wstrTimeline += L"-";
+	}
+	return wstrTimeline;
+}
+
+bool StartupOrchestrator::isReady(startup_subsystem ss)
+{
+	std::lock_guard<std::mutex> lk(m_Mutex);
+	return m_Entries[ss].state == STS_Ready;
+}
+
+void StartupOrchestrator::shutdown()
+{
+	std::vector<std::thread> vecThreads;
+	{
+		std::lock_guard<std::mutex> lk(m_Mutex);
+		m_bTerminating = true;
+		vecThreads.swap(m_vecThreads);
+	}
+	m_CondChanged.notify_all();
+	for (auto & thread : vecThreads)
+		thread.join();
+}
+
+double StartupOrchestrator::elapsedMs() const
+{
+	return std::chrono::duration<double, std::milli>(std::chrono::steady_clock::now() - m_tStart).count();
+}
+
+void StartupOrchestrator::setState(startup_subsystem ss, startup_state state)
+{
+	Entry & entry = m_Entries[ss];
+	double fNow = elapsedMs();
+	// A subsystem that signals without begin() is timed from its signal
+	if (entry.state == STS_Pending)
+		entry.fStartMs = fNow;
+	if (state == STS_Ready || state == STS_Failed)
+		entry.fReadyMs = fNow;
+	entry.state = state;
+}
+
+void StartupOrchestrator::report(startup_subsystem ss, const Entry & entry)
+{
+	static const char * subsystem;
+	static float start_msec, ready_msec;
+	static uint64_t ready;
+	static std::mutex mutexLogger;
+	static CsvLogger logger("startup", vector_header_value_t{
+		{"subsystem", &subsystem},
+		{"start_msec", &start_msec},
+		{"ready_msec", &ready_msec},
+		{"ready", &ready}
+		});
+	{
+		std::lock_guard<std::mutex> lk(mutexLogger);
+		subsystem = getSubsystemString(ss);
+		start_msec = static_cast<float>(entry.fStartMs);
+		ready_msec = static_cast<float>(entry.fReadyMs);
+		ready = entry.state == STS_Ready ? 1 : 0;
+		logger.log();
+	}
+
+	if (m_funPrintMessage) m_funPrintMessage(SCT_Startup, getTimeline().c_str());
+}
+
+const char * StartupOrchestrator::getSubsystemString(startup_subsystem ss)
+{
+	switch (ss)
+	{
+	case SS_Window: return "window";
+	case SS_SyncSocket: return "sync";
+	case SS_Device: return "device";
+	case SS_Tracker: return "tracker";
+	case SS_RosSocket: return "ros";
+	case SS_FirstBodyFrame: return "body";
+	case SS_FirstSkeleton: return "skeleton";
+	default: return "unknown";
+	}
+}
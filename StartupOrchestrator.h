@@ -0,0 +1,84 @@
+#pragma once
+#include "stdafx.h"
+#include <array>
+#include <chrono>
+#include <condition_variable>
+#include <initializer_list>
+#include <mutex>
+#include <string>
+#include <thread>
+#include <vector>
+
+// Subsystems brought up at startup, in the order they are listed in the timeline
+enum startup_subsystem
+{
+	SS_Window = 0,
+	SS_SyncSocket,
+	SS_Device,
+	SS_Tracker,
+	SS_RosSocket,
+	SS_FirstBodyFrame,      // first body frame on the frame bus
+	SS_FirstSkeleton,       // first skeleton published to ROS
+	SS_Count
+};
+
+enum startup_state
+{
+	STS_Pending = 0,
+	STS_Started,
+	STS_Ready,
+	STS_Failed
+};
+
+// Brings the subsystems up concurrently. A subsystem is either started as a task that
+// runs on its own thread once the subsystems it depends on are ready, or it reports its
+// progress itself with begin() and signal(). The time at which every subsystem started and
+// became ready is shown in the status list and written to the "startup" csv file.
+class StartupOrchestrator
+{
+private:
+	struct Entry
+	{
+		startup_state       state;
+		double              fStartMs;
+		double              fReadyMs;
+	};
+
+	std::chrono::steady_clock::time_point m_tStart;
+	std::mutex              m_Mutex;
+	std::condition_variable m_CondChanged;
+	std::array<Entry, SS_Count> m_Entries;
+	std::vector<std::thread> m_vecThreads;
+	bool                    m_bTerminating;
+
+	// Status update
+	std::function<void(static_control_type, const wchar_t *)>   m_funPrintMessage;
+
+public:
+	explicit StartupOrchestrator(std::function<void(static_control_type, const wchar_t*)> funPrintMessage);
+	~StartupOrchestrator();
+
+	// Runs funStart on a new thread once all dependencies are ready. The subsystem is ready
+	// when funStart returns true, and failed when it returns false or a dependency failed.
+	void run(startup_subsystem ss, std::initializer_list<startup_subsystem> dependencies, std::function<bool()> funStart);
+
+	// For subsystems that come up by themselves. Only the first call of each has an effect.
+	void begin(startup_subsystem ss);
+	void signal(startup_subsystem ss, bool bReady = true);
+
+	bool isReady(startup_subsystem ss);
+
+	// Ready time of every subsystem, for the status list
+	std::wstring getTimeline();
+
+	// Stops waiting for dependencies and joins the task threads
+	void shutdown();
+
+	static const char * getSubsystemString(startup_subsystem ss);
+
+private:
+	double elapsedMs() const;
+	// Expects m_Mutex to be held
+	void setState(startup_subsystem ss, startup_state state);
+	void report(startup_subsystem ss, const Entry & entry);
+};
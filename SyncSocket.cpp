@@ -38,7 +38,7 @@ bool SyncSocket::init(HWND hWnd)
 			L"WSAStartup failed with error %d\n Continue anyway?", iResult);
 		int msgboxID = MessageBox(hWnd, pszText, NULL, MB_YESNO | MB_ICONWARNING);
 		if (msgboxID == IDNO)
-			DestroyWindow(hWnd);
+			PostMessage(hWnd, WM_CLOSE, 0, 0);
 		m_bWs2Loaded = false;
 		return false;
 	}
@@ -54,7 +54,7 @@ bool SyncSocket::init(HWND hWnd)
 			L"socket failed with error %d\n Continue anyway?", iResult);
 		int msgboxID = MessageBox(hWnd, pszText, NULL, MB_YESNO | MB_ICONWARNING);
 		if (msgboxID == IDNO)
-			DestroyWindow(hWnd);
+			PostMessage(hWnd, WM_CLOSE, 0, 0);
 		releaseResource();
 		return false;
 	}
@@ -73,7 +73,7 @@ bool SyncSocket::init(HWND hWnd)
 			L"ioctlsocket failed with error %d\n Continue anyway?", WSAGetLastError());
 		int msgboxID = MessageBox(hWnd, pszText, NULL, MB_YESNO | MB_ICONWARNING);
 		if (msgboxID == IDNO)
-			DestroyWindow(hWnd);
+			PostMessage(hWnd, WM_CLOSE, 0, 0);
 		releaseResource();
 		return false;
 	}
@@ -93,7 +93,7 @@ bool SyncSocket::init(HWND hWnd)
 			L"bind failed with error %d\n Continue anyway?", WSAGetLastError());
 		int msgboxID = MessageBox(hWnd, pszText, NULL, MB_YESNO | MB_ICONWARNING);
 		if (msgboxID == IDNO)
-			DestroyWindow(hWnd);
+			PostMessage(hWnd, WM_CLOSE, 0, 0);
 		releaseResource();
 		return false;
 	}
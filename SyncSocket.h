@@ -45,6 +45,7 @@ public:
 public:
 	SyncSocket();
 	~SyncSocket();
+	// Safe to call from any thread; asks the window to close via WM_CLOSE if the user gives up
 	bool init(HWND hWnd);
 	OdroidTimestamp receive(SportSolePacket * pPacket = NULL);
 protected:
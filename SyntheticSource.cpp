@@ -0,0 +1,171 @@
+#include "SyntheticSource.h"
+#include "Config.h"
+#include "KinectAzure.h"
+#include "SkeletonKernels.h"
+
+// Joint positions of a standing body facing the camera, relative to the pelvis, in meters
+// (depth camera frame: x right, y down, z away from the camera).
+static const float c_JointTemplate[K4ABT_JOINT_COUNT][3] = {
+	{  0.00f,  0.00f,  0.00f }, // PELVIS
+	{  0.00f, -0.20f,  0.00f }, // SPINE_NAVAL
+	{  0.00f, -0.40f,  0.00f }, // SPINE_CHEST
+	{  0.00f, -0.60f,  0.00f }, // NECK
+	{  0.04f, -0.58f,  0.00f }, // CLAVICLE_LEFT
+	{  0.18f, -0.55f,  0.00f }, // SHOULDER_LEFT
+	{  0.22f, -0.30f,  0.00f }, // ELBOW_LEFT
+	{  0.24f, -0.05f,  0.00f }, // WRIST_LEFT
+	{ -0.04f, -0.58f,  0.00f }, // CLAVICLE_RIGHT
+	{ -0.18f, -0.55f,  0.00f }, // SHOULDER_RIGHT
+	{ -0.22f, -0.30f,  0.00f }, // ELBOW_RIGHT
+	{ -0.24f, -0.05f,  0.00f }, // WRIST_RIGHT
+	{  0.10f,  0.02f,  0.00f }, // HIP_LEFT
+	{  0.10f,  0.45f,  0.00f }, // KNEE_LEFT
+	{  0.10f,  0.85f,  0.00f }, // ANKLE_LEFT
+	{  0.10f,  0.90f, -0.12f }, // FOOT_LEFT
+	{ -0.10f,  0.02f,  0.00f }, // HIP_RIGHT
+	{ -0.10f,  0.45f,  0.00f }, // KNEE_RIGHT
+	{ -0.10f,  0.85f,  0.00f }, // ANKLE_RIGHT
+	{ -0.10f,  0.90f, -0.12f }, // FOOT_RIGHT
+	{  0.00f, -0.75f,  0.00f }, // HEAD
+	{  0.00f, -0.72f, -0.10f }, // NOSE
+	{  0.03f, -0.76f, -0.08f }, // EYE_LEFT
+	{  0.07f, -0.74f,  0.00f }, // EAR_LEFT
+	{ -0.03f, -0.76f, -0.08f }, // EYE_RIGHT
+	{ -0.07f, -0.74f,  0.00f }, // EAR_RIGHT
+};
+
+SyntheticSource::SyntheticSource(
+	std::function<void(static_control_type, const wchar_t*)> funPrintMessage,
+	FrameBus & bus
+) :
+	SensorSource(funPrintMessage, bus),
+	m_nNumBodies(1),
+	m_fFps(30.0),
+	m_nLatencyMs(0),
+	m_fImuRate(1600.0),
+	m_tStart(std::chrono::steady_clock::now())
+{
+	Config* pConfig = Config::Instance();
+	pConfig->assign("source/synthetic/numBodies", m_nNumBodies);
+	pConfig->assign("source/synthetic/fps", m_fFps);
+	pConfig->assign("source/synthetic/latencyMs", m_nLatencyMs);
+	pConfig->assign("source/synthetic/imuRate", m_fImuRate);
+	m_nNumBodies = saturate<int>(m_nNumBodies, 0, MAX_NUM_BODIES);
+	m_fFps = max(1.0, m_fFps);
+	m_fImuRate = max(1.0, m_fImuRate);
+}
+
+SyntheticSource::~SyntheticSource()
+{
+	stop();
+}
+
+uint64_t SyntheticSource::getDeviceUsec()
+{
+	return std::chrono::duration_cast<std::chrono::microseconds>(
+		std::chrono::steady_clock::now() - m_tStart).count();
+}
+
+void SyntheticSource::SkeletonProc()
+{
+	if (m_funPrintMessage) m_funPrintMessage(SCT_Kinect, L"Using synthetic sensor source.");
+
+	const auto period = std::chrono::microseconds(static_cast<int64_t>(1e6 / m_fFps));
+	auto tNext = std::chrono::steady_clock::now();
+
+	while (!m_bTerminating)
+	{
+		std::this_thread::sleep_until(tNext);
+		tNext = max(tNext + period, std::chrono::steady_clock::now());
+
+		BodyFrameRef frame = m_Bus.bodyFramePool.acquire();
+		if (!frame)
+			continue;
+		frame->timestamp_usec = getDeviceUsec();
+		frame->num_bodies = m_nNumBodies;
+		for (int i = 0; i < m_nNumBodies; i++)
+		{
+			frame->body_ids[i] = i + 1;
+			generateSkeleton(frame->timestamp_usec / 1e6, i, *frame);
+		}
+		checkOrientationNorms(frame->joints, frame->num_bodies, MIN_ORIENTATION_NORM2, frame->valid_joints);
+		frame->stamps.device_usec = frame->timestamp_usec;
+		frame->stamps.captured_ns = LatencyStats::now();
+
+		// Injected tracker latency
+		if (m_nLatencyMs > 0)
+			std::this_thread::sleep_for(std::chrono::milliseconds(m_nLatencyMs));
+		frame->stamps.popped_ns = LatencyStats::now();
+
+		m_Bus.publishBodyFrame(frame);
+	}
+}
+
+void SyntheticSource::ImuProc()
+{
+	const double fPeriodUsec = 1e6 / m_fImuRate;
+	uint64_t nSamples = 0;
+
+	while (!m_bTerminating)
+	{
+		// Deliver every sample that is due, then sleep, like the device does in bursts
+		uint64_t now = getDeviceUsec();
+		k4a_imu_sample_t imu_samples[IMU_BATCH_SIZE];
+		size_t nCount = 0;
+		for (; nSamples * fPeriodUsec <= now && nCount < IMU_BATCH_SIZE; nSamples++)
+		{
+			double t = nSamples * fPeriodUsec / 1e6;
+			k4a_imu_sample_t & imu_sample = imu_samples[nCount++];
+			imu_sample = {};
+			imu_sample.temperature = 30.0f;
+			imu_sample.acc_timestamp_usec = static_cast<uint64_t>(nSamples * fPeriodUsec);
+			imu_sample.gyro_timestamp_usec = imu_sample.acc_timestamp_usec;
+			imu_sample.acc_sample.xyz.x = -9.81f + 0.05f * static_cast<float>(sin(2 * M_PI * 1.8 * t));
+			imu_sample.acc_sample.xyz.y = 0.02f * static_cast<float>(cos(2 * M_PI * 0.9 * t));
+			imu_sample.acc_sample.xyz.z = 0.1f;
+			imu_sample.gyro_sample.xyz.x = 0.01f * static_cast<float>(sin(2 * M_PI * 0.5 * t));
+			imu_sample.gyro_sample.xyz.y = 0.0f;
+			imu_sample.gyro_sample.xyz.z = 0.0f;
+		}
+		if (nCount > 0)
+			m_Bus.publishImuSamples(imu_samples, nCount, LatencyStats::now());
+		if (nCount < IMU_BATCH_SIZE)
+			std::this_thread::sleep_for(std::chrono::milliseconds(1));
+	}
+}
+
+void SyntheticSource::generateSkeleton(double t, int iBody, BodyFrame & frame)
+{
+	frame.clearBody(iBody);
+	// Walk back and forth between 1.5 m and 4.5 m at 1 m/s, side by side with the other bodies
+	const double tBody = t + 1.3 * iBody;
+	const double fWalkPeriod = 6.0;
+	double fPhaseWalk = fmod(tBody, fWalkPeriod) / fWalkPeriod;
+	double pz = 1.5 + 3.0 * (fPhaseWalk < 0.5 ? 2 * fPhaseWalk : 2 - 2 * fPhaseWalk);
+	double px = (iBody - (m_nNumBodies - 1) / 2.0) * 0.8;
+	double phi = 2 * M_PI * 0.9 * tBody; // gait phase
+	double py = 0.02 * cos(2 * phi);     // vertical bob of the pelvis
+
+	for (int j = 0; j < K4ABT_JOINT_COUNT; j++)
+	{
+		double dz = 0.0;
+		switch (j)
+		{
+		case K4ABT_JOINT_KNEE_LEFT:   dz = 0.15 * sin(phi); break;
+		case K4ABT_JOINT_ANKLE_LEFT:
+		case K4ABT_JOINT_FOOT_LEFT:   dz = 0.30 * sin(phi); break;
+		case K4ABT_JOINT_KNEE_RIGHT:  dz = -0.15 * sin(phi); break;
+		case K4ABT_JOINT_ANKLE_RIGHT:
+		case K4ABT_JOINT_FOOT_RIGHT:  dz = -0.30 * sin(phi); break;
+		case K4ABT_JOINT_ELBOW_LEFT:  dz = -0.10 * sin(phi); break;
+		case K4ABT_JOINT_WRIST_LEFT:  dz = -0.20 * sin(phi); break;
+		case K4ABT_JOINT_ELBOW_RIGHT: dz = 0.10 * sin(phi); break;
+		case K4ABT_JOINT_WRIST_RIGHT: dz = 0.20 * sin(phi); break;
+		}
+		size_t i = BodyFrame::index(iBody, j);
+		frame.joints.px[i] = static_cast<float>(px + c_JointTemplate[j][0]);
+		frame.joints.py[i] = static_cast<float>(py + c_JointTemplate[j][1]);
+		frame.joints.pz[i] = static_cast<float>(pz + c_JointTemplate[j][2] + dz);
+		frame.joints.qw[i] = 1.0f;
+	}
+}
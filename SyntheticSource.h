@@ -0,0 +1,30 @@
+#pragma once
+#include "SensorSource.h"
+
+// Generates walking bodies and IMU samples without any hardware, for load testing.
+// Each body walks back and forth in front of the camera with a simple sinusoidal gait.
+// The injected latency is spent before each body frame is delivered, the same way a
+// slow k4abt_tracker_pop_result() holds up the serial capture path.
+class SyntheticSource : public SensorSource
+{
+private:
+	int                     m_nNumBodies;
+	double                  m_fFps;
+	int                     m_nLatencyMs;
+	double                  m_fImuRate;
+	std::chrono::steady_clock::time_point m_tStart;
+
+public:
+	SyntheticSource(
+		std::function<void(static_control_type, const wchar_t*)> funPrintMessage,
+		FrameBus & bus
+	);
+	~SyntheticSource();
+
+protected:
+	void SkeletonProc() override;
+	void ImuProc() override;
+
+	uint64_t getDeviceUsec();
+	void generateSkeleton(double t, int iBody, BodyFrame & frame);
+};
@@ -0,0 +1,185 @@
+#include "TrackerManager.h"
+#include <cstring>
+
+static void destroyTracker(k4abt_tracker_t tracker)
+{
+	k4abt_tracker_shutdown(tracker);
+	k4abt_tracker_destroy(tracker);
+}
+
+TrackerManager::TrackerManager(std::function<void(static_control_type, const wchar_t*)> funPrintMessage) :
+	m_nCount(1),
+	m_nMaxCount(MAX_TRACKERS),
+	m_Calibration({}),
+	m_BuildCalibration({}),
+	m_bBuilding(false),
+	m_bTerminating(false),
+	m_FailedCalibration({}),
+	m_nRetryTime(0),
+	m_nRetryDelayMs(0),
+	m_funPrintMessage(funPrintMessage)
+{
+}
+
+TrackerManager::~TrackerManager()
+{
+	shutdown();
+}
+
+void TrackerManager::ensureTracker(const k4a_calibration_t & calibration)
+{
+	std::unique_lock<std::mutex> lk(m_Mutex);
+	if (m_bTerminating)
+		return;
+	if (!m_vecTrackers.empty() && isSameCalibration(m_Calibration, calibration))
+	{
+		// Fewer trackers: the threads still holding the others let go once their pops return
+		if (m_vecTrackers.size() > m_nCount)
+		{
+			for (size_t i = m_nCount; i < m_vecTrackers.size(); i++)
+				k4abt_tracker_shutdown(m_vecTrackers[i].get());
+			m_vecTrackers.resize(m_nCount);
+		}
+		if (m_vecTrackers.size() == m_nCount)
+			return;
+	}
+	else if (!m_vecTrackers.empty())
+	{
+		// The trackers do not fit the new calibration. Shut them down so that pending pops
+		// return, and drop them; the threads still holding them release them when they are done.
+		for (auto & pTracker : m_vecTrackers)
+			k4abt_tracker_shutdown(pTracker.get());
+		m_vecTrackers.clear();
+
+		// Printed without the lock, see buildProc()
+		lk.unlock();
+		if (m_funPrintMessage) m_funPrintMessage(SCT_BodyTracker, L"Calibration changed, rebuilding body tracker.");
+		lk.lock();
+		if (m_bTerminating)
+			return;
+	}
+	if (m_bBuilding && isSameCalibration(m_BuildCalibration, calibration))
+		return;
+	if (m_nRetryDelayMs > 0 && isSameCalibration(m_FailedCalibration, calibration) && GetTickCount64() < m_nRetryTime)
+		return;
+
+	// A build in progress picks up the new calibration when it is done
+	m_BuildCalibration = calibration;
+	if (!m_bBuilding)
+	{
+		if (m_ThreadBuild.joinable())
+			m_ThreadBuild.join();
+		m_bBuilding = true;
+		m_ThreadBuild = std::thread(&TrackerManager::buildProc, this);
+	}
+}
+
+void TrackerManager::setCount(size_t nCount)
+{
+	std::lock_guard<std::mutex> lk(m_Mutex);
+	m_nCount = max(size_t(1), min(m_nMaxCount, nCount));
+}
+
+TrackerPtr TrackerManager::get()
+{
+	std::lock_guard<std::mutex> lk(m_Mutex);
+	return m_vecTrackers.empty() ? TrackerPtr() : m_vecTrackers[0];
+}
+
+std::vector<TrackerPtr> TrackerManager::getAll()
+{
+	std::lock_guard<std::mutex> lk(m_Mutex);
+	return m_vecTrackers;
+}
+
+void TrackerManager::shutdown()
+{
+	std::vector<TrackerPtr> vecTrackers;
+	{
+		std::lock_guard<std::mutex> lk(m_Mutex);
+		m_bTerminating = true;
+		vecTrackers.swap(m_vecTrackers);
+	}
+	for (auto & pTracker : vecTrackers)
+		k4abt_tracker_shutdown(pTracker.get());
+	if (m_ThreadBuild.joinable())
+		m_ThreadBuild.join();
+}
+
+void TrackerManager::buildProc()
+{
+	// Messages are printed without the lock: the window thread that shows them may be
+	// waiting for it in shutdown()
+	const size_t BUFFER_LEN = 128;
+	wchar_t pszText[BUFFER_LEN];
+	bool bFailed = false;
+	std::unique_lock<std::mutex> lk(m_Mutex);
+	while (!m_bTerminating && m_vecTrackers.size() < m_nCount)
+	{
+		k4a_calibration_t calibration = m_BuildCalibration;
+		const size_t iTracker = m_vecTrackers.size();
+		const size_t nCount = m_nCount;
+		lk.unlock();
+
+		if (nCount > 1)
+			StringCchPrintf(pszText, BUFFER_LEN, L"Creating body tracker %d of %d.", int(iTracker + 1), int(nCount));
+		else
+			StringCchPrintf(pszText, BUFFER_LEN, L"Creating body tracker.");
+		if (m_funPrintMessage) m_funPrintMessage(SCT_BodyTracker, pszText);
+		k4abt_tracker_t tracker = NULL;
+		k4a_result_t result = k4abt_tracker_create(&calibration, &tracker);
+
+		lk.lock();
+		if (K4A_FAILED(result) && iTracker > 0)
+		{
+			// Not a passing failure like a busy GPU: the SDK, or the GPU memory, does not allow
+			// another tracker in this process. Keep those already built, for good.
+			m_nMaxCount = iTracker;
+			m_nCount = min(m_nCount, m_nMaxCount);
+			StringCchPrintf(pszText, BUFFER_LEN, L"Failed to create body tracker %d, using %d.", int(iTracker + 1), int(iTracker));
+			bFailed = true;
+			break;
+		}
+		if (K4A_FAILED(result))
+		{
+			// The next ensureTracker() after the delay tries again, e.g. once the GPU is free
+			const int MAX_RETRY_DELAY_MS = 60000;
+			m_nRetryDelayMs = m_nRetryDelayMs > 0 ? min(MAX_RETRY_DELAY_MS, 2 * m_nRetryDelayMs) : 1000;
+			m_nRetryTime = GetTickCount64() + m_nRetryDelayMs;
+			m_FailedCalibration = calibration;
+			StringCchPrintf(pszText, BUFFER_LEN, L"Failed to create body tracker, retrying in %d s.", m_nRetryDelayMs / 1000);
+			bFailed = true;
+			break;
+		}
+		m_nRetryDelayMs = 0;
+		// The trackers built so far were dropped if the calibration changed meanwhile
+		if (!m_bTerminating && isSameCalibration(calibration, m_BuildCalibration) && m_vecTrackers.size() < m_nCount &&
+			(m_vecTrackers.empty() || isSameCalibration(calibration, m_Calibration)))
+		{
+			m_vecTrackers.push_back(TrackerPtr(tracker, destroyTracker));
+			m_Calibration = calibration;
+			lk.unlock();
+			if (m_funPrintMessage) m_funPrintMessage(SCT_BodyTracker, L"Successfully created body tracker.");
+			lk.lock();
+			continue;
+		}
+
+		// Outdated while it was being created
+		lk.unlock();
+		destroyTracker(tracker);
+		lk.lock();
+	}
+	m_bBuilding = false;
+	lk.unlock();
+	if (bFailed && m_funPrintMessage)
+		m_funPrintMessage(SCT_BodyTracker, pszText);
+}
+
+bool TrackerManager::isSameCalibration(const k4a_calibration_t & a, const k4a_calibration_t & b)
+{
+	// Both come from k4a_device_get_calibration(), which fills in the whole structure. The
+	// tracker only uses the depth camera, so a change of the color camera, e.g. when it is
+	// turned off by the capture profile, keeps the tracker.
+	return a.depth_mode == b.depth_mode &&
+		memcmp(&a.depth_camera_calibration, &b.depth_camera_calibration, sizeof(k4a_calibration_camera_t)) == 0;
+}
@@ -0,0 +1,70 @@
+#pragma once
+#include "stdafx.h"
+#include <memory>
+#include <mutex>
+#include <thread>
+#include <type_traits>
+#include <vector>
+
+// Shared handle to a body tracker. The tracker is destroyed when the last handle goes away,
+// so a thread that holds one can keep popping even while the tracker is being replaced.
+typedef std::shared_ptr<std::remove_pointer<k4abt_tracker_t>::type> TrackerPtr;
+
+// Trackers that can share the captures of the device, see TrackerManager::setCount()
+const size_t MAX_TRACKERS = 4;
+
+// Owns the body tracker of the live device across device reconnects. Creating a tracker
+// loads the model and takes seconds, so the tracker is kept as long as the device reports
+// the depth camera calibration it was created with. Only when that changes is it rebuilt, on
+// a background thread, while get() returns no tracker.
+// Several trackers can be created from the same calibration, so that the captures can be
+// distributed over them. They are built one after the other, and those already built are
+// returned by getAll() meanwhile. All of them run on the default GPU. Whether the SDK allows
+// more than one tracker per process depends on its version; if another tracker cannot be
+// created, the count is capped at the trackers already built instead of retrying.
+class TrackerManager
+{
+private:
+	std::mutex              m_Mutex;
+	std::vector<TrackerPtr> m_vecTrackers;
+	size_t                  m_nCount;           // the number of trackers to keep
+	size_t                  m_nMaxCount;        // lowered when the SDK refuses another tracker
+	k4a_calibration_t       m_Calibration;      // the calibration m_vecTrackers were created with
+	k4a_calibration_t       m_BuildCalibration; // the calibration to build a tracker for
+	bool                    m_bBuilding;
+	bool                    m_bTerminating;
+	// After a failed build, the same calibration is not tried again before m_nRetryTime. The
+	// delay doubles with every failure.
+	k4a_calibration_t       m_FailedCalibration;
+	INT64                   m_nRetryTime;
+	int                     m_nRetryDelayMs;
+	std::thread             m_ThreadBuild;
+
+	// Status update
+	std::function<void(static_control_type, const wchar_t *)>   m_funPrintMessage;
+
+public:
+	explicit TrackerManager(std::function<void(static_control_type, const wchar_t*)> funPrintMessage);
+	~TrackerManager();
+
+	// Makes sure that there is, or soon will be, a tracker for the calibration of a freshly
+	// opened device. Never blocks on tracker creation.
+	void ensureTracker(const k4a_calibration_t & calibration);
+
+	// The number of trackers, from 1 to MAX_TRACKERS, or fewer if the SDK refused one before.
+	// Applied by the next ensureTracker(): more trackers are built in the background, fewer are
+	// shut down.
+	void setCount(size_t nCount);
+
+	// The first tracker, or an empty handle while none is ready
+	TrackerPtr get();
+	// The trackers that are ready
+	std::vector<TrackerPtr> getAll();
+
+	// Unblocks pending pops, waits for a build in progress and releases the tracker
+	void shutdown();
+
+private:
+	void buildProc();
+	static bool isSameCalibration(const k4a_calibration_t & a, const k4a_calibration_t & b);
+};
@@ -0,0 +1,63 @@
+#pragma once
+#include "CsvLogger.h"
+
+// A logger whose columns are fixed at compile time by a record type. The record provides
+//
+//	template <typename Visitor> void fields(Visitor & visitor) const
+//
+// which calls visitor(name, value) for every column in order, with a value of type uint64_t,
+// float or const char * (a string that outlives the logger, e.g. a string literal). The
+// overload for each column is resolved at compile time, so logging a record is straight-line
+// code that copies its values into the row. See LogRecords.h for the records of the session.
+//
+// The name is a string literal, or any type with a getLogColumnName() overload that returns
+// a string. It is only looked at once to write the header, so a record with generated column
+// names does not pay for them per row.
+inline const char * getLogColumnName(const char * name) { return name; }
+
+template <typename Record>
+class TypedLogger : public LogFile
+{
+private:
+	struct ColumnCollector
+	{
+		vector_log_column_t & columns;
+		template <typename Name> void operator()(const Name & name, uint64_t) { columns.emplace_back(getLogColumnName(name), ValueType::type_uint64); }
+		template <typename Name> void operator()(const Name & name, float) { columns.emplace_back(getLogColumnName(name), ValueType::type_f); }
+		template <typename Name> void operator()(const Name & name, const char *) { columns.emplace_back(getLogColumnName(name), ValueType::type_str); }
+	};
+
+	struct RowEncoder
+	{
+		uint64_t * pSlots;
+		template <typename Name> void operator()(const Name &, uint64_t value) { *pSlots++ = value; }
+		template <typename Name> void operator()(const Name &, float value) { *pSlots++ = ValueType::storeFloat(value); }
+		template <typename Name> void operator()(const Name &, const char * value) { *pSlots++ = ValueType::storeString(value); }
+	};
+
+	static vector_log_column_t getColumns()
+	{
+		vector_log_column_t columns;
+		ColumnCollector collector = { columns };
+		Record().fields(collector);
+		return columns;
+	}
+
+public:
+	// Argument "name" is suffixed to the file name.
+	// Be sure to instantiate it as a member variable or static local variable
+	explicit TypedLogger(const char * name) : LogFile(name, getColumns()) {}
+
+	void log(const Record & record)
+	{
+		if (isOpen() == false) return;
+		logRow([&record](uint64_t * pSlots) { encode(record, pSlots); });
+	}
+
+	// Stores the values of the record, one slot per column
+	static void encode(const Record & record, uint64_t * pSlots)
+	{
+		RowEncoder encoder = { pSlots };
+		record.fields(encoder);
+	}
+};
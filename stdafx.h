@@ -78,11 +78,15 @@ enum static_control_type
 {
 	SCT_Kinect = 0,
 	SCT_BodyTracker,
+	SCT_Pipeline,
 	SCT_BodyInfo,
 	SCT_IMU,
 	SCT_RosSocket,
 	SCT_RosSocket_Skeleton,
 	SCT_RosSocket_IMU,
 	SCT_Params,
+	SCT_Latency,
+	SCT_Startup,
+	SCT_Logger,
 	SCT_Count
 };
\ No newline at end of file